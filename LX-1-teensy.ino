@@ -24,6 +24,14 @@
 #include "fan.h"
 #include "ODriveLib.h"
 #include "stormbreaker.h"
+#include "effects.h"
+#include "motion.h"
+#include "monitor.h"
+#include "thermal.h"
+#include "profiler.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "startup.h"
 #include "led.h"
 
 /*Errors-------------------------------------------------------------------------------------------*/
@@ -52,20 +60,105 @@ template<>        inline Print& operator <<(Print &obj, float arg) { obj.print(a
 
 /* Variables --------------------------------------------------------------------------------------*/
 ODriveClass odrive(odrive_serial);
+MotionPlanner motion(odrive);
+EffectsEngine effects(motion);
+StormBreaker thor(odrive, motion, effects);
+StartupSequencer startup(odrive, thor);
+FollowingMonitor monitor(odrive, motion, thor);
+#ifdef FANS
+    ThermalManager thermal(odrive, motion, startup);
+#endif
+Scheduler scheduler;
+#ifdef TESTING
+    Debug debugger(odrive, startup, scheduler);
+#endif
+
+#if defined LED_RING
+    bool rainbowRunning = true;
+#endif
+
+/* Functions --------------------------------------------------------------------------------------*/
+/**
+ * @brief   Ends the boot rainbow once homed and the first command arrives
+ * @param   None
+ * @return  None
+ */
+static void stopRainbow()
+{
+    #if defined HEAD && defined LED_RING
+        if (rainbowRunning && startup.done()){
+            setAllColour(GREEN);
+            rainbowRunning = false;
+        }
+    #endif
+}
+
+// Scheduler tasks and release conditions
+static bool commandReady()  { return pi_serial.available() >= 2; }
+static bool homing()        { return !startup.done(); }
+static bool homed()         { return startup.done(); }
+static bool controlTick()   { return startup.done() && motion.tickPending(); }
+static bool stopReady()     { return startup.done() && thor.stopPending(); }
+
+static void commandTask()
+{
+    if (pi_serial.available() >= TRACE_BACKLOG_LEVEL)
+        traceEvent(TRACE_PI_BACKLOG, pi_serial.available(), 0);
+
+    stopRainbow();
+    thor.serviceStormBreaker();
+}
+
+static void startupTask()   { startup.service(); }
+// effects are evaluated on the control tick, so their offsets go out with it
+static void motionTask()    { effects.service(); motion.service(); }
+static void trackingTask()  { thor.serviceTracking(); }
+static void stopTask()      { thor.serviceStops(); }
+static void feedbackTask()  { monitor.service(); }
+
 #ifdef TESTING
-    Debug debugger(odrive);
+    static bool debugReady() { return SerialUSB.available() > 0; }
+
+    static void debugTask()
+    {
+        if (SerialUSB.available() >= 2)
+            stopRainbow();
+        debugger.serviceDebug();
+    }
+
+    static bool traceReady() { return debugger.tracing(); }
+    static void traceTask()  { traceDrain(SerialUSB, SerialUSB.availableForWrite()); }
 #endif
-StormBreaker thor(odrive);
+
+// one section histogram per report keeps each frame inside the UART buffer
+static void profileTask()
+{
+    static uint8_t section = 0;
+    uint8_t data[PROFILE_PACKED_SIZE];
+
+    thor.sendTelemetry(StormBreaker::TELEMETRY_PROFILE, data, profilePack((ProfileSection_t)section, data, sizeof(data)));
+    section = (section + 1) % PROFILE_SECTION_COUNT;
+    if (section == 0)
+        profileReset();
+}
 
 #ifdef FANS
-    elapsedMillis temperatureCheckTiming;
+    static void fanTask()       { runFans(); }
+    static void thermalTask()   { thermal.service(); }
+
+    static void fanReportTask()
+    {
+        uint8_t data[FAN_ZONES * FAN_PACKED_SIZE];
+        thor.sendTelemetry(StormBreaker::TELEMETRY_FANS, data, fanPack(data, sizeof(data)));
+    }
 #endif
 
-#if defined LED_RING
-    elapsedMillis rainbowTiming;
+#if defined HEAD && defined LED_RING
+    // rainbow until homed and the Pi starts sending
+    static bool rainbowReady()  { return rainbowRunning; }
+    static void rainbowTask()   { rainbow(); }
 #endif
 
-/* Functions --------------------------------------------------------------------------------------*/
 /**
  * @brief   The Arduino setup function
  * @param   None
@@ -73,6 +166,8 @@ StormBreaker thor(odrive);
  */
 void setup()
 {
+    profileBegin();
+
     // power-on status LED
     pinMode(LED_BUILTIN, OUTPUT);
     digitalWrite(LED_BUILTIN, HIGH);
@@ -105,40 +200,35 @@ void setup()
         pi_serial.println("Hi Raspberry Pi how are you today? :D");
     #endif
 
-    #if defined HEAD && defined LED_RING
-        rainbow(RAINBOW_DELAY);
+    #ifdef FANS
+        initFans();
     #endif
 
-    odrive_startup_sequence(odrive);
-
-    #if defined HEAD && defined LED_RING
-        rainbowTiming = 0;
-        if (rainbowTiming < 100)
-            rainbow(RAINBOW_DELAY);
-    #else
-        delay(100);
+    // periods and deadlines in us, command input always runs before control and housekeeping
+    scheduler.addTask("command",  commandTask,  0,       2000,    Scheduler::PRIORITY_COMMAND, commandReady);
+    #ifdef TESTING
+        scheduler.addTask("debug",    debugTask,    0,       20000,   Scheduler::PRIORITY_COMMAND, debugReady);
+        scheduler.addTask("trace",    traceTask,    1000,    5000,    Scheduler::PRIORITY_HOUSEKEEPING, traceReady);
     #endif
-
-    lx1_startup_sequence(odrive, thor);
-
+    scheduler.addTask("startup",  startupTask,  1000,    5000,    Scheduler::PRIORITY_CONTROL, homing);
+    scheduler.addTask("motion",   motionTask,   0,       1000000 / CONTROL_RATE, Scheduler::PRIORITY_CONTROL, controlTick);
+    scheduler.addTask("feedback", feedbackTask, 1000,    1000,    Scheduler::PRIORITY_CONTROL, homed);
+    scheduler.addTask("tracking", trackingTask, 100000,  10000,   Scheduler::PRIORITY_CONTROL, homed);
+    scheduler.addTask("stop",     stopTask,     0,       10000,   Scheduler::PRIORITY_CONTROL, stopReady);
     #ifdef FANS
-        initFans();
-        temperatureCheckTiming = 0;
+        scheduler.addTask("fans",     fanTask,      FAN_SERVICE_INTERVAL * 1000UL, 1000, Scheduler::PRIORITY_HOUSEKEEPING);
+        scheduler.addTask("thermal",  thermalTask,  1000000, 1000,    Scheduler::PRIORITY_HOUSEKEEPING);
+        scheduler.addTask("fan report", fanReportTask, FAN_REPORT_INTERVAL * 1000UL, 10000, Scheduler::PRIORITY_HOUSEKEEPING);
     #endif
-
+    scheduler.addTask("profile",  profileTask,  PROFILE_REPORT_INTERVAL * 1000UL, 10000, Scheduler::PRIORITY_HOUSEKEEPING);
     #if defined HEAD && defined LED_RING
-        #if defined TESTING
-            while(SerialUSB.available() < 2 && pi_serial.available() < 2){
-                rainbow(RAINBOW_DELAY);
-            }
-            setAllColour(GREEN);
-        #else
-            while(pi_serial.available() < 2){
-                rainbow(RAINBOW_DELAY);
-            }
-            setAllColour(GREEN);
-        #endif
+        scheduler.addTask("rainbow",  rainbowTask,  RAINBOW_DELAY * 1000UL, RAINBOW_DELAY * 1000UL, Scheduler::PRIORITY_HOUSEKEEPING, rainbowReady);
     #endif
+
+    motion.begin();
+
+    // homing runs as a task so IDENTIFY and the LED ring keep being serviced
+    startup.begin();
 }
 
 /**
@@ -148,18 +238,6 @@ void setup()
  */
 void loop()
 {
-    if(pi_serial.available() >= 2)
-        thor.serviceStormBreaker();
-
-    #ifdef TESTING
-        if(SerialUSB.available())
-            debugger.serviceDebug();
-    #endif
-
-    #ifdef FANS
-        if (temperatureCheckTiming >= temperatureTimingThreshold){
-            runFans();
-            temperatureCheckTiming = 0;
-        }
-    #endif
+    PROFILE_SECTION(PROFILE_LOOP);
+    scheduler.run();
 }
@@ -52,12 +52,17 @@ static const int kMotorStrideBool = 4;
 static const int kMotorOffsetUint16 = 0;
 static const int kMotorStrideUint16 = 2;
 
+static const unsigned long kStatePollMin = 2;       // ms, first state poll interval
+static const unsigned long kStatePollMax = 100;     // ms, the interval doubles up to this
+static const unsigned long kStateTimeout = 10000;   // ms
+static const unsigned long kFeedbackTimeout = 1000; // ms
+
 // Print with stream operator
 template<class T> inline Print& operator <<(Print &obj,     T arg) { obj.print(arg);    return obj; }
 template<>        inline Print& operator <<(Print &obj, float arg) { obj.print(arg, 4); return obj; }
 
 ODriveClass::ODriveClass(Stream& serial)
-    : serial_(serial) {}
+    : serial_(serial), feedback_axis_(-1), feedback_discard_(false), feedback_length_(0) {}
 
 // ODrive Movement Commands
 void ODriveClass::SetPosition(int motor_number, float position) {
@@ -88,11 +93,117 @@ void ODriveClass::TrapezoidalMove(int motor_number, float position){
     serial_ << "t " << motor_number << " " << position << "\n";
 }
 
-void ODriveClass::ReadFeedback(int motor_number){
+// Parses a feedback reply, position and velocity come back on one line
+static bool parseFeedback(const char* line, float& position, float& velocity){
+    char* end;
+    float parsed = strtod(line, &end);
+
+    if (end == line)
+        return false;
+    position = parsed;
+    velocity = strtod(end, NULL);
+    return true;
+}
+
+// Feedback replies are the only ones with two numbers, property and state reads return one
+static bool isFeedback(const char* line){
+    char* end;
+    strtod(line, &end);
+    if (end == line)
+        return false;
+
+    const char* second = end;
+    strtod(second, &end);
+    return end != second;
+}
+
+// Blocking feedback read, Feedback keeps its previous sample when the reply times out
+bool ODriveClass::ReadFeedback(int motor_number){
+    finishFeedback();
+
+    // a late background reply would look like ours, let it arrive or give up on it first
+    while (feedback_discard_)
+        ServiceFeedback();
+
+    uint32_t request_time = micros();
+    serial_ << "f " << motor_number << "\n";
+    String reply = readString();
+    if (!parseFeedback(reply.c_str(), Feedback.position, Feedback.velocity))
+        return false;
+    // the ODrive samples somewhere between request and reply, take the midpoint
+    Feedback.timestamp = request_time + (micros() - request_time) / 2;
+    return true; // read via:  odrive_.Feedback. in stormbreaker.
+}
+
+// Sends a feedback request without waiting, the reply is collected by ServiceFeedback()
+bool ODriveClass::RequestFeedback(int motor_number){
+    if (feedback_axis_ >= 0 || feedback_discard_)
+        return false;
+
+    feedback_axis_ = motor_number;
+    feedback_length_ = 0;
+    feedback_request_time_ = micros();
     serial_ << "f " << motor_number << "\n";
-    Feedback.position = readFloat();
-    Feedback.velocity = readFloat();
-    return; // read via:  odrive_.Feedback. in stormbreaker.
+    return true;
+}
+
+// Collects whatever part of the feedback reply has arrived, true once it is complete
+bool ODriveClass::ServiceFeedback(){
+    // a lost reply must not block the next request, but a late one is still discarded
+    if (feedback_axis_ >= 0 && micros() - feedback_request_time_ >= kFeedbackTimeout * 1000UL){
+        feedback_axis_ = -1;
+        feedback_discard_ = true;
+        feedback_expire_time_ = micros();
+        return false;
+    }
+
+    // nothing else has been sent, so the next line can only be the expired reply
+    while (feedback_discard_ && serial_.available()){
+        if (serial_.read() == '\n')
+            feedback_discard_ = false;
+    }
+    if (feedback_discard_ && micros() - feedback_expire_time_ >= kFeedbackTimeout * 1000UL)
+        feedback_discard_ = false;
+
+    while (feedback_axis_ >= 0 && serial_.available()){
+        char c = serial_.read();
+        if (c == '\n'){
+            storeFeedback();
+            return true;
+        }
+        if (feedback_length_ < sizeof(feedback_line_) - 1)
+            feedback_line_[feedback_length_++] = c;
+    }
+    return false;
+}
+
+// Blocking reads wait out an outstanding feedback reply so replies stay in order,
+// ServiceFeedback() gives up on it after kFeedbackTimeout
+void ODriveClass::finishFeedback(){
+    while (feedback_axis_ >= 0 && !ServiceFeedback()){}
+}
+
+void ODriveClass::storeFeedback(){
+    AsyncFeedback_t& feedback = AsyncFeedback[feedback_axis_];
+
+    feedback_line_[feedback_length_] = '\0';
+    if (parseFeedback(feedback_line_, feedback.position, feedback.velocity)){
+        feedback.timestamp = feedback_request_time_ + (micros() - feedback_request_time_) / 2;
+        feedback.fresh = true;
+    }
+
+    feedback_axis_ = -1;
+}
+
+// Integer encoder count, exact where the float position is not
+int32_t ODriveClass::ReadShadowCount(int motor_number){
+    serial_ << "r axis" << motor_number << ".encoder.shadow_count\n";
+    return readInt();
+}
+
+// Moves the encoder count, and the position estimate with it, without moving the axis
+void ODriveClass::SetLinearCount(int axis, int32_t count){
+    WriteProperty(axis, "encoder.set_linear_count", count);
 }
 
 // ODrive Control Mode Command
@@ -120,7 +231,12 @@ void ODriveClass::MotorPreCalibrated(int axis, bool request){
 
 // Encoder Configuration Commands
 int ODriveClass::EncoderReadyStatus(int axis){
-    serial_ << "r axis" << axis << ".encoder.is_ready";
+    serial_ << "r axis" << axis << ".encoder.is_ready\n";
+    return readInt();
+}
+
+int ODriveClass::EncoderIndexFound(int axis){
+    serial_ << "r axis" << axis << ".encoder.index_found\n";
     return readInt();
 }
 
@@ -222,6 +338,11 @@ float ODriveClass::BusVoltage(void){
     return readFloat();
 }
 
+String ODriveClass::SerialNumber(void){
+    serial_ << "r serial_number\n";
+    return readString();
+}
+
 void ODriveClass::SaveConfiguration(void){
     serial_ << "ss\n";
 }
@@ -238,6 +359,38 @@ void ODriveClass::Reboot(void){
     while(!odrive_serial);
 }
 
+// Property Access
+// False when the read timed out or the reply was not a number, value is left as it was
+bool ODriveClass::ReadProperty(int axis, const char* property, float& value){
+    if (axis >= 0)
+        serial_ << "r axis" << axis << "." << property << "\n";
+    else
+        serial_ << "r " << property << "\n";
+
+    String reply = readString();
+    char* end;
+    float parsed = strtod(reply.c_str(), &end);
+
+    if (end == reply.c_str())
+        return false;
+    value = parsed;
+    return true;
+}
+
+void ODriveClass::WriteProperty(int axis, const char* property, float value){
+    if (axis >= 0)
+        serial_ << "w axis" << axis << "." << property << " " << value << "\n";
+    else
+        serial_ << "w " << property << " " << value << "\n";
+}
+
+void ODriveClass::WriteProperty(int axis, const char* property, int32_t value){
+    if (axis >= 0)
+        serial_ << "w axis" << axis << "." << property << " " << value << "\n";
+    else
+        serial_ << "w " << property << " " << value << "\n";
+}
+
 // General params
 float ODriveClass::readFloat() {
     return readString().toFloat();
@@ -252,21 +405,70 @@ int32_t ODriveClass::readState(int axis) {
     return readInt();
 }
 
+int32_t ODriveClass::readAxisError(int axis) {
+    serial_ << "r axis" << axis << ".error\n";
+    return readInt();
+}
+
 // State Helper
 bool ODriveClass::run_state(int axis, int requested_state, bool wait) {
-    int timeout_ctr = 100;
+    return run_state(axis, requested_state, wait, kStateTimeout, NULL);
+}
+
+bool ODriveClass::run_state(int axis, int requested_state, bool wait, unsigned long timeout, unsigned long* elapsed) {
     serial_ << "w axis" << axis << ".requested_state " << requested_state << '\n';
-    if (wait) {
-        do {
-            delay(100);
-            serial_ << "r axis" << axis << ".current_state\n";
-        } while (readInt() != AXIS_STATE_IDLE && --timeout_ctr > 0);
+    if (!wait)
+        return true;
+
+    // calibrations and searches return to idle, control states stay in place
+    if (requested_state == AXIS_STATE_CLOSED_LOOP_CONTROL || requested_state == AXIS_STATE_SENSORLESS_CONTROL)
+        return wait_for_state(axis, requested_state, timeout, elapsed);
+    else
+        return wait_for_state(axis, AXIS_STATE_IDLE, timeout, elapsed);
+}
+
+// Single non-blocking poll of a state transition started with run_state()
+ODriveClass::StateWait_t ODriveClass::check_state(int axis, int target_state) {
+    // the ODrive clears requested_state once it has acted on it
+    serial_ << "r axis" << axis << ".requested_state\n";
+    if (readInt() != AXIS_STATE_UNDEFINED)
+        return STATE_PENDING;
+
+    int32_t current_state = readState(axis);
+    if (current_state != target_state && current_state != AXIS_STATE_IDLE)
+        return STATE_PENDING;
+
+    AxisError = readAxisError(axis);
+    if (current_state != target_state || AxisError != 0)
+        return STATE_FAILED;
+
+    return STATE_REACHED;
+}
+
+// Polls with a doubling interval so quick transitions are seen within a few ms
+bool ODriveClass::wait_for_state(int axis, int target_state, unsigned long timeout, unsigned long* elapsed) {
+    unsigned long start = millis();
+    unsigned long interval = kStatePollMin;
+    StateWait_t status;
+
+    while ((status = check_state(axis, target_state)) == STATE_PENDING && millis() - start < timeout) {
+        delay(interval);
+        if (interval < kStatePollMax)
+            interval = min(interval * 2, kStatePollMax);
     }
 
-    return timeout_ctr > 0;
+    if (elapsed != NULL)
+        *elapsed = millis() - start;
+
+    if (status == STATE_PENDING)
+        AxisError = readAxisError(axis);
+
+    return status == STATE_REACHED;
 }
 
 String ODriveClass::readString() {
+    finishFeedback();
+
     String str = "";
     static const unsigned long timeout = 1000;
     unsigned long timeout_start = millis();
@@ -277,9 +479,20 @@ String ODriveClass::readString() {
             }
         }
         char c = serial_.read();
-        if (c == '\n')
-            break;
-        str += c;
+        if (c != '\n') {
+            str += c;
+            continue;
+        }
+
+        // the request was already sent, so the expired feedback reply is told apart by its
+        // shape, or is the rest of a line that had started to arrive
+        if (feedback_discard_ && (feedback_length_ > 0 || isFeedback(str.c_str()))) {
+            feedback_discard_ = false;
+            str = "";
+            continue;
+        }
+        feedback_discard_ = false;
+        break;
     }
     return str;
 }
@@ -63,6 +63,12 @@ public:
         AXIS_STATE_ENCODER_DIR_FIND = 10
     };
 
+    enum StateWait_t {
+        STATE_PENDING = 0,      //<! request not consumed or target state not reached yet
+        STATE_REACHED = 1,
+        STATE_FAILED = 2        //<! the axis dropped to idle with an error, see AxisError
+    };
+
     enum MotorType_t {
         MOTOR_TYPE_HIGH_CURRENT = 0,
         MOTOR_TYPE_LOW_CURRENT = 1,
@@ -85,8 +91,19 @@ public:
     struct Feedback_t {
         float position;
         float velocity;
+        uint32_t timestamp; // micros() at the estimated sampling instant
     } Feedback;
 
+    // filled in the background by RequestFeedback() and ServiceFeedback()
+    struct AsyncFeedback_t {
+        float position;
+        float velocity;
+        uint32_t timestamp; // micros() at the estimated sampling instant
+        bool fresh;         // set on every reply, cleared by the reader
+    } AsyncFeedback[2];
+
+    int32_t AxisError;  // axis.error read when a state wait fails
+
     ODriveClass(Stream& serial);
 
     // Commands
@@ -97,7 +114,11 @@ public:
     void SetVelocity(int motor_number, float velocity, float current_feedforward);
     void SetCurrent(int motor_number, float current);
     void TrapezoidalMove(int motor_number, float position);
-    void ReadFeedback(int motor_number);
+    bool ReadFeedback(int motor_number);
+    bool RequestFeedback(int motor_number);
+    bool ServiceFeedback();
+    int32_t ReadShadowCount(int motor_number);
+    void SetLinearCount(int axis, int32_t count);
 
     // Control Mode
     void SetControlModeVel(int axis);
@@ -110,6 +131,7 @@ public:
 
     // Encoder Configuration Commands
     int EncoderReadyStatus(int axis);
+    int EncoderIndexFound(int axis);
     void EncoderUseIndex(int axis, bool request);
     void EncoderPreCalibrated(int axis, bool request);
     void EncoderBandwidth(int axis, float bandwidth);
@@ -143,21 +165,40 @@ public:
 
     // System Commands
     float BusVoltage(void);
+    String SerialNumber(void);
     void SaveConfiguration(void);
     void EraseConfiguration(void);
     void Reboot(void);
 
+    // Property Access, axis < 0 addresses the root object
+    bool ReadProperty(int axis, const char* property, float& value);
+    void WriteProperty(int axis, const char* property, float value);
+    void WriteProperty(int axis, const char* property, int32_t value);
+
     // General params
     float readFloat();
     int32_t readInt();
     int32_t readState(int axis);
+    int32_t readAxisError(int axis);
 
     // State helper
     bool run_state(int axis, int requested_state, bool wait);
+    bool run_state(int axis, int requested_state, bool wait, unsigned long timeout, unsigned long* elapsed);
+    StateWait_t check_state(int axis, int target_state);
+    bool wait_for_state(int axis, int target_state, unsigned long timeout, unsigned long* elapsed);
 private:
     String readString();
+    void finishFeedback();
+    void storeFeedback();
 
     Stream& serial_;
+
+    int feedback_axis_;             // axis of the outstanding feedback request, -1 if none
+    uint32_t feedback_request_time_;
+    bool feedback_discard_;         // an expired reply may still arrive and must not be read as another answer
+    uint32_t feedback_expire_time_;
+    char feedback_line_[32];
+    uint8_t feedback_length_;
 };
 
 #endif //ODRIVELIB_H
@@ -29,9 +29,16 @@
 #define T_LOW_REGISTER 0x02
 #define T_HIGH_REGISTER 0x03
 
+#define READ_TIMEOUT 20	// ms before a non-blocking read is abandoned
+
 TMP102::TMP102(byte address)
 {
   _address = address;
+  _readState = READ_IDLE;
+  _readStart = 0;
+  _readFailed = false;
+  _lastTemp = 0.0f;
+  _lastReadTime = 0;
 }
 
 void TMP102::begin(void)
@@ -63,7 +70,6 @@ byte TMP102::readRegister(bool registerNumber){
 float TMP102::readTempC(void)
 {
   int registerByte[2];	// Store the data from the register here
-  int digitalTemp;  // Temperature stored in TMP102 register
 
   // Read Temperature
   // Change pointer address to temperature register (0)
@@ -72,27 +78,35 @@ float TMP102::readTempC(void)
   registerByte[0] = readRegister(0);
   registerByte[1] = readRegister(1);
 
+  return decodeTempC(registerByte[0], registerByte[1]);
+}
+
+
+float TMP102::decodeTempC(byte msb, byte lsb)
+{
+  int digitalTemp;  // Temperature stored in TMP102 register
+
   // Bit 0 of second byte will always be 0 in 12-bit readings and 1 in 13-bit
-  if(registerByte[1]&0x01)	// 13 bit mode
+  if(lsb&0x01)	// 13 bit mode
   {
 	// Combine bytes to create a signed int
-    digitalTemp = ((registerByte[0]) << 5) | (registerByte[1] >> 3);
+    digitalTemp = (msb << 5) | (lsb >> 3);
 	// Temperature data can be + or -, if it should be negative,
-	// convert 13 bit to 16 bit and use the 2s compliment.
+	// convert 13 bit to 32 bit and use the 2s compliment.
     if(digitalTemp > 0xFFF)
 	{
-      digitalTemp |= 0xE000;
+      digitalTemp -= 0x2000;
     }
   }
   else	// 12 bit mode
   {
 	// Combine bytes to create a signed int
-    digitalTemp = ((registerByte[0]) << 4) | (registerByte[1] >> 4);
+    digitalTemp = (msb << 4) | (lsb >> 4);
 	// Temperature data can be + or -, if it should be negative,
-	// convert 12 bit to 16 bit and use the 2s compliment.
+	// convert 12 bit to 32 bit and use the 2s compliment.
     if(digitalTemp > 0x7FF)
 	{
-      digitalTemp |= 0xF000;
+      digitalTemp -= 0x1000;
     }
   }
   // Convert digital reading to analog temperature (1-bit is equal to 0.0625 C)
@@ -100,6 +114,100 @@ float TMP102::readTempC(void)
 }
 
 
+bool TMP102::startReadTempC(void)
+{
+  // Both sensors share the bus, only one transfer may run at a time
+  if(_readState != READ_IDLE || !Wire.done())
+  {
+    return false;
+  }
+
+  // Point to the temperature register in the background
+  Wire.beginTransmission(_address);
+  Wire.write(TEMPERATURE_REGISTER);
+  Wire.sendTransmission(I2C_STOP);
+
+  _readState = READ_POINTER;
+  _readStart = millis();
+  return true;
+}
+
+
+bool TMP102::serviceRead(void)
+{
+  if(_readState == READ_IDLE)
+  {
+    return false;
+  }
+
+  if(!Wire.done())
+  {
+    // A wedged transfer is given up on, the bus stays busy until it ends
+    if(millis() - _readStart > READ_TIMEOUT)
+    {
+      return finishRead(true);
+    }
+    return false;
+  }
+
+  if(Wire.getError())
+  {
+    return finishRead(true);
+  }
+
+  if(_readState == READ_POINTER)
+  {
+    // Read both temperature bytes in the background
+    Wire.sendRequest(_address, 2, I2C_STOP);
+    _readState = READ_DATA;
+    return false;
+  }
+
+  if(Wire.available() < 2)
+  {
+    return finishRead(true);
+  }
+
+  byte msb = Wire.read();
+  byte lsb = Wire.read();
+  _lastTemp = decodeTempC(msb, lsb);
+  _lastReadTime = millis();
+  return finishRead(false);
+}
+
+
+bool TMP102::finishRead(bool failed)
+{
+  _readFailed = failed;
+  _readState = READ_IDLE;
+  return true;
+}
+
+
+bool TMP102::readPending(void)
+{
+  return _readState != READ_IDLE;
+}
+
+
+bool TMP102::readFailed(void)
+{
+  return _readFailed;
+}
+
+
+float TMP102::lastTempC(void)
+{
+  return _lastTemp;
+}
+
+
+unsigned long TMP102::lastReadTime(void)
+{
+  return _lastReadTime;
+}
+
+
 float TMP102::readTempF(void)
 {
 	return readTempC()*9.0/5.0 + 32.0;
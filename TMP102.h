@@ -78,8 +78,28 @@ class TMP102
 		// 1 - Thermostat Mode: Active when temp > T_HIGH until any read operation occurs
 		void setAlertMode(bool mode);
 
+		// Non-blocking temperature read using i2c_t3 background transfers,
+		// start a read then call serviceRead() until it returns true
+		bool startReadTempC(void);	// Starts a read, false if the I2C bus is busy
+		bool serviceRead(void);	// Advances the read, returns true once it has finished
+		bool readPending(void);	// True while a read is in progress
+		bool readFailed(void);	// True if the last read ended with an I2C error or timeout
+		float lastTempC(void);	// Temperature of the last successful read
+		unsigned long lastReadTime(void);	// millis() of the last successful read
+
+		// Converts the temperature register bytes, 12 or 13 bit (extended mode)
+		static float decodeTempC(byte msb, byte lsb);
+
 	private:
 		int _address; // Address of Temperature sensor (0x48,0x49,0x4A,0x4B)
+
+		enum ReadState { READ_IDLE, READ_POINTER, READ_DATA };
+		ReadState _readState;
+		unsigned long _readStart;	// millis() the read was started
+		bool _readFailed;
+		float _lastTemp;
+		unsigned long _lastReadTime;
+		bool finishRead(bool failed);
 		void openPointerRegister(byte pointerReg); // Changes the pointer register
 		byte readRegister(bool registerNumber);	// reads 1 byte of from register
 };
@@ -42,6 +42,7 @@
 
 #include <string.h>
 #include "WS2811.h"
+#include "trace.h"
 
 uint16_t OctoWS2811::stripLen;
 void * OctoWS2811::frameBuffer;
@@ -253,6 +254,7 @@ void OctoWS2811::isr(void)
 	//Serial1.print("*");
 	update_completed_at = micros();
 	update_in_progress = 0;
+	traceEvent(TRACE_LED_DMA_DONE, 0, 0);
 	//digitalWriteFast(9, LOW);
 }
 
@@ -20,22 +20,20 @@
 
 #include "calibration.h"
 #include "stormbreaker.h"
+#include "storage.h"
 #include "led.h"
+#include "trace.h"
 
 /* Constants -----------------------------------------------------------*/
 // ODrive Limits
 #define BRAKING_RESISTANCE   2.0f   // ohms
-#define CURRENT_LIM         30.0f  // amps
 #define CALIBRATION_CURRENT 15.0f  //amps
 #define VEL_LIMIT           90112.0f // counts/s
 #define POLE_PAIRS          20   // magnet poles / 2
 #define MOTOR_TYPE          ODriveClass::MOTOR_TYPE_HIGH_CURRENT
-#define CPR                 8192    // counts/revolution
 #define ENCODER_MODE        ODriveClass::ENCODER_MODE_INCREMENTAL
 #define ENCODER_BANDWIDTH   3250.0f // units unsure
 
-#define HOMING_VELOCITY     4096    //counts per second
-
 // ODrive PID Calibration
 #define PID_POS_GAIN_BODY        85.0f       //default 20
 #define PID_VEL_GAIN_BODY        0.0006f     //default 0.0005
@@ -46,7 +44,6 @@
 #define PID_VEL_INT_GAIN_HEAD    0.0007f     //default 0.001
 
 // ODrive startup settings
-#define STARTUP_TIMEOUT                     30000   // 30 seconds in millis
 #define STARTUP_MOTOR_CALIBRATION           false
 #define STARTUP_ENCODER_SEARCH              true
 #define STARTUP_ENCODER_OFFSET_CALIBRATION  false
@@ -64,217 +61,169 @@
 // #define MAGNETIC_ENCODER_HALF   48800
 // #define SYSTEM_CORRELATION      0.35756 // (CPR * TENSION_SCALING_FACTOR / MAGNETIC_ENCODER_TOTAL)
 
+#define CONFIG_TOLERANCE        1e-4f   // relative, the ASCII protocol rounds floats
+
+/* Variables  ----------------------------------------------------------*/
+// Desired ODrive configuration, synced by configuration_sync()
+struct ODriveConfig_t {
+    const char* property;   // relative to axisN, or to the root if global
+    bool global;
+    bool is_float;
+    bool calibration;       // the motor or encoder calibration depends on it
+    float value[2];         // body, head
+};
+
+constexpr ODriveConfig_t odrive_config[] = {
+    {"config.brake_resistance",                     true,  true,  false, {BRAKING_RESISTANCE, BRAKING_RESISTANCE}},
+    {"motor.config.current_lim",                    false, true,  false, {CURRENT_LIM, CURRENT_LIM}},
+    {"motor.config.calibration_current",            false, true,  true,  {CALIBRATION_CURRENT, CALIBRATION_CURRENT}},
+    {"motor.config.pole_pairs",                     false, false, true,  {POLE_PAIRS, POLE_PAIRS}},
+    {"motor.config.motor_type",                     false, false, true,  {MOTOR_TYPE, MOTOR_TYPE}},
+    {"controller.config.vel_limit",                 false, true,  false, {VEL_LIMIT, VEL_LIMIT}},
+    {"encoder.config.cpr",                          false, false, true,  {CPR, CPR}},
+    {"encoder.config.mode",                         false, false, true,  {ENCODER_MODE, ENCODER_MODE}},
+    {"encoder.config.use_index",                    false, false, true,  {ENCODER_USE_INDEX, ENCODER_USE_INDEX}},
+    {"encoder.config.bandwidth",                    false, true,  false, {ENCODER_BANDWIDTH, ENCODER_BANDWIDTH}},
+    {"trap_traj.config.vel_limit",                  false, true,  false, {TRAJ_VEL_LIMIT, TRAJ_VEL_LIMIT}},
+    {"trap_traj.config.accel_limit",                false, true,  false, {TRAJ_ACCEL_LIMIT, TRAJ_ACCEL_LIMIT}},
+    {"trap_traj.config.decel_limit",                false, true,  false, {TRAJ_DECEL_LIMIT, TRAJ_DECEL_LIMIT}},
+    {"controller.config.pos_gain",                  false, true,  false, {PID_POS_GAIN_BODY, PID_POS_GAIN_HEAD}},
+    {"controller.config.vel_gain",                  false, true,  false, {PID_VEL_GAIN_BODY, PID_VEL_GAIN_HEAD}},
+    {"controller.config.vel_integrator_gain",       false, true,  false, {PID_VEL_INT_GAIN_BODY, PID_VEL_INT_GAIN_HEAD}},
+    {"config.startup_motor_calibration",            false, false, false, {STARTUP_MOTOR_CALIBRATION, STARTUP_MOTOR_CALIBRATION}},
+    {"config.startup_encoder_index_search",         false, false, false, {STARTUP_ENCODER_SEARCH, STARTUP_ENCODER_SEARCH}},
+    {"config.startup_encoder_offset_calibration",   false, false, false, {STARTUP_ENCODER_OFFSET_CALIBRATION, STARTUP_ENCODER_OFFSET_CALIBRATION}},
+    {"config.startup_closed_loop_control",          false, false, false, {STARTUP_CLOSED_LOOP, STARTUP_CLOSED_LOOP}},
+    {"config.startup_sensorless_control",           false, false, false, {STARTUP_SENSORLESS, STARTUP_SENSORLESS}}
+};
+
+// Hall sensor edge capture, written by hall_sensor_isr()
+volatile bool hall_edge_captured = false;
+volatile uint32_t hall_edge_time = 0;   // micros() at the rising edge
+
+uint16_t index_fingerprint = 0;         // ODrive fingerprint for the stored index record
+
 /* Functions------------------------------------------------------------*/
 /**
-  * @brief  Startup sequence for the ODrive
+  * @brief  Brings the ODrive configuration in line with odrive_config[],
+  *     only values that differ are written.  Values that could not be read
+  *     are left alone, so a flaky link never forces a save and reboot
   * @param  ODriveClass& odrive - ODriveClass instantiated object
-  * @return void
+  * @param  int axis - axis to be configured
+  * @param  bool calibrated - the axis reached closed loop, its calibration
+  *     dependent values are not touched
+  * @return bool - true if anything was written and needs saving
   */
-void odrive_startup_sequence(ODriveClass& odrive)
+bool configuration_sync(ODriveClass& odrive, int axis, bool calibrated)
 {
-    bool calibration_status[2] = {true, true};
-
-    odrive_startup_check(odrive, calibration_status);
-
-    #if defined BOTH_FOR_TESTING
-        for (int axis = 0; axis < NUM_MOTORS; axis++) {
-    #elif defined BODY
-        for (int axis = AXIS_BODY; axis < (NUM_MOTORS + AXIS_BODY); axis++) {
+    #if defined BODY
+        int column = 0;
     #elif defined HEAD
-        for (int axis = AXIS_HEAD; axis < (NUM_MOTORS + AXIS_HEAD); axis++) {
-    #endif
-
-            if (calibration_status[axis] == false){
-
-                #ifdef TESTING
-                    SerialUSB.print("Configuring axis ");
-                    SerialUSB.println(axis);
-                #endif
-
-                if (odrive.MotorCalibrationStatus(axis)){
-                    if (odrive.EncoderReadyStatus(axis)){
-                        reconfigure_startup(odrive, axis);
-                    } else {
-                        encoder_calibrate(odrive, axis);
-                        reconfigure_startup(odrive, axis);
-                    }
-                } else {
-                    // FULL CALIBRATION SEQUENCE
-                    parameter_configuration(odrive, axis);
-                    motor_calibrate(odrive, axis);
-                    encoder_calibrate(odrive, axis);
-                    reconfigure_startup(odrive, axis);
-                }
-            }
-
-            odrive.SetControlModePos(axis);
-        }
-
-    // save calibration and reboot if either axis needs reconfiguration
-    if (!calibration_status[0] || !calibration_status[1]){
-        #ifdef TESTING
-            SerialUSB.println("Saving calibration and rebooting");
-        #endif
-
-        odrive.SaveConfiguration();
-        #if defined HEAD && defined LED_RING
-            elapsedMillis rainbowTiming = 0;
-            if (rainbowTiming < 2000)
-                rainbow(RAINBOW_DELAY);
-        #else
-            delay(2000);
-        #endif
-
-        odrive.Reboot();
-        #if defined HEAD && defined LED_RING
-            rainbowTiming = 0;
-            if (rainbowTiming < 2000)
-                rainbow(RAINBOW_DELAY);
-        #else
-            delay(2000);
-        #endif
-    }
-
-    return;
-}
-
-/**
-  * @brief  Startup checking for the ODrive
-  * @param  ODriveClass& odrive - ODriveClass instantiated object
-  * @param  bool calibration_check [] to hold the calibration results
-  * @return void
-  */
-void odrive_startup_check(ODriveClass& odrive, bool calibration_status[])
-{
-    #ifdef TESTING
-        SerialUSB.println("Searching for and waiting for ODrive");
+        int column = 1;
+    #else
+        int column = (axis == AXIS_BODY) ? 0 : 1;
     #endif
 
-    int32_t current_state;
-    // search for post-startup ODrive
+    bool changed = false;
 
-    #if defined BOTH_FOR_TESTING
-        for (int axis = 0; axis < NUM_MOTORS; axis++) {
-    #elif defined BODY
-        for (int axis = AXIS_BODY; axis < (NUM_MOTORS + AXIS_BODY); axis++) {
-    #elif defined HEAD
-        for (int axis = AXIS_HEAD; axis < (NUM_MOTORS + AXIS_HEAD); axis++) {
-    #endif
+    for (unsigned int i = 0; i < sizeof(odrive_config) / sizeof(odrive_config[0]); i++){
+        const ODriveConfig_t& entry = odrive_config[i];
+        int target = entry.global ? -1 : axis;
+        float current;
 
-            elapsedMillis timeout;
-            #if defined HEAD && defined LED_RING
-                elapsedMillis rainbowTiming = 0;
+        if (!odrive.ReadProperty(target, entry.property, current)){
+            #ifdef TESTING
+                SerialUSB.print("Axis ");
+                SerialUSB.print(axis);
+                SerialUSB.print(" ");
+                SerialUSB.print(entry.property);
+                SerialUSB.println(": no reply, skipped");
             #endif
+            continue;
+        }
 
-            do {
-                current_state = odrive.readState(axis);
-                #ifdef TESTING
-                    SerialUSB.print("CURRENT STATE: ");
-                    SerialUSB.println(current_state);
-                #endif
-                #if defined HEAD && defined LED_RING
-                    rainbowTiming = 0;
-                    if (rainbowTiming < 100)
-                        rainbow(RAINBOW_DELAY);
-                #else
-                    delay(100);
-                #endif
-            } while (current_state != ODriveClass::AXIS_STATE_CLOSED_LOOP_CONTROL && current_state != ODriveClass::AXIS_STATE_IDLE && timeout <= STARTUP_TIMEOUT);
-
-            current_state = odrive.readState(axis);
+        if (abs(current - entry.value[column]) <= CONFIG_TOLERANCE * (1.0f + abs(entry.value[column])))
+            continue;
 
+        if (calibrated && entry.calibration){
             #ifdef TESTING
-                SerialUSB.print("ODrive ");
+                SerialUSB.print("Axis ");
                 SerialUSB.print(axis);
-                SerialUSB.print(" state : ");;
-                SerialUSB.println(current_state);
-
-                SerialUSB.print("Calibration status: ");
+                SerialUSB.print(" ");
+                SerialUSB.print(entry.property);
+                SerialUSB.println(" differs, left alone on a calibrated axis");
             #endif
+            continue;
+        }
 
-            if (current_state == ODriveClass::AXIS_STATE_CLOSED_LOOP_CONTROL){
-                calibration_status[axis] = true;
+        #ifdef TESTING
+            SerialUSB.print("Axis ");
+            SerialUSB.print(axis);
+            SerialUSB.print(" ");
+            SerialUSB.print(entry.property);
+            SerialUSB.print(": ");
+            SerialUSB.print(current);
+            SerialUSB.print(" -> ");
+            SerialUSB.println(entry.value[column]);
+        #endif
 
-                #ifdef TESTING
-                    SerialUSB.println("calibrated");
-                #endif
-            } else {
-                calibration_status[axis] = false;
+        if (entry.is_float)
+            odrive.WriteProperty(target, entry.property, entry.value[column]);
+        else
+            odrive.WriteProperty(target, entry.property, (int32_t)entry.value[column]);
 
-                #ifdef TESTING
-                    SerialUSB.println("not calibrated");
-                #endif
-            }
-        }
+        changed = true;
+    }
 
-    return;
+    return changed;
 }
 
 /**
-  * @brief  Reconfigure ODrive startup sequence
+  * @brief  Starts the odrive encoder index search, wait for the axis to
+  *     return to idle before calling encoder_offset_calibrate()
   * @param  ODriveClass& odrive - ODriveClass instantiated object
-  * @param  int axis - motor axis to be reconfigured
+  * @param  int axis - encoder axis to be calibrated
   * @return void
   */
-void reconfigure_startup(ODriveClass& odrive, int axis)
+void encoder_calibrate(ODriveClass& odrive, int axis)
 {
     #ifdef TESTING
-        SerialUSB.print("Reconfiguring axis ");
+        SerialUSB.print("Calibrating axis ");
         SerialUSB.print(axis);
-        SerialUSB.println(" startup sequence");
+        SerialUSB.println(" encoder");
     #endif
 
-    odrive.StartupMotorCalibration(axis, STARTUP_MOTOR_CALIBRATION);
-    odrive.StartupEncoderIndexSearch(axis, STARTUP_ENCODER_SEARCH);
-    odrive.StartupEncoderOffsetCalibration(axis, STARTUP_ENCODER_OFFSET_CALIBRATION);
-    odrive.StartupClosedLoop(axis, STARTUP_CLOSED_LOOP);
-    odrive.StartupSensorless(axis, STARTUP_SENSORLESS);
+    odrive.EncoderUseIndex(axis, ENCODER_USE_INDEX);
+    delay(20);
+    odrive.run_state(axis, ODriveClass::AXIS_STATE_ENCODER_INDEX_SEARCH, false);
 }
 
 /**
-  * @brief  Calibrate odrive encoder
+  * @brief  Starts the odrive encoder offset calibration, wait for the axis to
+  *     return to idle before calling encoder_calibrate_finish()
   * @param  ODriveClass& odrive - ODriveClass instantiated object
   * @param  int axis - encoder axis to be calibrated
   * @return void
   */
-void encoder_calibrate(ODriveClass& odrive, int axis)
+void encoder_offset_calibrate(ODriveClass& odrive, int axis)
 {
-    #ifdef TESTING
-        SerialUSB.print("Calibrating axis ");
-        SerialUSB.print(axis);
-        SerialUSB.println(" encoder");
-    #endif
-
-    odrive.EncoderUseIndex(axis, ENCODER_USE_INDEX);
-    delay(20);
-    odrive.run_state(axis, ODriveClass::AXIS_STATE_ENCODER_INDEX_SEARCH, true);
-
-    #if defined HEAD && defined LED_RING
-        elapsedMillis rainbowTiming = 0;
-        if (rainbowTiming < 2000)
-            rainbow(RAINBOW_DELAY);
-    #else
-        delay(2000);
-    #endif
-
-    odrive.run_state(axis, ODriveClass::AXIS_STATE_ENCODER_OFFSET_CALIBRATION, true);
-
-    #if defined HEAD && defined LED_RING
-        rainbowTiming = 0;
-        if (rainbowTiming < 1000)
-            rainbow(RAINBOW_DELAY);
-    #else
-        delay(1000);
-    #endif
+    odrive.run_state(axis, ODriveClass::AXIS_STATE_ENCODER_OFFSET_CALIBRATION, false);
+}
 
+/**
+  * @brief  Stores the odrive encoder calibration
+  * @param  ODriveClass& odrive - ODriveClass instantiated object
+  * @param  int axis - encoder axis that was calibrated
+  * @return void
+  */
+void encoder_calibrate_finish(ODriveClass& odrive, int axis)
+{
     odrive.EncoderPreCalibrated(axis, ENCODER_PRE_CALIBRATED);
-    delay(20);
-    odrive.EncoderBandwidth(axis, ENCODER_BANDWIDTH);
-    delay(50);
 }
 
 /**
-  * @brief  Calibrate odrive motor
+  * @brief  Starts the odrive motor calibration, wait for the axis to
+  *     return to idle before calling motor_calibrate_finish()
   * @param  ODriveClass& odrive - ODriveClass instantiated object
   * @param  int axis - motor axis to be calibrated
   * @return void
@@ -287,148 +236,202 @@ void motor_calibrate(ODriveClass& odrive, int axis)
         SerialUSB.println(" motor");
     #endif
 
-    odrive.run_state(axis, ODriveClass::AXIS_STATE_MOTOR_CALIBRATION, true);
-    odrive.MotorPreCalibrated(axis, MOTOR_PRE_CALIBRATED);
+    odrive.run_state(axis, ODriveClass::AXIS_STATE_MOTOR_CALIBRATION, false);
 }
 
 /**
-  * @brief  Sets ODrive limits
+  * @brief  Stores the odrive motor calibration
   * @param  ODriveClass& odrive - ODriveClass instantiated object
-  * @param  int axis - axis to be configured
+  * @param  int axis - motor axis that was calibrated
   * @return void
   */
-void parameter_configuration(ODriveClass& odrive, int axis)
+void motor_calibrate_finish(ODriveClass& odrive, int axis)
 {
+    odrive.MotorPreCalibrated(axis, MOTOR_PRE_CALIBRATED);
+}
+
+/**
+  * @brief  Loads the stored hall sensor edge if it belongs to this ODrive
+  * @param  ODriveClass& odrive - ODriveClass instantiated object
+  * @param  StormBreaker& thor - StormBreaker instantiated class object
+  * @param  int axis - axis being homed
+  * @return void
+  */
+void load_index(ODriveClass& odrive, StormBreaker& thor, int axis){
+    IndexRecord_t record;
+
+    index_fingerprint = odrive_fingerprint(odrive, axis);
+
+    // positions are only comparable across boots once the encoder index is found
+    thor.SystemIndex.hall_known = loadIndexRecord(record)
+        && record.axis == axis
+        && record.odrive_fingerprint == index_fingerprint
+        && odrive.EncoderIndexFound(axis);
+
+    thor.SystemIndex.fast_attempts = 0;
+    thor.SystemIndex.fast_hits = 0;
+    if (thor.SystemIndex.hall_known){
+        thor.SystemIndex.hall_position = record.hall_position;
+        thor.SystemIndex.fast_attempts = record.fast_attempts;
+        thor.SystemIndex.fast_hits = record.fast_hits;
+    }
+
     #ifdef TESTING
-        SerialUSB.print("Configuring parameters for axis ");
-        SerialUSB.println(axis);
+        SerialUSB.print("Stored index: ");
+        if (thor.SystemIndex.hall_known)
+            SerialUSB.println(thor.SystemIndex.hall_position);
+        else
+            SerialUSB.println("none");
     #endif
+}
 
-    odrive.SetControlModeTraj(axis);
+/**
+  * @brief  Stores the hall sensor edge found by the index search
+  * @param  StormBreaker& thor - StormBreaker instantiated class object
+  * @param  int axis - axis that was homed
+  * @return void
+  */
+void save_index(StormBreaker& thor, int axis){
+    IndexRecord_t record;
 
-    odrive.ConfigureBrakingResistance(BRAKING_RESISTANCE);
-    odrive.ConfigureCurrentLimit(axis, CURRENT_LIM);
-    odrive.ConfigureCalibrationCurrent(axis, CALIBRATION_CURRENT);
-    odrive.ConfigureVelLimit(axis, VEL_LIMIT);
-    odrive.ConfigurePolePairs(axis, POLE_PAIRS);
-    odrive.ConfigureMotorType(axis, MOTOR_TYPE);
-    odrive.ConfigureCPR(axis, CPR);
-    odrive.ConfigureEncoderMode(axis, ENCODER_MODE);
+    record.axis = axis;
+    record.odrive_fingerprint = index_fingerprint;
+    record.hall_position = thor.SystemIndex.hall_position;
+    record.fast_attempts = thor.SystemIndex.fast_attempts;
+    record.fast_hits = thor.SystemIndex.fast_hits;
 
-    odrive.ConfigureTrajVelLimit(axis, TRAJ_VEL_LIMIT);
-    odrive.ConfigureTrajAccelLimit(axis, TRAJ_ACCEL_LIMIT);
-    odrive.ConfigureTrajDecelLimit(axis, TRAJ_DECEL_LIMIT);
+    saveIndexRecord(record);
+}
 
-    #if defined BODY || defined BOTH_FOR_TESTING
-        if(axis == AXIS_BODY){
-            odrive.ConfigurePosGain(axis, PID_POS_GAIN_BODY);
-            odrive.ConfigureVelGain(axis, PID_VEL_GAIN_BODY);
-            odrive.ConfigureVelIntGain(axis, PID_VEL_INT_GAIN_BODY);
-        }
-    #elif defined HEAD || defined BOTH_FOR_TESTING
-        if(axis == AXIS_HEAD){
-            odrive.ConfigurePosGain(axis, PID_POS_GAIN_HEAD);
-            odrive.ConfigureVelGain(axis, PID_VEL_GAIN_HEAD);
-            odrive.ConfigureVelIntGain(axis, PID_VEL_INT_GAIN_HEAD);
-        }
-    #endif
+/**
+  * @brief  Fingerprints the ODrive and the configuration the stored index depends on
+  * @param  ODriveClass& odrive - ODriveClass instantiated object
+  * @param  int axis - axis being homed
+  * @return uint16_t - fingerprint
+  */
+uint16_t odrive_fingerprint(ODriveClass& odrive, int axis){
+    const int32_t config[] = {axis, CPR, POLE_PAIRS, ENCODER_MODE, TENSION_SCALING_FACTOR, HALL_SENSOR_OFFSET};
+    String serial_number = odrive.SerialNumber();
+
+    uint16_t crc = crc16((const uint8_t*)serial_number.c_str(), serial_number.length());
+    return crc16((const uint8_t*)config, sizeof(config), crc);
 }
 
 /**
-  * @brief  LX1 system startup homing sequence
-  * @param  ODriveClass& odrive - ODriveClass instantiated class object
-  * @param  StormBreaker& thor - StormBreaker instantiated class object
+  * @brief  Starts a move towards a target, capturing the first hall sensor
+  *     edge on the way
+  * @param  ODriveClass& odrive - ODriveClass instantiated object
+  * @param  int axis - axis to be moved
+  * @param  float target - end of the search move
+  * @param  float velocity - search velocity in counts/s
   * @return void
   */
-void lx1_startup_sequence(ODriveClass& odrive, StormBreaker& thor){
-    // Homing the odrive system
-    #if defined BODY || defined BOTH_FOR_TESTING
-        int axis = AXIS_BODY;
-    #else
-        int axis = AXIS_HEAD;
-    #endif
+void hall_sensor_arm(ODriveClass& odrive, int axis, float target, float velocity){
+    odrive.ConfigureTrajVelLimit(axis, velocity);
 
-    startup_index_search(odrive, thor, axis);
+    // the edge is timestamped in hall_sensor_isr()
+    hall_edge_captured = false;
+    attachInterrupt(digitalPinToInterrupt(HALL_SENSOR), hall_sensor_isr, RISING);
 
-    #if defined BODY || defined BOTH_FOR_TESTING
-        homing_system(odrive, thor.SystemIndex.pan_index, axis, true);
-    #else
-        homing_system(odrive, thor.SystemIndex.tilt_index, axis, true);
-    #endif
+    odrive.TrapezoidalMove(axis, target);
+}
 
-    #ifdef TESTING
-        #if defined HEAD && defined LED_RING
-            elapsedMillis rainbowTiming = 0;
-            if (rainbowTiming < 100)
-                rainbow(RAINBOW_DELAY);
-        #else
-            delay(100);
-        #endif
+/**
+  * @brief  Stops capturing hall sensor edges
+  * @param  void
+  * @return bool - true if an edge was captured since hall_sensor_arm()
+  */
+bool hall_sensor_disarm(void){
+    detachInterrupt(digitalPinToInterrupt(HALL_SENSOR));
+    return hall_edge_captured;
+}
 
-        odrive.ReadFeedback(axis);
-        SerialUSB.print("ODrive encoder count: ");
-        SerialUSB.println(odrive.Feedback.position);
-        SerialUSB.println();
-    #endif
+/**
+  * @brief  Checks for a hall sensor edge without disarming
+  * @param  void
+  * @return bool - true if an edge was captured since hall_sensor_arm()
+  */
+bool hall_sensor_captured(void){
+    return hall_edge_captured;
 }
 
 /**
-  * @brief  Searches for system index
+  * @brief  Checks whether an axis has settled at a target position
   * @param  ODriveClass& odrive - ODriveClass instantiated object
-  * @param  int axis - axis to be configured
+  * @param  int axis - axis to be monitored
+  * @param  float target - position the axis is moving to
+  * @return bool - true if the axis is at the target and stopped
+  */
+bool move_settled(ODriveClass& odrive, int axis, float target){
+    if (!odrive.ReadFeedback(axis))
+        return false;
+
+    return abs(odrive.Feedback.position - target) <= HOMING_POSITION_TOLERANCE && abs(odrive.Feedback.velocity) < 1;
+}
+
+/**
+  * @brief  Hall sensor rising edge interrupt, latches the edge time
+  * @param  void
   * @return void
   */
- void startup_index_search(ODriveClass& odrive, StormBreaker& thor, int axis){
-    // Set up odrive for homing spin
-    odrive.ConfigureTrajVelLimit(axis, HOMING_VELOCITY);
-    odrive.ReadFeedback(axis);
-    odrive.SetControlModeTraj(axis);
-    #if defined HEAD && defined LED_RING
-        rainbow();
-    #endif
+void hall_sensor_isr(void){
+    traceEvent(TRACE_HALL_EDGE, !hall_edge_captured, 0);
+
+    if (!hall_edge_captured){
+        hall_edge_time = micros();
+        hall_edge_captured = true;
+    }
+}
 
-    // SEARCH FOR MAG PULSE
-    // polling based search:
-    bool index_pulse = false;
-    elapsedMillis timeout = 0;
+/**
+  * @brief  Reconstructs the encoder position at the captured hall sensor edge
+  *     by stepping a timestamped feedback sample back by its velocity
+  * @param  ODriveClass& odrive - ODriveClass instantiated object
+  * @param  int axis - axis that triggered the hall sensor
+  * @return float - encoder position at the hall sensor edge
+  */
+float hall_edge_position(ODriveClass& odrive, int axis){
+    odrive.ReadFeedback(axis);
 
-    odrive.TrapezoidalMove(axis, (odrive.Feedback.position + (CPR * TENSION_SCALING_FACTOR)));
+    // signed so a sample taken before the edge still works out
+    int32_t sample_delay = (int32_t)(odrive.Feedback.timestamp - hall_edge_time);
+    float edge_position = odrive.Feedback.position - odrive.Feedback.velocity * (sample_delay * 1e-6f);
 
-    while (!index_pulse){
-        index_pulse = (digitalRead(HALL_SENSOR)== HIGH);
+    #ifdef TESTING
+        SerialUSB.print("Hall edge ");
+        SerialUSB.print(sample_delay);
+        SerialUSB.print("us before sample, position ");
+        SerialUSB.println(edge_position);
+    #endif
 
-        if (index_pulse || timeout >= STARTUP_TIMEOUT){
-            startup_index(odrive, thor, axis);
-            break;
-        }
-    }
- }
+    return edge_position;
+}
 
 /**
   * @brief  Calculates the system index on startup
   * @param  ODriveClass& odrive - ODriveClass instantiated class object
   * @param  StormBreaker& thor - StormBreaker instantiated class object
+  * @param  float position - encoder position of the hall sensor
   * @param  int axis - axis to be indexed
   * @return void
   */
-void startup_index(ODriveClass& odrive, StormBreaker& thor, int axis){
+void startup_index(ODriveClass& odrive, StormBreaker& thor, float position, int axis){
 
-    odrive.ReadFeedback(axis);
-
-    thor.SystemIndex.start_index = int(odrive.Feedback.position / CPR) + HALL_SENSOR_OFFSET;
+    // floor, not truncate, the coarse search can find the edge below encoder zero
+    thor.SystemIndex.start_index = (int)floorf(position / CPR) + HALL_SENSOR_OFFSET;
 
     #if defined BODY || defined BOTH_FOR_TESTING
         // thor.SystemIndex.pan_index = system_reindex(odrive.Feedback.position, 0, thor.SystemIndex.encoder_direction);
-        thor.SystemIndex.pan_index = thor.SystemIndex.start_index * CPR;
+        thor.SystemIndex.pan_index = (int64_t)thor.SystemIndex.start_index * CPR;
         #ifdef TESTING
             SerialUSB.print("Pan Index: ");
-            SerialUSB.println(thor.SystemIndex.pan_index);
+            SerialUSB.println((double)thor.SystemIndex.pan_index, 0);
         #endif
     #endif
 
     #if defined HEAD
         // thor.SystemIndex.tilt_index = system_reindex(odrive.Feedback.position, 0, thor.SystemIndex.encoder_direction);
-        thor.SystemIndex.tilt_index = thor.SystemIndex.start_index * CPR;
+        thor.SystemIndex.tilt_index = (int64_t)thor.SystemIndex.start_index * CPR;
 
         #ifdef LED_RING
             rainbow();
@@ -436,90 +439,23 @@ void startup_index(ODriveClass& odrive, StormBreaker& thor, int axis){
 
         #ifdef TESTING
             SerialUSB.print("Tilt Index: ");
-            SerialUSB.println(thor.SystemIndex.tilt_index);
+            SerialUSB.println((double)thor.SystemIndex.tilt_index, 0);
         #endif
     #endif
 }
 
 /**
-  * @brief  Recalculates the system index
-  * @param  float odrive_position - position of the odrive encoder
-  * @param  int start_index -
-  * @return float index - new calculated system index
-  */
-float system_reindex(float odrive_position, int start_index){
-
-    float index;
-    int rotations;
-
-    if (odrive_position >= 0)
-        rotations = int(odrive_position / CPR + 0.5);
-    else
-        rotations = int(odrive_position / CPR - 0.5);
-
-    int rotational_offset = (rotations - start_index) % TENSION_SCALING_FACTOR;
-
-    if (abs(rotational_offset) < REINDEX_FACTOR)
-        index = (rotations - rotational_offset) * CPR;
-    else if (rotational_offset >= REINDEX_FACTOR)
-        index = (rotations - rotational_offset + TENSION_SCALING_FACTOR) * CPR;
-    else
-        index = (rotations - rotational_offset - TENSION_SCALING_FACTOR) * CPR;
-
-    #ifdef TESTING
-        SerialUSB.print("New index ");
-        SerialUSB.print(index);
-        SerialUSB.print(" at rotations = ");
-        SerialUSB.println(index/CPR);
-    #endif
-
-    return index;
-}
-
-/**
-  * @brief  Homes one system axis
+  * @brief  Homes one system axis, use move_settled() to wait for the move
   * @param  ODriveClass& odrive - ODriveClass instantiated class object
   * @param  float index - index to home the system to
   * @param  int axis - axis to be configured
-  * @param  bool startup - startup delay status
   * @return void
   */
- void homing_system(ODriveClass& odrive, float index, int axis, bool startup){
+ void homing_system(ODriveClass& odrive, float index, int axis){
 
     odrive.ConfigureTrajAccelLimit(axis, HOMING_VELOCITY);
     odrive.ConfigureTrajDecelLimit(axis, HOMING_VELOCITY);
     odrive.SetControlModeTraj(axis);
 
     odrive.TrapezoidalMove(axis, index);
-
-    if (startup){
-        #if defined HEAD && defined LED_RING
-            elapsedMillis rainbowTiming = 0;
-            if (rainbowTiming < 1000)
-                rainbow(RAINBOW_DELAY);
-        #else
-            delay(1000);
-        #endif
-
-        do {
-            #if defined HEAD && defined LED_RING
-                rainbowTiming = 0;
-                if (rainbowTiming < 500)
-                    rainbow(RAINBOW_DELAY);
-            #else
-                delay(500);
-            #endif
-
-            odrive.ReadFeedback(axis);
-        }
-        while (abs(odrive.Feedback.velocity) >= 1);
-
-        #if defined HEAD && defined LED_RING
-            rainbowTiming = 0;
-            if (rainbowTiming < 250)
-                rainbow(RAINBOW_DELAY);
-        #else
-            delay(250);
-        #endif
-    }
  }
@@ -26,6 +26,8 @@
 #include "options.h"
 
 /* Constants -----------------------------------------------------------*/
+#define CURRENT_LIM         30.0f  // amps, derated by ThermalManager when hot
+
 // ODrive Trajectory Control Limits
 #define TRAJ_VEL_LIMIT      40960.0f //needs to be a factor of 256 to work nicely with pan_tilt_speed calculation
 #define TRAJ_ACCEL_LIMIT    25000.0f
@@ -33,24 +35,48 @@
 
 // ODrive Velocity Control Limits
 #define VEL_VEL_LIMIT       81900.0f //needs to be a factor of 126 to work nicely with velocity calculations
+#define VEL_RAMP_LIMIT      102400.0f //counts/s^2, fastest velocity change without belt slip, needs to be a factor of 256 to work nicely with pan_tilt_speed calculation
+
+// Encoder
+#define CPR                 8192    // counts/revolution
 
 // Homing
 #define HALL_SENSOR 35
 #define HALL_SENSOR_OFFSET 2
 
+#define HOMING_VELOCITY     4096    //counts per second
+
+// Two phase homing: a fast coarse pass finds the hall sensor, then the axis backs
+// off and approaches again at HOMING_VELOCITY, always from the same side
+#define HOMING_SEARCH_VELOCITY      (HOMING_VELOCITY * 4)   // counts per second
+#define HOMING_BACKOFF              (CPR / 2)               // counts, must clear the magnet
+#define HOMING_POSITION_TOLERANCE   64                      // counts
+#define HOMING_VERIFY_TOLERANCE     (CPR / 16)              // counts, stored edge vs found edge
+#define HOMING_VERIFY_BACKOFF       (CPR / 8)               // counts, up to speed before the tolerance
+
+// ODrive startup
+#define STARTUP_TIMEOUT     30000   // 30 seconds in millis
+
 /* Functions------------------------------------------------------------*/
-void odrive_startup_sequence(ODriveClass& );
-void odrive_startup_check(ODriveClass& , bool*);
-void reconfigure_startup(ODriveClass&, int);
+bool configuration_sync(ODriveClass&, int, bool);
 void encoder_calibrate(ODriveClass&, int);
+void encoder_offset_calibrate(ODriveClass&, int);
+void encoder_calibrate_finish(ODriveClass&, int);
 void motor_calibrate(ODriveClass&, int);
-void parameter_configuration(ODriveClass&, int);
+void motor_calibrate_finish(ODriveClass&, int);
+
+void load_index(ODriveClass&, StormBreaker&, int);
+void save_index(StormBreaker&, int);
+uint16_t odrive_fingerprint(ODriveClass&, int);
 
-void lx1_startup_sequence(ODriveClass&, StormBreaker&);
-void startup_index_search(ODriveClass&, StormBreaker&, int);
-void startup_index(ODriveClass&, StormBreaker&, int);
+void hall_sensor_arm(ODriveClass&, int, float, float);
+bool hall_sensor_disarm(void);
+bool hall_sensor_captured(void);
+bool move_settled(ODriveClass&, int, float);
+void hall_sensor_isr(void);
+float hall_edge_position(ODriveClass&, int);
+void startup_index(ODriveClass&, StormBreaker&, float, int);
 
-float system_reindex(float, int);
-void homing_system(ODriveClass&, float, int, bool);
+void homing_system(ODriveClass&, float, int);
 
 #endif //CALIBRATION_H
@@ -0,0 +1,93 @@
+/*
+ * Curves Source
+ *
+ * @file    curves.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   pan_tilt_speed response curves.
+ * Maps the ArtNet pan_tilt_speed channel (0 fastest, 255 slowest) to a
+ * fraction of a trajectory limit through lookup tables built at compile time.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "curves.h"
+
+/* Constants -----------------------------------------------------------*/
+#define SPEED_STEPS     256
+#define MINIMUM_FRACTION (1.0 / SPEED_STEPS)   // slowest speed, matches the original linear mapping
+#define LN_256          5.545177444479562      // exponential curve spans 1 to MINIMUM_FRACTION
+
+/* Functions------------------------------------------------------------*/
+// exp() is not constexpr, halve the argument until the series converges quickly
+static constexpr double const_exp_series(double x, int n, double term, double sum)
+{
+    return n > 16 ? sum : const_exp_series(x, n + 1, term * x / n, sum + term * x / n);
+}
+
+static constexpr double const_exp(double x)
+{
+    return (x < -0.5) ? const_exp(x / 2) * const_exp(x / 2) : const_exp_series(x, 1, 1.0, 1.0);
+}
+
+static constexpr double curve_fraction(ResponseCurve_t curve, int speed)
+{
+    double x = (double)speed / (SPEED_STEPS - 1);
+
+    return (curve == RESPONSE_LINEAR) ? 1.0 - (double)speed / SPEED_STEPS
+        : (curve == RESPONSE_EXPONENTIAL) ? const_exp(-LN_256 * x)
+        : (curve == RESPONSE_S) ? 1.0 - (1.0 - MINIMUM_FRACTION) * x * x * (3.0 - 2.0 * x)
+        : 1.0;
+}
+
+struct ResponseTable_t {
+    float fraction[SPEED_STEPS];
+
+    constexpr ResponseTable_t(ResponseCurve_t curve) : fraction()
+    {
+        for (int speed = 0; speed < SPEED_STEPS; speed++)
+            fraction[speed] = (float)curve_fraction(curve, speed);
+    }
+
+    constexpr bool decreasing() const
+    {
+        for (int speed = 1; speed < SPEED_STEPS; speed++){
+            if (fraction[speed] > fraction[speed - 1])
+                return false;
+        }
+        return true;
+    }
+};
+
+static constexpr ResponseTable_t response_tables[RESPONSE_COUNT] = {
+    ResponseTable_t(RESPONSE_FIXED),
+    ResponseTable_t(RESPONSE_LINEAR),
+    ResponseTable_t(RESPONSE_EXPONENTIAL),
+    ResponseTable_t(RESPONSE_S)
+};
+
+// the tables are checked when they are built
+static_assert(response_tables[RESPONSE_FIXED].fraction[255] == 1.0f, "fixed curve must ignore speed");
+static_assert(response_tables[RESPONSE_LINEAR].fraction[1] == 1.0f - 1.0f / 256, "linear curve must match the original mapping");
+static_assert(response_tables[RESPONSE_LINEAR].fraction[255] == 1.0f / 256, "linear curve must match the original mapping");
+static_assert(response_tables[RESPONSE_EXPONENTIAL].fraction[0] > 0.9999f && response_tables[RESPONSE_EXPONENTIAL].fraction[255] < 1.0001f / 256, "exponential curve must span the full range");
+static_assert(response_tables[RESPONSE_S].fraction[0] == 1.0f && response_tables[RESPONSE_S].fraction[255] == 1.0f / 256, "S curve must span the full range");
+static_assert(response_tables[RESPONSE_LINEAR].decreasing() && response_tables[RESPONSE_EXPONENTIAL].decreasing() && response_tables[RESPONSE_S].decreasing(), "slower speeds must never raise a limit");
+
+/**
+  * @brief  Fraction of a limit to use for a pan_tilt_speed value
+  * @param  uint8_t curve - ResponseCurve_t, unknown curves fall back to linear
+  * @param  uint8_t speed - ArtNet pan_tilt_speed, 0 fastest
+  * @return float - fraction of the limit, 1/256 to 1
+  */
+float responseFraction(uint8_t curve, uint8_t speed)
+{
+    if (curve >= RESPONSE_COUNT)
+        curve = RESPONSE_LINEAR;
+
+    return response_tables[curve].fraction[speed];
+}
@@ -0,0 +1,36 @@
+/*
+ * Curves Header
+ *
+ * @file    curves.h
+ * @author  Carbon Video Systems 2019
+ * @description   pan_tilt_speed response curves.
+ * Maps the ArtNet pan_tilt_speed channel (0 fastest, 255 slowest) to a
+ * fraction of a trajectory limit through lookup tables built at compile time.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef CURVES_H
+#define CURVES_H
+
+/* Includes-------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Constants -----------------------------------------------------------*/
+// sent by the Pi, do not reorder
+enum ResponseCurve_t {
+    RESPONSE_FIXED = 0,         // full limit at every speed
+    RESPONSE_LINEAR = 1,
+    RESPONSE_EXPONENTIAL = 2,   // finer control over the slow end
+    RESPONSE_S = 3,             // finer control at both ends
+    RESPONSE_COUNT
+};
+
+/* Functions------------------------------------------------------------*/
+float responseFraction(uint8_t curve, uint8_t speed);
+
+#endif //CURVES_H
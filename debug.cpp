@@ -15,6 +15,8 @@
 /* Includes-------------------------------------------------------------*/
 #include "calibration.h"
 #include "debug.h"
+#include "profiler.h"
+#include "trace.h"
 
 /* Constants -----------------------------------------------------------*/
 
@@ -39,7 +41,7 @@ void Debug::serviceDebug()
         SerialUSB.println("Rebooting");
         odrive_.Reboot();
         delay(1000);
-        odrive_startup_sequence(odrive_);
+        startup_.begin();
         break;
     // State read Commands
     case 'c':
@@ -82,6 +84,24 @@ void Debug::serviceDebug()
         SerialUSB.println(voltage);
         break;
     }
+    case 'p':
+        bootProfilePrint(SerialUSB);
+        break;
+    case 'h':
+        profilePrint(SerialUSB);
+        profileReset();
+        break;
+    case 'b':
+        // text and binary records share the port, tools/trace_decode splits them by the record CRC
+        tracing_ = !tracing_;
+        SerialUSB.println(tracing_ ? "Binary trace on" : "Binary trace off");
+        if (tracing_)
+            traceReset();
+        break;
+    case 't':
+        scheduler_.printStatistics(SerialUSB);
+        scheduler_.resetStatistics();
+        break;
     case '\n':
         break;
     case '\r':
@@ -17,17 +17,23 @@
 
 /* Includes-------------------------------------------------------------*/
 #include "ODriveLib.h"
+#include "startup.h"
+#include "scheduler.h"
 #include "options.h"
 
 /* Functions------------------------------------------------------------*/
 class Debug {
 public:
-    Debug(ODriveClass& odrive) : odrive_(odrive) {}
+    Debug(ODriveClass& odrive, StartupSequencer& startup, Scheduler& scheduler) : odrive_(odrive), startup_(startup), scheduler_(scheduler), tracing_(false) {}
 
     void serviceDebug();
+    bool tracing() { return tracing_; }
 
 private:
     ODriveClass& odrive_;
+    StartupSequencer& startup_;
+    Scheduler& scheduler_;
+    bool tracing_;          // binary trace records are streamed over USB
 };
 
 #endif //DEBUG_H
@@ -0,0 +1,152 @@
+/*
+ * Effects Source
+ *
+ * @file    effects.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   On-board parametric pan/tilt effects.
+ * Circles, figure-8s, sine sweeps and ballyhoos are evaluated on the
+ * Teensy every control tick and added on top of the ArtNet position
+ * through the motion planner.  Fixtures sharing a time base stay in
+ * phase with each other.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include <math.h>
+
+#include "effects.h"
+
+/* Constants -----------------------------------------------------------*/
+#define MILLIHERTZ_PER_MS   1000000ULL  // mHz * ms in one cycle
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Starts (or retunes) an effect
+  * @param  uint8_t shape - Shape_t, EFFECT_OFF stops the running effect
+  * @param  float size - amplitude in counts
+  * @param  uint16_t rate - cycles per second in mHz
+  * @param  uint16_t phase - phase offset in 1/65536 of a cycle
+  * @param  uint32_t timebase - shared time base in ms at the time of reception
+  * @return void
+  */
+void EffectsEngine::start(uint8_t shape, float size, uint16_t rate, uint16_t phase, uint32_t timebase)
+{
+    timebase_offset_ = (int32_t)(timebase - millis());
+    start(shape, size, rate, phase);
+}
+
+/**
+  * @brief  Starts (or retunes) an effect on the last received time base
+  * @param  uint8_t shape - Shape_t, EFFECT_OFF stops the running effect
+  * @param  float size - amplitude in counts
+  * @param  uint16_t rate - cycles per second in mHz
+  * @param  uint16_t phase - phase offset in 1/65536 of a cycle
+  * @return void
+  */
+void EffectsEngine::start(uint8_t shape, float size, uint16_t rate, uint16_t phase)
+{
+    if (shape == EFFECT_OFF || shape > EFFECT_BALLYHOO){
+        stop();
+        return;
+    }
+
+    shape_ = (Shape_t)shape;
+    size_ = size;
+    rate_ = rate;
+    phase_ = phase;
+
+    #ifdef TESTING
+        SerialUSB.print("Effect ");
+        SerialUSB.print(shape_);
+        SerialUSB.print(" size ");
+        SerialUSB.print(size_);
+        SerialUSB.print(" rate ");
+        SerialUSB.print(rate_);
+        SerialUSB.println("mHz");
+    #endif
+}
+
+/**
+  * @brief  Stops the running effect and returns to the ArtNet position
+  * @param  void
+  * @return void
+  */
+void EffectsEngine::stop()
+{
+    if (shape_ == EFFECT_OFF)
+        return;
+
+    shape_ = EFFECT_OFF;
+
+    #if defined BODY || defined BOTH_FOR_TESTING
+        motion_.setOffset(AXIS_BODY, 0.0f);
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        motion_.setOffset(AXIS_HEAD, 0.0f);
+    #endif
+}
+
+/**
+  * @brief  Evaluates the running effect, called on each control tick before
+  *     MotionPlanner::service() sends the offsets
+  * @param  void
+  * @return void
+  */
+void EffectsEngine::service()
+{
+    if (shape_ == EFFECT_OFF)
+        return;
+
+    float theta = 2.0f * (float)M_PI * cycle();
+    float shape[2] = {0.0f, 0.0f};  // pan, tilt
+
+    switch(shape_){
+    case EFFECT_CIRCLE:
+        shape[0] = sinf(theta);
+        shape[1] = cosf(theta);
+        break;
+    case EFFECT_FIGURE_8:
+        shape[0] = sinf(theta);
+        shape[1] = sinf(2.0f * theta);
+        break;
+    case EFFECT_SINE_PAN:
+        shape[0] = sinf(theta);
+        break;
+    case EFFECT_SINE_TILT:
+        shape[1] = sinf(theta);
+        break;
+    case EFFECT_BALLYHOO: // wide pan sweep with a faster tilt swing
+        shape[0] = sinf(theta);
+        shape[1] = 0.5f * sinf(3.0f * theta);
+        break;
+    default:
+        break;
+    }
+
+    #if defined BODY || defined BOTH_FOR_TESTING
+        motion_.setOffset(AXIS_BODY, shape[0] * size_);
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        motion_.setOffset(AXIS_HEAD, shape[1] * size_);
+    #endif
+}
+
+/**
+  * @brief  Position within the effect cycle on the shared time base
+  * @param  void
+  * @return float - cycle position, 0 to 2
+  */
+float EffectsEngine::cycle()
+{
+    uint32_t now = millis() + timebase_offset_;
+
+    // integer math so every fixture lands on the same point of the cycle
+    uint32_t progress = ((uint64_t)now * rate_) % MILLIHERTZ_PER_MS;
+
+    return (float)progress / MILLIHERTZ_PER_MS + (float)phase_ / 65536.0f;
+}
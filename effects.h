@@ -0,0 +1,62 @@
+/*
+ * Effects Header
+ *
+ * @file    effects.h
+ * @author  Carbon Video Systems 2019
+ * @description   On-board parametric pan/tilt effects.
+ * Circles, figure-8s, sine sweeps and ballyhoos are evaluated on the
+ * Teensy every control tick and added on top of the ArtNet position
+ * through the motion planner.  Fixtures sharing a time base stay in
+ * phase with each other.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+#include "motion.h"
+#include "options.h"
+
+/* Functions------------------------------------------------------------*/
+class EffectsEngine {
+public:
+    EffectsEngine(MotionPlanner& motion) : motion_(motion), shape_(EFFECT_OFF), timebase_offset_(0) {}
+
+    // sent by the Pi, do not reorder
+    enum Shape_t {
+        EFFECT_OFF = 0,
+        EFFECT_CIRCLE = 1,
+        EFFECT_FIGURE_8 = 2,
+        EFFECT_SINE_PAN = 3,
+        EFFECT_SINE_TILT = 4,
+        EFFECT_BALLYHOO = 5
+    };
+
+    void start(uint8_t shape, float size, uint16_t rate, uint16_t phase, uint32_t timebase);
+    void start(uint8_t shape, float size, uint16_t rate, uint16_t phase);
+    void stop();
+    void service();
+
+    bool running() { return shape_ != EFFECT_OFF; }
+
+private:
+    MotionPlanner& motion_;
+
+    Shape_t shape_;
+    float size_;                // amplitude in counts
+    uint16_t rate_;             // mHz
+    uint16_t phase_;            // 1/65536 of a cycle
+    int32_t timebase_offset_;   // shared time base minus millis()
+
+    float cycle();
+};
+
+#endif //EFFECTS_H
@@ -1,10 +1,12 @@
-
 /*
  * Fan Source
  *
  * @file    fan.cpp
  * @author  Carbon Video Systems 2019
  * @description   Cooling Fan Driver.
+ * Each thermal zone has one fan and is cooled by the hottest of the TMP102
+ * sensors mapped to it.  Sensors are discovered on the I2C bus at startup.
+ * With FAN_TACH the fan speeds are measured and stalled fans are restarted.
  *
  * @section LICENSE
  * Redistribution and use in source and binary forms, with or without
@@ -15,31 +17,176 @@
 
 /* Includes-------------------------------------------------------------*/
 #include "fan.h"
+#include "profiler.h"
+#include "trace.h"
 
 /* Constants -----------------------------------------------------------*/
-#define TEMP_SENSOR_1_ADDRESS     0x48
-#define TEMP_SENSOR_2_ADDRESS     0x49
-
+#define TEMP_SENSOR_FIRST_ADDRESS   0x48    // TMP102s answer at 0x48 to 0x4B
 #define FAN1_PIN            3
 #define FAN2_PIN            4
+#define TEMP_ALERT_PIN      5   // all open drain ALERT lines, active low
+#define FAN1_TACH_PIN       6   // open collector tach outputs
+#define FAN2_TACH_PIN       7
 
-#define MIN_PWM_THRESHOLD   14
 #define MAX_PWM_THRESHOLD   1024
 #define PWM_FREQ            29296.875
 #define ANALOG_RESOLUTION   10
 
-#define MIN_FAN_TEMP        25
-#define MAX_FAN_TEMP        40
-#define pwmNum(temperature)  int(map(temperature, MIN_FAN_TEMP, MAX_FAN_TEMP, MIN_PWM_THRESHOLD, MAX_PWM_THRESHOLD))
+// PI controller, duty is a fraction of full speed
+#define FAN_KP              0.08f   // duty per degree C above the setpoint
+#define FAN_KI              0.004f  // duty per degree C second
+#define FAN_FILTER          0.3f    // weight of the newest temperature reading
+#define FAN_MIN_DUTY        0.2f    // slowest speed the fans keep spinning at
+#define FAN_HYSTERESIS      2.0f    // degrees C below the setpoint before a fan stops
+#define FAN_PWM_STEP        8       // smallest PWM change written, keeps sensor noise off the fans
+
+// Tachometer
+#define TACH_PULSES_PER_REV 2
+#define TACH_TIMEOUT        500000  // us without a pulse before a fan counts as stopped
+#define FAN_MAX_RPM         6000    // at full duty, expected speed scales linearly with duty
+#define TACH_MIN_PERIOD     (60000000UL / (FAN_MAX_RPM * TACH_PULSES_PER_REV))  // us, shorter gaps are PWM glitches
+#define FAN_STALL_FRACTION  0.3f    // of the expected speed, below it the fan is stalling
+#define FAN_STALL_PASSES    2       // slow passes in a row before a stall is declared
+
+// TMP102 conversion rates
+#define CONVERSION_RATE_IDLE    0   // 0.25 Hz while the sensors only watch their alert window
+#define CONVERSION_RATE_POLLED  2   // 4 Hz while the fans are being regulated
 
 /* Variables  ----------------------------------------------------------*/
-TMP102 temp_sensor_1(TEMP_SENSOR_1_ADDRESS);
-TMP102 temp_sensor_2(TEMP_SENSOR_2_ADDRESS);
+struct ThermalZone_t {
+    uint8_t pin;            // fan PWM pin
+    uint8_t tach_pin;
+    float setpoint;         // degrees C
+    float temperature;      // filtered reading
+    bool filtered;          // temperature holds a reading
+    float integral;         // duty
+    bool running;
+    int pwm;                // last value written to the pin
+    unsigned long last_update;
+    float reading;          // hottest sensor of the current pass
+    bool reading_known;
+    bool has_sensor;
+    uint16_t rpm;           // measured at the last pass
+    uint8_t slow_passes;
+    bool stalled;
+};
+
+ThermalZone_t thermal_zones[FAN_ZONES] = {
+    {FAN1_PIN, FAN1_TACH_PIN, FAN_DEFAULT_SETPOINT, 0.0f, false, 0.0f, false, 0, 0, 0.0f, false, false, 0, 0, false},
+    {FAN2_PIN, FAN2_TACH_PIN, FAN_DEFAULT_SETPOINT, 0.0f, false, 0.0f, false, 0, 0, 0.0f, false, false, 0, 0, false}
+};
+
+struct TempSensor_t {
+    TMP102 device;
+    uint8_t zone;           // index into thermal_zones
+    bool present;           // answered on the bus at startup
+};
+
+TempSensor_t temp_sensors[TEMP_SENSOR_COUNT] = {
+    {TMP102(TEMP_SENSOR_FIRST_ADDRESS),     0, false},
+    {TMP102(TEMP_SENSOR_FIRST_ADDRESS + 1), 1, false},
+    {TMP102(TEMP_SENSOR_FIRST_ADDRESS + 2), 0, false},
+    {TMP102(TEMP_SENSOR_FIRST_ADDRESS + 3), 1, false}
+};
+
+#ifdef FAN_TACH
+    // written by the tach interrupts
+    volatile uint32_t tach_edge[FAN_ZONES];     // micros() of the last pulse
+    volatile uint32_t tach_period[FAN_ZONES];   // us between the last two pulses
+#endif
+
+#ifdef TEMP_ALERT
+    volatile bool temperature_alert = false;
+    bool temperature_polling = true;    // false while the sensors wait for an ALERT
+#endif
 
 /* Functions------------------------------------------------------------*/
+static void controlFan(ThermalZone_t& zone, float reading);
+static void writeFan(ThermalZone_t& zone, int pwm);
+
+#ifdef FAN_TACH
+/**
+  * @brief  Tach pulse interrupt, one instance per zone
+  * @param  void
+  * @return void
+  */
+template<int zone> static void tachIsr(void)
+{
+    uint32_t now = micros();
+    uint32_t period = now - tach_edge[zone];
+
+    // no fan turns faster than FAN_MAX_RPM, drop the glitch and keep timing from the last real pulse
+    if (period < TACH_MIN_PERIOD)
+        return;
+
+    tach_period[zone] = period;
+    tach_edge[zone] = now;
+}
+
+void (*const tach_isr[FAN_ZONES])(void) = {tachIsr<0>, tachIsr<1>};
+
+/**
+  * @brief  Fan speed from the last tach period
+  * @param  int zone - index into thermal_zones
+  * @return uint16_t - RPM, 0 once the pulses have stopped
+  */
+static uint16_t measureRpm(int zone)
+{
+    noInterrupts();
+    uint32_t edge = tach_edge[zone];
+    uint32_t period = tach_period[zone];
+    interrupts();
+
+    if (period == 0 || micros() - edge > TACH_TIMEOUT)
+        return 0;
+
+    uint32_t rpm = (60000000UL / TACH_PULSES_PER_REV) / period;
+    return min(rpm, (uint32_t)FAN_MAX_RPM);
+}
+
+/**
+  * @brief  Compares the measured speed of a fan with the speed expected for
+  *     its duty and restarts it at full power once it has stalled
+  * @param  int index - index into thermal_zones
+  * @return void
+  */
+static void checkTach(int index)
+{
+    ThermalZone_t& zone = thermal_zones[index];
+    float expected = FAN_MAX_RPM * (float)zone.pwm / MAX_PWM_THRESHOLD;
+
+    zone.rpm = measureRpm(index);
+
+    if (zone.pwm == 0 || zone.rpm >= FAN_STALL_FRACTION * expected){
+        zone.slow_passes = 0;
+        zone.stalled = false;
+        return;
+    }
+
+    if (++zone.slow_passes < FAN_STALL_PASSES)
+        return;
+
+    if (!zone.stalled){
+        #ifdef TESTING
+            SerialUSB.print("Fan ");
+            SerialUSB.print(index + 1);
+            SerialUSB.print(" stalled at ");
+            SerialUSB.print(zone.rpm);
+            SerialUSB.println(" RPM");
+        #endif
+    }
+
+    // the next pass lets the PI loop take it back down
+    zone.stalled = true;
+    zone.slow_passes = 0;
+    writeFan(zone, MAX_PWM_THRESHOLD);
+}
+#endif
+
 /**
-  * @brief  Initializes cooling fan GPIO control and the
-  *     TMP102 temperature sensor.
+  * @brief  Initializes cooling fan GPIO control and discovers the
+  *     TMP102 temperature sensors.  A zone without a sensor runs its fan
+  *     at full speed.
   * @param  void
   * @return void
   */
@@ -49,97 +196,326 @@ void initFans(void)
         SerialUSB.println("Initializing temperature sensors");
     #endif
 
-    temp_sensor_1.begin();
+    temp_sensors[0].device.begin();
 
-    pinMode(FAN1_PIN, OUTPUT);
-    pinMode(FAN2_PIN, OUTPUT);
     analogWriteResolution(ANALOG_RESOLUTION);
-    analogWriteFrequency(FAN1_PIN, PWM_FREQ);
-    analogWriteFrequency(FAN2_PIN, PWM_FREQ);
 
-    analogWrite(FAN1_PIN, 0);
-    analogWrite(FAN2_PIN, 0);
+    for (int i = 0; i < TEMP_SENSOR_COUNT; i++){
+        Wire.beginTransmission(TEMP_SENSOR_FIRST_ADDRESS + i);
+        temp_sensors[i].present = (Wire.endTransmission() == 0);
+
+        if (temp_sensors[i].present)
+            thermal_zones[temp_sensors[i].zone].has_sensor = true;
+
+        #ifdef TESTING
+            SerialUSB.print("Temperature sensor 0x");
+            SerialUSB.print(TEMP_SENSOR_FIRST_ADDRESS + i, HEX);
+            SerialUSB.println(temp_sensors[i].present ? " found" : " missing");
+        #endif
+    }
+
+    for (int i = 0; i < FAN_ZONES; i++){
+        pinMode(thermal_zones[i].pin, OUTPUT);
+        analogWriteFrequency(thermal_zones[i].pin, PWM_FREQ);
+        analogWrite(thermal_zones[i].pin, 0);
+        writeFan(thermal_zones[i], thermal_zones[i].has_sensor ? 0 : MAX_PWM_THRESHOLD);
+    }
+
+    #ifdef FAN_TACH
+        for (int i = 0; i < FAN_ZONES; i++){
+            pinMode(thermal_zones[i].tach_pin, INPUT_PULLUP);
+            attachInterrupt(digitalPinToInterrupt(thermal_zones[i].tach_pin), tach_isr[i], FALLING);
+        }
+    #endif
+
+    #ifdef TEMP_ALERT
+        pinMode(TEMP_ALERT_PIN, INPUT_PULLUP);
+        attachInterrupt(digitalPinToInterrupt(TEMP_ALERT_PIN), temperatureAlertIsr, FALLING);
+    #endif
 }
 
+#ifdef TEMP_ALERT
 /**
-  * @brief  Chooses which fan to update.
+  * @brief  ALERT line interrupt, a sensor has reached its fan setpoint
   * @param  void
   * @return void
   */
-void runFans(void)
+void temperatureAlertIsr(void)
 {
-    static bool fan_select = true;
+    temperature_alert = true;
+    traceEvent(TRACE_TEMP_ALERT, 0, 0);
+}
 
-    if (fan_select)
-        runFan1();
-    else
-        runFan2();
+/**
+  * @brief  Hands temperature monitoring to the sensors or takes it back.
+  *     Watching programs each sensor's T_HIGH to its zone setpoint and T_LOW
+  *     to the stop point in comparator mode at the idle conversion rate.
+  *     These are blocking I2C writes, done only when the mode changes.
+  * @param  bool watch - true to stop polling and wait for an ALERT
+  * @return void
+  */
+static void watchTemperatures(bool watch)
+{
+    for (int i = 0; i < TEMP_SENSOR_COUNT; i++){
+        TempSensor_t& sensor = temp_sensors[i];
 
-    fan_select = (!fan_select);
+        if (!sensor.present)
+            continue;
+
+        if (watch){
+            sensor.device.setAlertMode(0);
+            sensor.device.setAlertPolarity(0);
+            sensor.device.setLowTempC(thermal_zones[sensor.zone].setpoint - FAN_HYSTERESIS);
+            sensor.device.setHighTempC(thermal_zones[sensor.zone].setpoint);
+        }
+        sensor.device.setConversionRate(watch ? CONVERSION_RATE_IDLE : CONVERSION_RATE_POLLED);
+    }
+
+    temperature_alert = false;
+    temperature_polling = !watch;
+
+    #ifdef TESTING
+        SerialUSB.println(watch ? "Temperature sensors watching for ALERT" : "Temperature sensors polled");
+    #endif
 }
+#endif
 
 /**
-  * @brief  Reads temperature sensor #1 and runs fan #1 accordingly.
+  * @brief  Updates every zone from the readings of one pass over the sensors
   * @param  void
   * @return void
   */
-void runFan1(void)
+static void updateZones(void)
 {
-    static bool fanStartup1 = true;
-    float temp_sensor_data_1 = constrain(temp_sensor_1.readTempC(), MIN_FAN_TEMP, MAX_FAN_TEMP);
+    bool running = false;
 
-    if (temp_sensor_data_1 <= MIN_FAN_TEMP){
-        analogWrite(FAN1_PIN, 0);
-        fanStartup1 = true;
+    for (int i = 0; i < FAN_ZONES; i++){
+        ThermalZone_t& zone = thermal_zones[i];
 
-        #ifdef TESTING
-            SerialUSB.println("Fan 1 off");
-        #endif
-    }
-    else{
-        if (fanStartup1)
-            analogWrite(FAN1_PIN, MAX_PWM_THRESHOLD);
-        else
-            analogWrite(FAN1_PIN, pwmNum(temp_sensor_data_1));
+        // a zone whose sensors all failed keeps its fan as it was
+        if (zone.reading_known){
+            controlFan(zone, zone.reading);
 
-        #ifdef TESTING
-            SerialUSB.print("FAN 1 ON - constrained temperature 1:  ");
-            SerialUSB.println(temp_sensor_data_1);
+            #ifdef TESTING
+                SerialUSB.print("Fan ");
+                SerialUSB.print(i + 1);
+                SerialUSB.print(" temperature: ");
+                SerialUSB.print(zone.temperature);
+                SerialUSB.print("  PWM: ");
+                SerialUSB.print(zone.pwm);
+                SerialUSB.print("  RPM: ");
+                SerialUSB.println(zone.rpm);
+            #endif
+        }
+
+        #ifdef FAN_TACH
+            checkTach(i);
         #endif
 
-        fanStartup1 = false;
+        running = running || zone.running || !zone.has_sensor;
     }
+
+    #ifdef TEMP_ALERT
+        // once every fan has stopped the sensors can watch for the setpoints themselves
+        if (!running)
+            watchTemperatures(true);
+    #endif
 }
 
 /**
-  * @brief  Reads temperature sensor #2 and runs fan #2 accordingly.
+  * @brief  Reads every sensor without blocking, one transfer at a time, and
+  *     updates all zones once the pass is complete.  Call every FAN_SERVICE_INTERVAL.
   * @param  void
   * @return void
   */
-void runFan2(void)
+void runFans(void)
 {
-    static bool fanStartup2 = true;
-    float temp_sensor_data_2 = constrain(temp_sensor_2.readTempC(), MIN_FAN_TEMP, MAX_FAN_TEMP);
+    static uint8_t sensor_index = TEMP_SENSOR_COUNT;    // no pass in progress
+    static elapsedMillis pass_timer;
+    PROFILE_SECTION(PROFILE_FAN_UPDATE);
 
-    if (temp_sensor_data_2 <= MIN_FAN_TEMP){
-        analogWrite(FAN2_PIN, 0);
-        fanStartup2 = true;
+    #ifdef TEMP_ALERT
+        // no I2C traffic at all until a sensor leaves its window
+        if (!temperature_polling){
+            if (!temperature_alert && digitalRead(TEMP_ALERT_PIN) == HIGH)
+                return;
+            temperature_alert = false;
+            watchTemperatures(false);
+            pass_timer = temperatureTimingThreshold;
+        }
+    #endif
 
-        #ifdef TESTING
-            SerialUSB.println("Fan 2 off");
-        #endif
+    if (sensor_index >= TEMP_SENSOR_COUNT){
+        if (pass_timer < temperatureTimingThreshold)
+            return;
+
+        pass_timer = 0;
+        sensor_index = 0;
+        for (int i = 0; i < FAN_ZONES; i++)
+            thermal_zones[i].reading_known = false;
     }
-    else{
-        if(fanStartup2)
-            analogWrite(FAN2_PIN, MAX_PWM_THRESHOLD);
-        else
-            analogWrite(FAN2_PIN, pwmNum(temp_sensor_data_2));
 
-        #ifdef TESTING
-            SerialUSB.print("FAN 2 ON - constrained temperature 2: ");
-            SerialUSB.println(temp_sensor_data_2);
-        #endif
+    for (; sensor_index < TEMP_SENSOR_COUNT; sensor_index++){
+        TempSensor_t& sensor = temp_sensors[sensor_index];
+
+        if (!sensor.present)
+            continue;
+
+        if (!sensor.device.readPending()){
+            // retried on the next call if the bus is busy
+            sensor.device.startReadTempC();
+            return;
+        }
+
+        if (!sensor.device.serviceRead())
+            return;
+
+        if (sensor.device.readFailed()){
+            #ifdef TESTING
+                SerialUSB.print("Temperature sensor 0x");
+                SerialUSB.print(TEMP_SENSOR_FIRST_ADDRESS + sensor_index, HEX);
+                SerialUSB.println(" read failed");
+            #endif
+            continue;
+        }
+
+        ThermalZone_t& zone = thermal_zones[sensor.zone];
+        float reading = sensor.device.lastTempC();
 
-        fanStartup2 = false;
+        if (!zone.reading_known || reading > zone.reading)
+            zone.reading = reading;
+        zone.reading_known = true;
     }
+
+    updateZones();
+}
+
+/**
+  * @brief  Sets the temperature a zone regulates to
+  * @param  uint8_t fan - zone number, starting at 1
+  * @param  float temperature - setpoint in degrees C
+  * @return bool - false if the zone or setpoint is out of range
+  */
+bool setFanSetpoint(uint8_t fan, float temperature)
+{
+    if (fan < 1 || fan > FAN_ZONES || !(temperature >= FAN_MIN_SETPOINT && temperature <= FAN_MAX_SETPOINT))
+        return false;
+
+    thermal_zones[fan - 1].setpoint = temperature;
+
+    #ifdef TEMP_ALERT
+        // the alert windows follow the setpoints, reprogram them on the next pass
+        temperature_alert = true;
+    #endif
+
+    return true;
+}
+
+/**
+  * @brief  Writes a fan PWM value, skipping changes smaller than FAN_PWM_STEP
+  * @param  ThermalZone_t& zone - zone of the fan
+  * @param  int pwm - PWM value
+  * @return void
+  */
+static void writeFan(ThermalZone_t& zone, int pwm)
+{
+    if (pwm == zone.pwm || (abs(pwm - zone.pwm) < FAN_PWM_STEP && pwm != 0 && pwm != MAX_PWM_THRESHOLD))
+        return;
+
+    analogWrite(zone.pin, pwm);
+    zone.pwm = pwm;
+}
+
+/**
+  * @brief  Runs one PI step of a zone from a new temperature reading.  Fans
+  *     start at full speed when the setpoint is reached, then hold at least
+  *     FAN_MIN_DUTY until FAN_HYSTERESIS below it.
+  * @param  ThermalZone_t& zone - zone to be regulated
+  * @param  float reading - temperature in degrees C
+  * @return void
+  */
+static void controlFan(ThermalZone_t& zone, float reading)
+{
+    unsigned long now = millis();
+    float interval = zone.filtered ? (now - zone.last_update) / 1000.0f : 0.0f;
+
+    if (zone.filtered)
+        zone.temperature += FAN_FILTER * (reading - zone.temperature);
+    else
+        zone.temperature = reading;
+    zone.filtered = true;
+    zone.last_update = now;
+
+    float error = zone.temperature - zone.setpoint;
+
+    if (!zone.running){
+        if (error < 0.0f)
+            return;
+
+        // full power kick so the fan reliably starts
+        zone.running = true;
+        zone.integral = FAN_MIN_DUTY;
+        writeFan(zone, MAX_PWM_THRESHOLD);
+        return;
+    }
+
+    if (error < -FAN_HYSTERESIS){
+        zone.running = false;
+        zone.integral = 0.0f;
+        writeFan(zone, 0);
+        return;
+    }
+
+    float proportional = FAN_KP * error;
+    float integral = zone.integral + FAN_KI * error * interval;
+    float output = proportional + integral;
+
+    // anti-windup, the integral only grows while the output is not saturated
+    if (!(output > 1.0f && error > 0.0f) && !(output < FAN_MIN_DUTY && error < 0.0f))
+        zone.integral = constrain(integral, 0.0f, 1.0f);
+
+    float duty = constrain(proportional + zone.integral, FAN_MIN_DUTY, 1.0f);
+    writeFan(zone, int(duty * MAX_PWM_THRESHOLD));
+}
+
+/**
+  * @brief  Filtered temperature of the hottest zone
+  * @param  float& temperature - degrees C
+  * @return bool - false until a sensor has been read
+  */
+bool hottestTemperature(float& temperature)
+{
+    bool known = false;
+
+    for (int i = 0; i < FAN_ZONES; i++){
+        if (thermal_zones[i].filtered && (!known || thermal_zones[i].temperature > temperature)){
+            temperature = thermal_zones[i].temperature;
+            known = true;
+        }
+    }
+
+    return known;
+}
+
+/**
+  * @brief  Packs the state of every zone for a telemetry frame
+  *     [zone][PWM, 16 bit big endian][RPM, 16 bit big endian][stalled]
+  * @param  uint8_t* buffer - destination buffer
+  * @param  uint8_t size - size of buffer in bytes
+  * @return uint8_t - number of bytes packed
+  */
+uint8_t fanPack(uint8_t* buffer, uint8_t size)
+{
+    uint8_t length = 0;
+
+    for (uint8_t i = 0; i < FAN_ZONES && length + FAN_PACKED_SIZE <= size; i++){
+        buffer[length++] = i;
+        buffer[length++] = thermal_zones[i].pwm >> 8;
+        buffer[length++] = thermal_zones[i].pwm;
+        buffer[length++] = thermal_zones[i].rpm >> 8;
+        buffer[length++] = thermal_zones[i].rpm;
+        buffer[length++] = thermal_zones[i].stalled;
+    }
+
+    return length;
 }
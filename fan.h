@@ -20,10 +20,24 @@
 #include "TMP102.h"
 #include "options.h"
 
+/* Constants -----------------------------------------------------------*/
+#define FAN_SERVICE_INTERVAL    5       // ms between polls of a temperature read in progress
+#define FAN_DEFAULT_SETPOINT    32.0f   // degrees C the fans regulate to
+#define FAN_MIN_SETPOINT        20.0f   // degrees C, lower would run the fans flat out at room temperature
+#define FAN_MAX_SETPOINT        60.0f
+#define FAN_ZONES               2       // one fan per zone
+#define TEMP_SENSOR_COUNT       4       // TMP102 addresses probed at startup
+#define FAN_PACKED_SIZE         6       // telemetry bytes per zone
+#define FAN_REPORT_INTERVAL     5000    // ms between fan telemetry frames
+
 /* Functions------------------------------------------------------------*/
 void initFans(void);
 void runFans(void);
-void runFan1(void);
-void runFan2(void);
+bool setFanSetpoint(uint8_t fan, float temperature);
+bool hottestTemperature(float& temperature);
+uint8_t fanPack(uint8_t* buffer, uint8_t size);
+#ifdef TEMP_ALERT
+    void temperatureAlertIsr(void);
+#endif
 
 #endif //FAN_H
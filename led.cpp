@@ -15,6 +15,7 @@
 /* Includes-------------------------------------------------------------*/
 #include "led.h"
 #include "WS2811.h"
+#include "profiler.h"
 
 /* Constants -----------------------------------------------------------*/
 #define RAINBOW_RESOLUTION  6
@@ -35,6 +36,17 @@ OctoWS2811 leds(ledsStrip, displayMemory, drawingMemory, config);
 int rainbowColors[rainbow_bound];
 
 /* Functions------------------------------------------------------------*/
+/**
+  * @brief  Starts the DMA refresh of the ring, timed by the profiler
+  * @param  void
+  * @return void
+  */
+static void showLeds(void)
+{
+  PROFILE_SECTION(PROFILE_LED_SHOW);
+  leds.show();
+}
+
 /**
   * @brief  Initializes the led ring without turning on the LEDS
   * @param  void
@@ -55,7 +67,7 @@ void led_begin(bool startup)
     leds.begin();
 
     if(startup)
-        leds.show();
+        showLeds();
 }
 
 /**
@@ -68,7 +80,7 @@ void colorWipe(int color)
   for (int i=0; i < leds.numPixels(); i++) {
     leds.setPixel(i, color);
   }
-  leds.show();
+  showLeds();
 }
 
 /**
@@ -81,7 +93,7 @@ void setAllColour(int colour){
     for (int i= 0; i < ledsStrip; i++){
         leds.setPixel(i, colour);
     }
-    leds.show();
+    showLeds();
 }
 
 /**
@@ -96,7 +108,7 @@ void setAllColour(int colour, int delay_millis)
     for (int i= 0; i < ledsStrip; i++){
     leds.setPixel(i, colour);
   }
-  leds.show();
+  showLeds();
   delay(delay_millis);
 }
 
@@ -112,7 +124,7 @@ void ArtNetLEDUpdate(uint8_t red, uint8_t green, uint8_t blue){
     for (int i = 0; i < ledsStrip; i++){
         leds.setPixel(i, red, green, blue);
     }
-    leds.show();
+    showLeds();
 }
 
 /**
@@ -156,7 +168,7 @@ void rainbow(int delay_ms)
         // leds.setPixel(4 * ledsStrip + i, rainbowColors[(RAINBOW_RESOLUTION * i + shift) % rainbow_bound]);
         leds.setPixel(i, rainbowColors[(RAINBOW_RESOLUTION * i + shift) % rainbow_bound]);
     }
-    leds.show();
+    showLeds();
 
     if (shift >= rainbow_bound - 1)
         shift = 0;
@@ -0,0 +1,128 @@
+/*
+ * Monitor Source
+ *
+ * @file    monitor.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Following error monitor.
+ * Compares background ODrive feedback with the trajectory the motion
+ * planner expects and reports stalls, following errors and moves that
+ * never arrive over telemetry.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "monitor.h"
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Collects background feedback, checks it and requests the next sample,
+  *     never waits on the ODrive
+  * @param  void
+  * @return void
+  */
+void FollowingMonitor::service()
+{
+    odrive_.ServiceFeedback();
+
+    for (int axis = 0; axis < NUM_MOTORS; axis++){
+        if (odrive_.AsyncFeedback[axis].fresh){
+            odrive_.AsyncFeedback[axis].fresh = false;
+            check(axis);
+        }
+    }
+
+    if (request_timer_ >= MONITOR_INTERVAL){
+        // alternate between the axes under trajectory control
+        for (int i = 0; i < NUM_MOTORS; i++){
+            axis_ = (axis_ + 1) % NUM_MOTORS;
+            if (motion_.tracking(axis_)){
+                if (odrive_.RequestFeedback(axis_))
+                    request_timer_ = 0;
+                break;
+            }
+        }
+    }
+}
+
+/**
+  * @brief  Compares one feedback sample with the planned trajectory
+  * @param  int axis - axis the sample belongs to
+  * @return void
+  */
+void FollowingMonitor::check(int axis)
+{
+    ODriveClass::AsyncFeedback_t& feedback = odrive_.AsyncFeedback[axis];
+    State_t& state = state_[axis];
+    float planned_position;
+    float planned_velocity;
+    bool complete;
+
+    if (!motion_.plannedState(axis, feedback.timestamp, planned_position, planned_velocity, complete)){
+        state.error = 0.0f;
+        state.fault = FAULT_NONE;
+        state.complete = false;
+        return;
+    }
+
+    state.error = feedback.position - planned_position;
+
+    Fault_t fault = FAULT_NONE;
+
+    if (abs(state.error) > FOLLOWING_ERROR_LIMIT){
+        if (abs(feedback.velocity) < STALL_VELOCITY && abs(planned_velocity) >= STALL_VELOCITY)
+            fault = FAULT_STALL;
+        else
+            fault = FAULT_FOLLOWING_ERROR;
+    }
+
+    if (complete){
+        if (!state.complete){
+            state.complete = true;
+            state.complete_time = feedback.timestamp;
+        }
+        if (fault == FAULT_NONE && abs(state.error) > ARRIVAL_TOLERANCE && feedback.timestamp - state.complete_time > ARRIVAL_TIME)
+            fault = FAULT_NOT_ARRIVED;
+    }
+    else{
+        state.complete = false;
+    }
+
+    // report each fault once, following errors clear with some hysteresis
+    if (fault != FAULT_NONE){
+        if (fault != state.fault)
+            report(axis, fault);
+        state.fault = fault;
+    }
+    else if (state.fault == FAULT_NOT_ARRIVED || abs(state.error) < FOLLOWING_ERROR_LIMIT / 2){
+        state.fault = FAULT_NONE;
+    }
+}
+
+/**
+  * @brief  Sends a following error telemetry frame
+  *     [axis][fault][following error in counts, 32 bit big endian]
+  * @param  int axis - faulted axis
+  * @param  Fault_t fault - detected fault
+  * @return void
+  */
+void FollowingMonitor::report(int axis, Fault_t fault)
+{
+    int32_t error = (int32_t)state_[axis].error;
+    uint8_t data[6] = {(uint8_t)axis, (uint8_t)fault, (uint8_t)(error >> 24), (uint8_t)(error >> 16), (uint8_t)(error >> 8), (uint8_t)error};
+
+    thor_.sendTelemetry(StormBreaker::TELEMETRY_FOLLOWING_ERROR, data, sizeof(data));
+
+    #ifdef TESTING
+        SerialUSB.print("Axis ");
+        SerialUSB.print(axis);
+        SerialUSB.print(" fault ");
+        SerialUSB.print(fault);
+        SerialUSB.print(", following error ");
+        SerialUSB.println(state_[axis].error);
+    #endif
+}
@@ -0,0 +1,72 @@
+/*
+ * Monitor Header
+ *
+ * @file    monitor.h
+ * @author  Carbon Video Systems 2019
+ * @description   Following error monitor.
+ * Compares background ODrive feedback with the trajectory the motion
+ * planner expects and reports stalls, following errors and moves that
+ * never arrive over telemetry.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+#include "ODriveLib.h"
+#include "motion.h"
+#include "stormbreaker.h"
+#include "options.h"
+
+/* Constants -----------------------------------------------------------*/
+#define MONITOR_INTERVAL            20      // ms between feedback requests
+#define FOLLOWING_ERROR_LIMIT       2048.0f // counts, a quarter motor turn
+#define ARRIVAL_TOLERANCE           64.0f   // counts from the target once the move is over
+#define ARRIVAL_TIME                250000  // us allowed to settle after the planned end of a move
+#define STALL_VELOCITY              256.0f  // counts/s, slower than this counts as stopped
+
+/* Functions------------------------------------------------------------*/
+class FollowingMonitor {
+public:
+    FollowingMonitor(ODriveClass& odrive, MotionPlanner& motion, StormBreaker& thor) : odrive_(odrive), motion_(motion), thor_(thor), axis_(0) {}
+
+    // reported over telemetry, do not reorder
+    enum Fault_t {
+        FAULT_NONE = 0,
+        FAULT_FOLLOWING_ERROR = 1,  // behind or ahead of the trajectory, belt slip
+        FAULT_STALL = 2,            // stopped while the trajectory is moving
+        FAULT_NOT_ARRIVED = 3       // move finished but the axis is not on target
+    };
+
+    void service();
+
+    float followingError(int axis) { return state_[axis].error; }
+
+private:
+    ODriveClass& odrive_;
+    MotionPlanner& motion_;
+    StormBreaker& thor_;
+
+    struct State_t {
+        float error;                // last following error in counts
+        Fault_t fault;              // latched until the error recovers
+        uint32_t complete_time;     // micros() when the planned move first read as complete
+        bool complete;
+    } state_[2];
+
+    int axis_;                      // axis of the next feedback request
+    elapsedMillis request_timer_;
+
+    void check(int axis);
+    void report(int axis, Fault_t fault);
+};
+
+#endif //MONITOR_H
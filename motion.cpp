@@ -0,0 +1,528 @@
+/*
+ * Motion Source
+ *
+ * @file    motion.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Pan/tilt motion planner.
+ * All trajectory moves and trajectory limits go through this class so
+ * limit writes are deduplicated and, with both axes on one ODrive, pan
+ * and tilt moves are coordinated to arrive together.  Velocity changes in the
+ * continuous modes are ramped so reversals do not slam the belts.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include <math.h>
+
+#include "motion.h"
+#include "profiler.h"
+
+/* Constants -----------------------------------------------------------*/
+#define MINIMUM_DISTANCE    1.0f    // counts, smaller moves are not coordinated
+#define FEEDBACK_AGE        100000  // us, background feedback this old can seed a trajectory
+
+/* Variables  ----------------------------------------------------------*/
+volatile uint32_t MotionPlanner::ticks_ = 0;
+volatile uint32_t MotionPlanner::tick_time_ = 0;
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Starts the control tick
+  * @param  uint16_t rate - ticks per second
+  * @return void
+  */
+void MotionPlanner::begin(uint16_t rate)
+{
+    tick_period_ = 1000000 / rate;
+    tick_count_ = ticks_;
+    tick_timer_.begin(tick, tick_period_);
+}
+
+/**
+  * @brief  Control tick interrupt, only counts and timestamps the tick
+  * @param  void
+  * @return void
+  */
+void MotionPlanner::tick()
+{
+    tick_time_ = profileTicks();
+    ticks_ = ticks_ + 1;
+}
+
+/**
+  * @brief  Whether a control tick is waiting to be serviced
+  * @param  void
+  * @return bool - true when service() has setpoints to send
+  */
+bool MotionPlanner::tickPending()
+{
+    return ticks_ != tick_count_;
+}
+
+/**
+  * @brief  Sets the trajectory limits for an axis
+  * @param  int axis - axis to be configured
+  * @param  float velocity - velocity limit in counts/s
+  * @param  float acceleration - acceleration limit in counts/s^2
+  * @param  float deceleration - deceleration limit in counts/s^2
+  * @return void
+  */
+void MotionPlanner::setLimits(int axis, float velocity, float acceleration, float deceleration)
+{
+    axis_[axis].velocity = velocity;
+    axis_[axis].acceleration = acceleration;
+    axis_[axis].deceleration = deceleration;
+
+    applyLimits(axis, velocity, acceleration, deceleration);
+}
+
+/**
+  * @brief  Starts a trajectory move, coordinated with the other axis when both
+  *     are driven by this ODrive
+  * @param  int axis - axis to be moved
+  * @param  float position - target position in counts, before the offset
+  * @return void
+  */
+void MotionPlanner::moveTo(int axis, float position)
+{
+    axis_[axis].base = position;
+    axis_[axis].base_known = true;
+    axis_[axis].velocity_active = false;
+    position += axis_[axis].offset;
+
+    #if defined BOTH_FOR_TESTING
+        if (!axis_[axis].move_pending && !axis_[AXIS_BODY + AXIS_HEAD - axis].move_pending)
+            pending_timer_ = 0;
+    #endif
+
+    // sent on the next control tick
+    axis_[axis].pending = position;
+    axis_[axis].move_pending = true;
+}
+
+/**
+  * @brief  Sets how fast the velocity of an axis may change
+  * @param  int axis - axis to be configured
+  * @param  float rate - ramp rate in counts/s^2, 0 disables ramping
+  * @return void
+  */
+void MotionPlanner::setRampRate(int axis, float rate)
+{
+    axis_[axis].ramp_rate = rate;
+}
+
+/**
+  * @brief  Scales the acceleration limits and velocity ramps of every axis,
+  *     rewriting the limits of axes that have them applied
+  * @param  float scale - fraction of the requested acceleration, 1 for full
+  * @return void
+  */
+void MotionPlanner::setAccelerationScale(float scale)
+{
+    if (scale == acceleration_scale_)
+        return;
+
+    acceleration_scale_ = scale;
+
+    for (int axis = 0; axis < NUM_MOTORS; axis++){
+        if (axis_[axis].applied_known)
+            applyLimits(axis, axis_[axis].applied_velocity, axis_[axis].acceleration, axis_[axis].deceleration);
+    }
+}
+
+/**
+  * @brief  Ramps an axis to a new velocity, the first step is sent on the next control tick
+  * @param  int axis - axis to be driven
+  * @param  float velocity - target velocity in counts/s
+  * @return void
+  */
+void MotionPlanner::setVelocity(int axis, float velocity)
+{
+    Axis_t& a = axis_[axis];
+
+    // coming out of trajectory control the axis is at rest
+    if (!a.velocity_active){
+        a.velocity_command = 0.0f;
+        a.velocity_active = true;
+    }
+
+    a.velocity_target = velocity;
+    a.move_pending = false;
+}
+
+/**
+  * @brief  Ends velocity control of an axis, use once it has ramped to rest or was stopped directly
+  * @param  int axis - axis to be stopped
+  * @return void
+  */
+void MotionPlanner::stopVelocity(int axis)
+{
+    axis_[axis].velocity_active = false;
+    axis_[axis].velocity_command = 0.0f;
+}
+
+/**
+  * @brief  Whether an axis has ramped to rest, or is not under velocity control
+  * @param  int axis - axis to be checked
+  * @return bool - true once a zero velocity has been sent
+  */
+bool MotionPlanner::stopped(int axis)
+{
+    return !axis_[axis].velocity_active || (axis_[axis].velocity_target == 0.0f && axis_[axis].velocity_command == 0.0f);
+}
+
+/**
+  * @brief  Sets the offset added to every move of an axis and moves to it
+  * @param  int axis - axis to be offset
+  * @param  float offset - offset in counts
+  * @return void
+  */
+void MotionPlanner::setOffset(int axis, float offset)
+{
+    axis_[axis].offset = offset;
+
+    // only moves axes that are under trajectory control
+    if (axis_[axis].base_known)
+        moveTo(axis, axis_[axis].base);
+}
+
+/**
+  * @brief  Stops applying offsets to an axis, use when it leaves trajectory control
+  * @param  int axis - axis to be released
+  * @return void
+  */
+void MotionPlanner::release(int axis)
+{
+    axis_[axis].base_known = false;
+    axis_[axis].move_pending = false;
+    axis_[axis].planned = false;
+}
+
+/**
+  * @brief  Forgets the limits and target last sent for an axis, use after
+  *     writing trajectory settings to the ODrive directly
+  * @param  int axis - axis to be invalidated
+  * @return void
+  */
+void MotionPlanner::invalidate(int axis)
+{
+    axis_[axis].applied_known = false;
+    axis_[axis].target_known = false;
+    axis_[axis].planned = false;
+}
+
+/**
+  * @brief  Sends the pending moves and steps the velocity ramps, once per control tick
+  * @param  void
+  * @return void
+  */
+void MotionPlanner::service()
+{
+    uint32_t ticks = ticks_;
+    uint32_t elapsed = ticks - tick_count_;
+
+    if (elapsed == 0)
+        return;
+
+    // delay from the timer tick to the setpoints going out
+    profileRecord(PROFILE_CONTROL_JITTER, profileTicks() - tick_time_);
+    tick_count_ = ticks;
+
+    #if defined BOTH_FOR_TESTING
+        // pan and tilt arrive in separate packets, move once both are in
+        if ((axis_[AXIS_BODY].move_pending && axis_[AXIS_HEAD].move_pending) ||
+                ((axis_[AXIS_BODY].move_pending || axis_[AXIS_HEAD].move_pending) && pending_timer_ >= COORDINATION_WINDOW))
+            emitCoordinated();
+    #else
+        for (int axis = 0; axis < NUM_MOTORS; axis++){
+            if (axis_[axis].move_pending)
+                emit(axis);
+        }
+    #endif
+
+    // late ticks are folded into one step
+    float interval = elapsed * tick_period_ * 1e-6f;
+
+    for (int axis = 0; axis < NUM_MOTORS; axis++){
+        if (axis_[axis].velocity_active && axis_[axis].velocity_command != axis_[axis].velocity_target)
+            stepVelocity(axis, interval);
+    }
+}
+
+/**
+  * @brief  Where the ODrive trajectory of an axis should be at a given time
+  * @param  int axis - axis to be checked
+  * @param  uint32_t time - micros() timestamp
+  * @param  float& position - planned position in counts
+  * @param  float& velocity - planned velocity in counts/s
+  * @param  bool& complete - the move has finished by this time
+  * @return bool - false if the axis has no known trajectory
+  */
+bool MotionPlanner::plannedState(int axis, uint32_t time, float& position, float& velocity, bool& complete)
+{
+    Axis_t& a = axis_[axis];
+
+    if (!a.planned || !a.base_known)
+        return false;
+
+    float elapsed = (int32_t)(time - a.trajectory.start_time) * 1e-6f;
+    evaluate(a.trajectory, elapsed, position, velocity);
+    complete = elapsed >= a.trajectory.accel_time + a.trajectory.cruise_time + a.trajectory.decel_time;
+
+    return true;
+}
+
+/**
+  * @brief  Duration of a trapezoidal (or triangular) move from rest to rest
+  * @param  float distance - move distance in counts
+  * @param  float velocity - velocity limit in counts/s
+  * @param  float acceleration - acceleration limit in counts/s^2
+  * @param  float deceleration - deceleration limit in counts/s^2
+  * @return float - duration in seconds
+  */
+float MotionPlanner::trapezoidDuration(float distance, float velocity, float acceleration, float deceleration)
+{
+    distance = fabsf(distance);
+
+    if (velocity <= 0.0f || acceleration <= 0.0f || deceleration <= 0.0f)
+        return 0.0f;
+
+    float ramp_distance = velocity * velocity / (2.0f * acceleration) + velocity * velocity / (2.0f * deceleration);
+
+    if (distance >= ramp_distance)
+        return velocity / acceleration + velocity / deceleration + (distance - ramp_distance) / velocity;
+
+    // never reaches the velocity limit
+    float peak = sqrtf(2.0f * distance * acceleration * deceleration / (acceleration + deceleration));
+    return peak / acceleration + peak / deceleration;
+}
+
+/**
+  * @brief  Writes trajectory limits that differ from the ones last written
+  * @param  int axis - axis to be configured
+  * @param  float velocity - velocity limit in counts/s
+  * @param  float acceleration - acceleration limit in counts/s^2
+  * @param  float deceleration - deceleration limit in counts/s^2
+  * @return void
+  */
+void MotionPlanner::applyLimits(int axis, float velocity, float acceleration, float deceleration)
+{
+    Axis_t& a = axis_[axis];
+
+    acceleration *= acceleration_scale_;
+    deceleration *= acceleration_scale_;
+
+    if (!a.applied_known || velocity != a.applied_velocity)
+        odrive_.ConfigureTrajVelLimit(axis, velocity);
+    if (!a.applied_known || acceleration != a.applied_acceleration)
+        odrive_.ConfigureTrajAccelLimit(axis, acceleration);
+    if (!a.applied_known || deceleration != a.applied_deceleration)
+        odrive_.ConfigureTrajDecelLimit(axis, deceleration);
+
+    a.applied_velocity = velocity;
+    a.applied_acceleration = acceleration;
+    a.applied_deceleration = deceleration;
+    a.applied_known = true;
+}
+
+/**
+  * @brief  Sends the pending move of one axis
+  * @param  int axis - axis to be moved
+  * @return void
+  */
+void MotionPlanner::emit(int axis)
+{
+    plan(axis, axis_[axis].pending);
+    {
+        PROFILE_SECTION(PROFILE_ODRIVE_EMIT);
+        odrive_.TrapezoidalMove(axis, axis_[axis].pending);
+    }
+
+    axis_[axis].target = axis_[axis].pending;
+    axis_[axis].target_known = true;
+    axis_[axis].move_pending = false;
+}
+
+/**
+  * @brief  Sends the pending pan and tilt moves with their limits scaled so both
+  *     axes follow the same profile shape and arrive together in a straight line
+  * @param  void
+  * @return void
+  */
+void MotionPlanner::emitCoordinated()
+{
+    #if defined BOTH_FOR_TESTING
+        float distance[2] = {0.0f, 0.0f};
+        float duration[2] = {0.0f, 0.0f};
+        int axes[2] = {AXIS_BODY, AXIS_HEAD};
+
+        for (int i = 0; i < 2; i++){
+            Axis_t& a = axis_[axes[i]];
+            if (a.move_pending && a.target_known)
+                distance[i] = fabsf(a.pending - a.target);
+            if (distance[i] >= MINIMUM_DISTANCE)
+                duration[i] = trapezoidDuration(distance[i], a.velocity, a.acceleration, a.deceleration);
+        }
+
+        // the slowest axis leads with its own limits, the other is scaled down to match
+        int lead = (duration[0] >= duration[1]) ? 0 : 1;
+        int follow = 1 - lead;
+
+        if (duration[follow] > 0.0f){
+            Axis_t& l = axis_[axes[lead]];
+            Axis_t& f = axis_[axes[follow]];
+            float ratio = distance[follow] / distance[lead];
+
+            // a scaled limit beyond the follower's own slows the lead instead,
+            // clamping the follower alone would change its shape and it would arrive late
+            float velocity = min(l.velocity, f.velocity / ratio);
+            float acceleration = min(l.acceleration, f.acceleration / ratio);
+            float deceleration = min(l.deceleration, f.deceleration / ratio);
+
+            applyLimits(axes[lead], velocity, acceleration, deceleration);
+            applyLimits(axes[follow], velocity * ratio, acceleration * ratio, deceleration * ratio);
+
+            #ifdef TESTING
+                SerialUSB.print("Coordinated move skew: ");
+                SerialUSB.print(1000.0f * (trapezoidDuration(distance[follow], f.applied_velocity, f.applied_acceleration, f.applied_deceleration)
+                    - trapezoidDuration(distance[lead], l.applied_velocity, l.applied_acceleration, l.applied_deceleration)));
+                SerialUSB.println("ms");
+            #endif
+        } else {
+            applyLimits(axes[lead], axis_[axes[lead]].velocity, axis_[axes[lead]].acceleration, axis_[axes[lead]].deceleration);
+            if (axis_[axes[follow]].move_pending)
+                applyLimits(axes[follow], axis_[axes[follow]].velocity, axis_[axes[follow]].acceleration, axis_[axes[follow]].deceleration);
+        }
+
+        for (int i = 0; i < 2; i++){
+            if (axis_[axes[i]].move_pending)
+                emit(axes[i]);
+        }
+    #endif
+}
+
+/**
+  * @brief  Moves the commanded velocity one step towards the target
+  * @param  int axis - axis to be driven
+  * @param  float interval - time covered by this step in seconds
+  * @return void
+  */
+void MotionPlanner::stepVelocity(int axis, float interval)
+{
+    Axis_t& a = axis_[axis];
+    float step = a.ramp_rate * acceleration_scale_ * interval;
+
+    if (step <= 0.0f)
+        a.velocity_command = a.velocity_target;
+    else
+        a.velocity_command += constrain(a.velocity_target - a.velocity_command, -step, step);
+
+    PROFILE_SECTION(PROFILE_ODRIVE_EMIT);
+    odrive_.SetVelocity(axis, a.velocity_command);
+}
+
+/**
+  * @brief  Plans a move the way the ODrive does, starting from the state of the
+  *     previous trajectory so overlapping moves are followed
+  * @param  int axis - axis to be moved
+  * @param  float position - target position in counts
+  * @return void
+  */
+void MotionPlanner::plan(int axis, float position)
+{
+    Axis_t& a = axis_[axis];
+    Trajectory_t& t = a.trajectory;
+    uint32_t now = micros();
+    float start_position;
+    float start_velocity;
+
+    if (a.planned){
+        evaluate(t, (int32_t)(now - t.start_time) * 1e-6f, start_position, start_velocity);
+    }
+    else if (now - odrive_.AsyncFeedback[axis].timestamp < FEEDBACK_AGE){
+        start_velocity = odrive_.AsyncFeedback[axis].velocity;
+        start_position = odrive_.AsyncFeedback[axis].position + start_velocity * (now - odrive_.AsyncFeedback[axis].timestamp) * 1e-6f;
+    }
+    else{
+        // nothing to start from, wait for the next move
+        a.planned = false;
+        return;
+    }
+
+    if (!a.applied_known || a.applied_velocity <= 0.0f || a.applied_acceleration <= 0.0f || a.applied_deceleration <= 0.0f){
+        a.planned = false;
+        return;
+    }
+
+    float distance = position - start_position;
+    float stop_distance = start_velocity * start_velocity / (2.0f * a.applied_deceleration);
+    float direction = (distance - copysignf(stop_distance, start_velocity)) >= 0.0f ? 1.0f : -1.0f;
+
+    t.acceleration = direction * a.applied_acceleration;
+    t.deceleration = -direction * a.applied_deceleration;
+    t.cruise_velocity = direction * a.applied_velocity;
+
+    // already faster than the cruise velocity, slow down to it
+    if (direction * start_velocity > direction * t.cruise_velocity)
+        t.acceleration = -t.acceleration;
+
+    t.accel_time = (t.cruise_velocity - start_velocity) / t.acceleration;
+    t.decel_time = -t.cruise_velocity / t.deceleration;
+
+    float minimum_distance = 0.5f * t.accel_time * (t.cruise_velocity + start_velocity) + 0.5f * t.decel_time * t.cruise_velocity;
+
+    if (direction * distance < direction * minimum_distance){
+        // never reaches the cruise velocity
+        t.cruise_velocity = direction * sqrtf(max(0.0f, (t.deceleration * start_velocity * start_velocity + 2.0f * t.acceleration * t.deceleration * distance) / (t.deceleration - t.acceleration)));
+        t.accel_time = max(0.0f, (t.cruise_velocity - start_velocity) / t.acceleration);
+        t.decel_time = max(0.0f, -t.cruise_velocity / t.deceleration);
+        t.cruise_time = 0.0f;
+    }
+    else{
+        t.cruise_time = (distance - minimum_distance) / t.cruise_velocity;
+    }
+
+    t.start_position = start_position;
+    t.start_velocity = start_velocity;
+    t.final_position = position;
+    t.accel_position = start_position + start_velocity * t.accel_time + 0.5f * t.acceleration * t.accel_time * t.accel_time;
+    t.start_time = now;
+    a.planned = true;
+}
+
+/**
+  * @brief  Position and velocity along a planned trajectory
+  * @param  const Trajectory_t& trajectory - planned move
+  * @param  float time - seconds since the move started
+  * @param  float& position - counts
+  * @param  float& velocity - counts/s
+  * @return void
+  */
+void MotionPlanner::evaluate(const Trajectory_t& trajectory, float time, float& position, float& velocity)
+{
+    const Trajectory_t& t = trajectory;
+    float total_time = t.accel_time + t.cruise_time + t.decel_time;
+
+    if (time < 0.0f){
+        position = t.start_position;
+        velocity = t.start_velocity;
+    } else if (time < t.accel_time){
+        position = t.start_position + t.start_velocity * time + 0.5f * t.acceleration * time * time;
+        velocity = t.start_velocity + t.acceleration * time;
+    } else if (time < t.accel_time + t.cruise_time){
+        position = t.accel_position + t.cruise_velocity * (time - t.accel_time);
+        velocity = t.cruise_velocity;
+    } else if (time < total_time){
+        float remaining = time - total_time;
+        position = t.final_position + 0.5f * t.deceleration * remaining * remaining;
+        velocity = t.deceleration * remaining;
+    } else{
+        position = t.final_position;
+        velocity = 0.0f;
+    }
+}
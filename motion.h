@@ -0,0 +1,118 @@
+/*
+ * Motion Header
+ *
+ * @file    motion.h
+ * @author  Carbon Video Systems 2019
+ * @description   Pan/tilt motion planner.
+ * All trajectory moves and trajectory limits go through this class so
+ * limit writes are deduplicated and, with both axes on one ODrive, pan
+ * and tilt moves are coordinated to arrive together.  Velocity changes in the
+ * continuous modes are ramped so reversals do not slam the belts.
+ * Frames only update targets, setpoints are sent on a fixed rate control
+ * tick driven by a hardware timer.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef MOTION_H
+#define MOTION_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+#include "ODriveLib.h"
+#include "options.h"
+
+/* Constants -----------------------------------------------------------*/
+#define COORDINATION_WINDOW 5   // ms to wait for the other axis' target before moving alone
+#define CONTROL_RATE        100 // Hz, setpoints are sent and velocity ramps stepped on this tick
+
+/* Functions------------------------------------------------------------*/
+class MotionPlanner {
+public:
+    MotionPlanner(ODriveClass& odrive) : odrive_(odrive), acceleration_scale_(1.0f), tick_period_(1000000 / CONTROL_RATE) {}
+
+    void begin(uint16_t rate = CONTROL_RATE);
+    void setLimits(int axis, float velocity, float acceleration, float deceleration);
+    void moveTo(int axis, float position);
+    void setRampRate(int axis, float rate);
+    void setAccelerationScale(float scale);
+    void setVelocity(int axis, float velocity);
+    void stopVelocity(int axis);
+    void setOffset(int axis, float offset);
+    void release(int axis);
+    void invalidate(int axis);
+    void service();
+
+    bool tickPending();
+    bool tracking(int axis) { return axis_[axis].base_known; }
+    bool rotating(int axis) { return axis_[axis].velocity_active; }
+    bool stopped(int axis);
+    bool plannedState(int axis, uint32_t time, float& position, float& velocity, bool& complete);
+
+    static float trapezoidDuration(float distance, float velocity, float acceleration, float deceleration);
+
+private:
+    ODriveClass& odrive_;
+
+    // mirror of the ODrive trapezoidal planner for the last move
+    struct Trajectory_t {
+        float start_position;
+        float start_velocity;
+        float final_position;
+        float acceleration;     // signed, counts/s^2
+        float cruise_velocity;  // signed, counts/s
+        float deceleration;     // signed, counts/s^2
+        float accel_time;       // s
+        float cruise_time;
+        float decel_time;
+        float accel_position;   // position at the end of the acceleration
+        uint32_t start_time;    // micros()
+    };
+
+    struct Axis_t {
+        float base;             // position requested with moveTo()
+        bool base_known;        // axis is under trajectory control
+        float offset;           // added to base, set by the effects engine
+        float target;           // last position sent to the ODrive
+        bool target_known;
+        float pending;          // position waiting for service()
+        bool move_pending;
+        float velocity;         // limits requested with setLimits()
+        float acceleration;
+        float deceleration;
+        float applied_velocity; // limits last written to the ODrive
+        float applied_acceleration;
+        float applied_deceleration;
+        bool applied_known;
+        float ramp_rate;        // counts/s^2 for velocity changes
+        float velocity_target;  // velocity requested with setVelocity()
+        float velocity_command; // velocity last sent to the ODrive
+        bool velocity_active;   // axis is under velocity control
+        Trajectory_t trajectory;
+        bool planned;           // trajectory follows the last move sent
+    } axis_[2];
+
+    float acceleration_scale_;  // applied to every acceleration limit and velocity ramp
+    elapsedMillis pending_timer_;
+    IntervalTimer tick_timer_;
+    uint32_t tick_period_;      // us
+    uint32_t tick_count_;       // control ticks already serviced
+
+    static volatile uint32_t ticks_;        // written by the control tick interrupt
+    static volatile uint32_t tick_time_;    // profileTicks() of the last control tick
+    static void tick();
+
+    void applyLimits(int axis, float velocity, float acceleration, float deceleration);
+    void emit(int axis);
+    void emitCoordinated();
+    void stepVelocity(int axis, float interval);
+    void plan(int axis, float position);
+    static void evaluate(const Trajectory_t& trajectory, float time, float& position, float& velocity);
+};
+
+#endif //MOTION_H
@@ -30,14 +30,20 @@
     /* Testing specific stuff */
 #endif
 
-/* Define either BODY or HEAD for normal operation or BOTH_FOR_TESTING for testing purposes*/
-#define BODY
+/* Define either HEAD for normal operation or BOTH_FOR_TESTING for testing purposes, BODY otherwise*/
 // #define HEAD
 // #define BOTH_FOR_TESTING
+#if !defined HEAD && !defined BOTH_FOR_TESTING
+    #define BODY
+#endif
 
 // Define FANS and/or LED_RING as needed
 #define FANS
 // #define LED_RING
+// Define TEMP_ALERT when the TMP102 ALERT lines are wired to TEMP_ALERT_PIN (fan.cpp)
+// #define TEMP_ALERT
+// Define FAN_TACH when the fan tachometer outputs are wired to the tach pins (fan.cpp)
+// #define FAN_TACH
 
 #if defined BODY
     /* Body specific stuff */
@@ -0,0 +1,82 @@
+/*
+ * Predictor Source
+ *
+ * @file    predictor.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Pan/tilt target prediction.
+ * Estimates how fast the console is moving a target from the ArtNet frames
+ * and leads it by the configured pipeline latency, so the fixture does not
+ * trail behind the console.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "predictor.h"
+
+/* Constants -----------------------------------------------------------*/
+#define MINIMUM_LEAD    1.0f    // counts, smaller leads are dropped so a held target settles
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Sets how far ahead targets of an axis are predicted
+  * @param  int axis - axis to be configured
+  * @param  uint16_t horizon - pipeline latency in ms, 0 disables prediction
+  * @return void
+  */
+void Predictor::setHorizon(int axis, uint16_t horizon)
+{
+    axis_[axis].horizon = min(horizon, (uint16_t)PREDICTION_MAX_HORIZON);
+    reset(axis);
+}
+
+/**
+  * @brief  Takes the target of a new frame and predicts where it will be once
+  *     the pipeline latency has passed
+  * @param  int axis - axis the target belongs to
+  * @param  float target - target position in counts
+  * @return float - predicted target, the target itself when prediction is off
+  */
+float Predictor::update(int axis, float target)
+{
+    Axis_t& a = axis_[axis];
+    uint32_t now = micros();
+
+    if (a.horizon == 0)
+        return target;
+
+    float interval = (now - a.time) * 1e-6f;
+
+    if (!a.known || interval * 1000.0f > PREDICTION_FRAME_GAP || interval <= 0.0f)
+        a.velocity = 0.0f;
+    else
+        a.velocity += PREDICTION_SMOOTHING * ((target - a.target) / interval - a.velocity);
+
+    a.target = target;
+    a.time = now;
+    a.known = true;
+
+    float lead = a.velocity * a.horizon * 1e-3f;
+
+    if (abs(lead) < MINIMUM_LEAD){
+        a.velocity = 0.0f;
+        return target;
+    }
+
+    return target + lead;
+}
+
+/**
+  * @brief  Forgets the target history, use when the control mode changes
+  * @param  int axis - axis to be reset
+  * @return void
+  */
+void Predictor::reset(int axis)
+{
+    axis_[axis].known = false;
+    axis_[axis].velocity = 0.0f;
+}
@@ -0,0 +1,56 @@
+/*
+ * Predictor Header
+ *
+ * @file    predictor.h
+ * @author  Carbon Video Systems 2019
+ * @description   Pan/tilt target prediction.
+ * Estimates how fast the console is moving a target from the ArtNet frames
+ * and leads it by the configured pipeline latency, so the fixture does not
+ * trail behind the console.
+ * Experimental: it only removes the pipeline latency, not the lag of the
+ * ODrive trajectory braking to stop on each new target, and it runs past
+ * the target when a move stops.  Tune the horizon with the replay harness
+ * in test/test_predictor.cpp before enabling it for a show.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+#include <stdint.h>
+
+/* Constants -----------------------------------------------------------*/
+#define PREDICTION_FRAME_GAP    100     // ms without a frame before the target counts as stopped
+#define PREDICTION_SMOOTHING    0.5f    // weight of the newest velocity sample
+#define PREDICTION_MAX_HORIZON  500     // ms
+
+/* Functions------------------------------------------------------------*/
+class Predictor {
+public:
+    Predictor() {}
+
+    void setHorizon(int axis, uint16_t horizon);
+    float update(int axis, float target);
+    void reset(int axis);
+
+    bool enabled(int axis) { return axis_[axis].horizon > 0; }
+    bool moving(int axis) { return axis_[axis].velocity != 0.0f; }
+
+private:
+    struct Axis_t {
+        uint16_t horizon;       // ms to lead the target by, 0 disables prediction
+        float target;           // last target from the console
+        uint32_t time;          // micros() of the last target
+        bool known;
+        float velocity;         // smoothed target velocity in counts/s
+    } axis_[2];
+};
+
+#endif //PREDICTOR_H
@@ -0,0 +1,225 @@
+/*
+ * Profiler Source
+ *
+ * @file    profiler.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Lightweight timing instrumentation.
+ * Boot phases are stamped with micros() into a static table which can be
+ * printed as CSV on the debug console or packed into a telemetry frame.
+ * Code sections are timed with the DWT cycle counter into log2 histograms,
+ * cheap enough to stay enabled in production builds.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "profiler.h"
+
+/* Constants -----------------------------------------------------------*/
+#define BOOT_EVENT_PACKED_SIZE  6   // id, axis, 32 bit big endian time
+
+/* Variables  ----------------------------------------------------------*/
+struct BootEvent_t {
+    uint8_t id;
+    uint8_t axis;
+    uint32_t time;      // micros() since power on
+};
+
+BootEvent_t boot_profile[BOOT_PROFILE_SIZE];
+uint8_t boot_profile_count = 0;
+uint32_t boot_number = 0;       // stored power on counter, see countBoot()
+
+struct ProfileHistogram_t {
+    uint32_t buckets[PROFILE_BUCKETS];
+    uint32_t max;       // ticks
+};
+
+ProfileHistogram_t profile_histogram[PROFILE_SECTION_COUNT];
+
+const char* const profile_names[PROFILE_SECTION_COUNT] = {"loop", "frame parse", "odrive emit", "fan update", "led show", "control jitter"};
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Clears the boot profile
+  * @param  uint32_t boot - power on counter the profile is reported under
+  * @return void
+  */
+void bootProfileReset(uint32_t boot)
+{
+    boot_number = boot;
+    boot_profile_count = 0;
+}
+
+/**
+  * @brief  Stamps a boot phase boundary, ignored once the table is full
+  * @param  uint8_t id - phase being entered
+  * @param  uint8_t axis - axis the phase applies to
+  * @return void
+  */
+void bootProfileMark(uint8_t id, uint8_t axis)
+{
+    if (boot_profile_count >= BOOT_PROFILE_SIZE)
+        return;
+
+    boot_profile[boot_profile_count].id = id;
+    boot_profile[boot_profile_count].axis = axis;
+    boot_profile[boot_profile_count].time = micros();
+    boot_profile_count++;
+}
+
+/**
+  * @brief  Prints the boot profile as CSV, one phase boundary per line
+  * @param  Print& out - stream to print to
+  * @return void
+  */
+void bootProfilePrint(Print& out)
+{
+    out.println("boot,index,phase,axis,us");
+
+    for (uint8_t i = 0; i < boot_profile_count; i++){
+        out.print(boot_number);
+        out.print(",");
+        out.print(i);
+        out.print(",");
+        out.print(boot_profile[i].id);
+        out.print(",");
+        out.print(boot_profile[i].axis);
+        out.print(",");
+        out.println(boot_profile[i].time);
+    }
+}
+
+/**
+  * @brief  Packs the boot profile for a telemetry frame
+  *     [boot, 32 bit big endian] then [id][axis][time, 32 bit big endian] per phase boundary
+  * @param  uint8_t* buffer - destination buffer
+  * @param  uint8_t size - size of buffer in bytes
+  * @return uint8_t - number of bytes packed
+  */
+uint8_t bootProfilePack(uint8_t* buffer, uint8_t size)
+{
+    uint8_t length = 0;
+
+    if (size < 4)
+        return 0;
+
+    buffer[length++] = boot_number >> 24;
+    buffer[length++] = boot_number >> 16;
+    buffer[length++] = boot_number >> 8;
+    buffer[length++] = boot_number;
+
+    for (uint8_t i = 0; i < boot_profile_count && length + BOOT_EVENT_PACKED_SIZE <= size; i++){
+        buffer[length++] = boot_profile[i].id;
+        buffer[length++] = boot_profile[i].axis;
+        buffer[length++] = boot_profile[i].time >> 24;
+        buffer[length++] = boot_profile[i].time >> 16;
+        buffer[length++] = boot_profile[i].time >> 8;
+        buffer[length++] = boot_profile[i].time;
+    }
+
+    return length;
+}
+
+/**
+  * @brief  Starts the cycle counter used to time sections
+  * @param  void
+  * @return void
+  */
+void profileBegin(void)
+{
+    #if defined ARM_DWT_CYCCNT
+        ARM_DEMCR |= ARM_DEMCR_TRCENA;
+        ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+    #endif
+
+    profileReset();
+}
+
+/**
+  * @brief  Adds one timed run of a section to its histogram
+  * @param  ProfileSection_t section - section that was timed
+  * @param  uint32_t ticks - duration of the run
+  * @return void
+  */
+void profileRecord(ProfileSection_t section, uint32_t ticks)
+{
+    ProfileHistogram_t& histogram = profile_histogram[section];
+    uint8_t bucket = 31 - __builtin_clz(ticks | 1);
+
+    histogram.buckets[min(bucket, (uint8_t)(PROFILE_BUCKETS - 1))]++;
+    if (ticks > histogram.max)
+        histogram.max = ticks;
+}
+
+/**
+  * @brief  Prints every section histogram as CSV, skipping empty buckets
+  * @param  Print& out - stream to print to
+  * @return void
+  */
+void profilePrint(Print& out)
+{
+    out.println("profile,section,bucket_us,count");
+
+    for (uint8_t i = 0; i < PROFILE_SECTION_COUNT; i++){
+        for (uint8_t b = 0; b < PROFILE_BUCKETS; b++){
+            if (profile_histogram[i].buckets[b] == 0)
+                continue;
+            out.print("profile,");
+            out.print(profile_names[i]);
+            out.print(",");
+            out.print((float)(1UL << b) / PROFILE_TICKS_PER_US);
+            out.print(",");
+            out.println(profile_histogram[i].buckets[b]);
+        }
+        out.print("profile,");
+        out.print(profile_names[i]);
+        out.print(",max,");
+        out.println((float)profile_histogram[i].max / PROFILE_TICKS_PER_US);
+    }
+}
+
+/**
+  * @brief  Clears every section histogram
+  * @param  void
+  * @return void
+  */
+void profileReset(void)
+{
+    memset(profile_histogram, 0, sizeof(profile_histogram));
+}
+
+/**
+  * @brief  Packs one section histogram for a telemetry frame
+  *     [section][ticks per us][max ticks, 32 bit big endian][bucket counts, 16 bit big endian, saturated]
+  * @param  ProfileSection_t section - section to be packed
+  * @param  uint8_t* buffer - destination buffer
+  * @param  uint8_t size - size of buffer in bytes
+  * @return uint8_t - number of bytes packed, 0 when buffer is too small
+  */
+uint8_t profilePack(ProfileSection_t section, uint8_t* buffer, uint8_t size)
+{
+    ProfileHistogram_t& histogram = profile_histogram[section];
+    uint8_t length = 0;
+
+    if (size < PROFILE_PACKED_SIZE)
+        return 0;
+
+    buffer[length++] = section;
+    buffer[length++] = PROFILE_TICKS_PER_US;
+    buffer[length++] = histogram.max >> 24;
+    buffer[length++] = histogram.max >> 16;
+    buffer[length++] = histogram.max >> 8;
+    buffer[length++] = histogram.max;
+
+    for (uint8_t b = 0; b < PROFILE_BUCKETS; b++){
+        uint16_t count = min(histogram.buckets[b], (uint32_t)0xFFFF);
+        buffer[length++] = count >> 8;
+        buffer[length++] = count;
+    }
+
+    return length;
+}
@@ -0,0 +1,94 @@
+/*
+ * Profiler Header
+ *
+ * @file    profiler.h
+ * @author  Carbon Video Systems 2019
+ * @description   Lightweight timing instrumentation.
+ * Boot phases are stamped with micros() into a static table which can be
+ * printed as CSV on the debug console or packed into a telemetry frame.
+ * Code sections are timed with the DWT cycle counter into log2 histograms,
+ * cheap enough to stay enabled in production builds.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+#include "options.h"
+
+/* Constants -----------------------------------------------------------*/
+#define BOOT_PROFILE_SIZE       32      // phase boundaries kept per boot
+#define BOOT_EVENT_FIRST_FRAME  0xF0    // ids below this are StartupSequencer::Phase_t
+#define BOOT_PROFILE_PACKED_SIZE    (4 + BOOT_PROFILE_SIZE * 6)
+
+#define PROFILE_BUCKETS         24      // bucket n counts durations of 2^n to 2^(n+1)-1 ticks
+#define PROFILE_PACKED_SIZE     (6 + PROFILE_BUCKETS * 2)
+#define PROFILE_REPORT_INTERVAL 2000    // ms between section telemetry frames
+
+// DWT cycle counter on the Teensy, micros() where it does not exist
+#if defined ARM_DWT_CYCCNT
+    #define PROFILE_TICKS_PER_US    (F_CPU / 1000000)
+#else
+    #define PROFILE_TICKS_PER_US    1
+#endif
+
+enum ProfileSection_t {
+    PROFILE_LOOP = 0,           // one scheduler pass
+    PROFILE_FRAME_PARSE = 1,    // StormBreaker message
+    PROFILE_ODRIVE_EMIT = 2,    // motion command sent to the ODrive
+    PROFILE_FAN_UPDATE = 3,     // temperature read and fan PWM
+    PROFILE_LED_SHOW = 4,       // LED ring refresh
+    PROFILE_CONTROL_JITTER = 5, // control tick to setpoints sent
+    PROFILE_SECTION_COUNT
+};
+
+/* Functions------------------------------------------------------------*/
+void bootProfileReset(uint32_t boot);
+void bootProfileMark(uint8_t id, uint8_t axis);
+void bootProfilePrint(Print& out);
+uint8_t bootProfilePack(uint8_t* buffer, uint8_t size);
+
+void profileBegin(void);
+void profileRecord(ProfileSection_t section, uint32_t ticks);
+void profilePrint(Print& out);
+void profileReset(void);
+uint8_t profilePack(ProfileSection_t section, uint8_t* buffer, uint8_t size);
+
+/**
+  * @brief  Reads the profiling clock
+  * @param  void
+  * @return uint32_t - current time in ticks
+  */
+inline uint32_t profileTicks(void)
+{
+    #if defined ARM_DWT_CYCCNT
+        return ARM_DWT_CYCCNT;
+    #else
+        return micros();
+    #endif
+}
+
+// Times the enclosing scope into a section histogram
+class ProfileScope {
+public:
+    ProfileScope(ProfileSection_t section) : section_(section), start_(profileTicks()) {}
+    ~ProfileScope() { profileRecord(section_, profileTicks() - start_); }
+
+private:
+    ProfileSection_t section_;
+    uint32_t start_;
+};
+
+#define PROFILE_CONCAT_(a, b)   a##b
+#define PROFILE_CONCAT(a, b)    PROFILE_CONCAT_(a, b)
+#define PROFILE_SECTION(section)    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(section)
+
+#endif //PROFILER_H
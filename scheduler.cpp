@@ -0,0 +1,158 @@
+/*
+ * Scheduler Source
+ *
+ * @file    scheduler.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Cooperative task scheduler for loop().
+ * Each pass runs the most urgent ready task: the highest priority first,
+ * then the earliest deadline.  Command servicing therefore never waits
+ * behind more than one housekeeping task.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "scheduler.h"
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Registers a task
+  * @param  const char* name - name shown in the statistics
+  * @param  TaskFunction_t task - function to run, must not block for long
+  * @param  uint32_t period - us between releases, 0 to run whenever ready
+  * @param  uint32_t deadline - us after release by which the task must have finished
+  * @param  Priority_t priority - lower values always run first
+  * @param  ReadyFunction_t ready - optional gate, the task is only released while it returns true
+  * @return int - task index, -1 when the table is full
+  */
+int Scheduler::addTask(const char* name, TaskFunction_t task, uint32_t period, uint32_t deadline, Priority_t priority, ReadyFunction_t ready)
+{
+    if (task_count_ >= SCHEDULER_MAX_TASKS)
+        return -1;
+
+    Task_t& t = tasks_[task_count_];
+    t.name = name;
+    t.task = task;
+    t.ready = ready;
+    t.period = period;
+    t.deadline = deadline;
+    t.priority = priority;
+    t.release = micros();
+    t.pending = false;
+    t.runs = 0;
+    t.overruns = 0;
+    t.max_duration = 0;
+
+    return task_count_++;
+}
+
+/**
+  * @brief  Checks whether a task is due, latching the time it was released
+  * @param  Task_t& task - task to be checked
+  * @param  uint32_t now - current micros()
+  * @return bool - true when the task should run
+  */
+bool Scheduler::released(Task_t& task, uint32_t now)
+{
+    if (task.pending)
+        return true;
+
+    if (task.period > 0 && (int32_t)(now - task.release) < 0)
+        return false;
+
+    if (task.ready != NULL && !task.ready()){
+        // held back, not late, so it is released on time once the gate opens
+        if (task.period > 0)
+            task.release = now;
+        return false;
+    }
+
+    // event driven tasks are released when they are first seen ready
+    if (task.period == 0)
+        task.release = now;
+
+    task.pending = true;
+    return true;
+}
+
+/**
+  * @brief  Runs the most urgent released task, call from loop()
+  * @param  void
+  * @return void
+  */
+void Scheduler::run()
+{
+    uint32_t now = micros();
+    Task_t* next = NULL;
+
+    for (int i = 0; i < task_count_; i++){
+        Task_t& task = tasks_[i];
+
+        if (!released(task, now))
+            continue;
+
+        if (next == NULL || task.priority < next->priority ||
+                (task.priority == next->priority && (int32_t)((task.release + task.deadline) - (next->release + next->deadline)) < 0))
+            next = &task;
+    }
+
+    if (next == NULL)
+        return;
+
+    uint32_t start = micros();
+    next->task();
+    uint32_t finish = micros();
+
+    next->pending = false;
+    next->runs++;
+    next->max_duration = max(next->max_duration, finish - start);
+
+    if (finish - next->release > next->deadline)
+        next->overruns++;
+
+    if (next->period > 0){
+        next->release += next->period;
+        // skip releases that were missed instead of running back to back
+        if ((int32_t)(finish - next->release) >= 0)
+            next->release = finish + next->period;
+    }
+}
+
+/**
+  * @brief  Prints runs, overruns and the longest run of each task
+  * @param  Print& out - stream to print to
+  * @return void
+  */
+void Scheduler::printStatistics(Print& out)
+{
+    out.println("task,priority,runs,overruns,max_us");
+    for (int i = 0; i < task_count_; i++){
+        out.print(tasks_[i].name);
+        out.print(",");
+        out.print((int)tasks_[i].priority);
+        out.print(",");
+        out.print(tasks_[i].runs);
+        out.print(",");
+        out.print(tasks_[i].overruns);
+        out.print(",");
+        out.println(tasks_[i].max_duration);
+    }
+}
+
+/**
+  * @brief  Clears the statistics of every task
+  * @param  void
+  * @return void
+  */
+void Scheduler::resetStatistics()
+{
+    for (int i = 0; i < task_count_; i++){
+        tasks_[i].runs = 0;
+        tasks_[i].overruns = 0;
+        tasks_[i].max_duration = 0;
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * Scheduler Header
+ *
+ * @file    scheduler.h
+ * @author  Carbon Video Systems 2019
+ * @description   Cooperative task scheduler for loop().
+ * Each pass runs the most urgent ready task: the highest priority first,
+ * then the earliest deadline.  Command servicing therefore never waits
+ * behind more than one housekeeping task.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+/* Constants -----------------------------------------------------------*/
+#define SCHEDULER_MAX_TASKS     16
+
+/* Functions------------------------------------------------------------*/
+class Scheduler {
+public:
+    Scheduler() : task_count_(0) {}
+
+    typedef void (*TaskFunction_t)(void);
+    typedef bool (*ReadyFunction_t)(void);
+
+    enum Priority_t {
+        PRIORITY_COMMAND = 0,       // StormBreaker and debug input
+        PRIORITY_CONTROL = 1,       // startup, motion and feedback
+        PRIORITY_HOUSEKEEPING = 2   // fans, LEDs
+    };
+
+    int addTask(const char* name, TaskFunction_t task, uint32_t period, uint32_t deadline, Priority_t priority, ReadyFunction_t ready = NULL);
+    void run();
+
+    void printStatistics(Print& out);
+    void resetStatistics();
+
+private:
+    struct Task_t {
+        const char* name;
+        TaskFunction_t task;
+        ReadyFunction_t ready;      // optional, the task is only released while this returns true
+        uint32_t period;            // us, 0 releases the task whenever it is ready
+        uint32_t deadline;          // us after release by which the task must have finished
+        Priority_t priority;
+        uint32_t release;           // micros() of the current or next release
+        bool pending;               // released and waiting to run
+        uint32_t runs;
+        uint32_t overruns;          // runs that finished after their deadline
+        uint32_t max_duration;      // us
+    } tasks_[SCHEDULER_MAX_TASKS];
+
+    int task_count_;
+
+    bool released(Task_t& task, uint32_t now);
+};
+
+#endif //SCHEDULER_H
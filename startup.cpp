@@ -0,0 +1,596 @@
+/*
+ * Startup Source
+ *
+ * @file    startup.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Non-blocking ODrive startup and homing sequencer.
+ * The sequence is advanced one step at a time from loop() so the
+ * StormBreaker link and the LED ring keep being serviced while the
+ * ODrive calibrates and the system homes.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "startup.h"
+#include "calibration.h"
+#include "profiler.h"
+#include "storage.h"
+
+/* Constants -----------------------------------------------------------*/
+#define STATE_POLL_INTERVAL     100     // ms between ODrive state reads
+#define STATE_POLL_MIN          2       // ms, first poll after a calibration step starts
+#define MOVE_POLL_INTERVAL      10      // ms between feedback reads while moving
+#define SAVE_CONFIGURATION_TIME 2000    // ms
+#define REBOOT_TIME             2000    // ms
+
+#if defined BOTH_FOR_TESTING
+    #define FIRST_AXIS  0
+#elif defined BODY
+    #define FIRST_AXIS  AXIS_BODY
+#elif defined HEAD
+    #define FIRST_AXIS  AXIS_HEAD
+#endif
+
+#if defined BODY || defined BOTH_FOR_TESTING
+    #define HOMING_AXIS AXIS_BODY
+#else
+    #define HOMING_AXIS AXIS_HEAD
+#endif
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Starts the startup sequence from the beginning
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::begin()
+{
+    axis_ = FIRST_AXIS;
+    calibration_status_[0] = true;
+    calibration_status_[1] = true;
+    axis_failed_[0] = false;
+    axis_failed_[1] = false;
+    reconfigured_ = false;
+    rebooted_ = false;
+
+    thor_.enableMotion(false);
+    bootProfileReset(countBoot());
+
+    #ifdef TESTING
+        SerialUSB.println("Searching for and waiting for ODrive");
+    #endif
+
+    setPhase(PHASE_WAIT_ODRIVE);
+}
+
+/**
+  * @brief  Advances the startup sequence, returns without waiting
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::service()
+{
+    switch(phase_){
+    case PHASE_WAIT_ODRIVE:
+        serviceWaitODrive();
+        break;
+    case PHASE_CONFIGURE:
+        serviceConfigure();
+        break;
+    case PHASE_MOTOR_CALIBRATION:
+    case PHASE_ENCODER_INDEX_SEARCH:
+    case PHASE_ENCODER_OFFSET_CALIBRATION:
+        serviceCalibration();
+        break;
+    case PHASE_SAVE:
+    case PHASE_REBOOT:
+        serviceSave();
+        break;
+    case PHASE_VERIFY_BACKOFF:
+    case PHASE_VERIFY_APPROACH:
+    case PHASE_INDEX_SEARCH:
+    case PHASE_INDEX_BACKOFF:
+    case PHASE_INDEX_APPROACH:
+        serviceIndex();
+        break;
+    case PHASE_HOMING:
+        serviceHoming();
+        break;
+    case PHASE_DONE:
+    case PHASE_FAILED:
+        break;
+    }
+}
+
+/**
+  * @brief  Moves to the next phase and reports it
+  * @param  Phase_t phase - the next phase
+  * @return void
+  */
+void StartupSequencer::setPhase(Phase_t phase)
+{
+    uint8_t status[2] = {(uint8_t)phase, (uint8_t)axis_};
+
+    phase_ = phase;
+    phase_timer_ = 0;
+    poll_timer_ = 0;
+    poll_interval_ = STATE_POLL_MIN;
+
+    bootProfileMark(phase, axis_);
+
+    thor_.sendTelemetry(StormBreaker::TELEMETRY_STARTUP, status, sizeof(status));
+
+    #ifdef TESTING
+        SerialUSB.print("Startup phase ");
+        SerialUSB.print(phase);
+        SerialUSB.print(" axis ");
+        SerialUSB.println(axis_);
+    #endif
+}
+
+/**
+  * @brief  Polls each axis until the ODrive has finished its own startup sequence
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::serviceWaitODrive()
+{
+    if (poll_timer_ < STATE_POLL_INTERVAL)
+        return;
+    poll_timer_ = 0;
+
+    int32_t current_state = odrive_.readState(axis_);
+
+    #ifdef TESTING
+        SerialUSB.print("CURRENT STATE: ");
+        SerialUSB.println(current_state);
+    #endif
+
+    if (current_state != ODriveClass::AXIS_STATE_CLOSED_LOOP_CONTROL && current_state != ODriveClass::AXIS_STATE_IDLE && phase_timer_ <= STARTUP_TIMEOUT)
+        return;
+
+    calibration_status_[axis_] = (current_state == ODriveClass::AXIS_STATE_CLOSED_LOOP_CONTROL);
+
+    #ifdef TESTING
+        SerialUSB.print("Calibration status: ");
+        SerialUSB.println(calibration_status_[axis_] ? "calibrated" : "not calibrated");
+    #endif
+
+    // the configuration has already been saved once, an axis still out of closed loop is not coming back
+    if (rebooted_ && !calibration_status_[axis_] && !axis_failed_[axis_])
+        failAxis(odrive_.readAxisError(axis_));
+
+    if (++axis_ < FIRST_AXIS + NUM_MOTORS){
+        setPhase(PHASE_WAIT_ODRIVE);
+    } else if (rebooted_){
+        startHoming();
+    } else {
+        axis_ = FIRST_AXIS;
+        setPhase(PHASE_CONFIGURE);
+    }
+}
+
+/**
+  * @brief  Syncs the configuration of the next axis and starts the calibration
+  *     steps it needs if it did not reach closed loop
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::serviceConfigure()
+{
+    if (configuration_sync(odrive_, axis_, calibration_status_[axis_]))
+        reconfigured_ = true;
+
+    if (calibration_status_[axis_] || axis_failed_[axis_]){
+        if (calibration_status_[axis_])
+            odrive_.SetControlModePos(axis_);
+        nextAxis();
+        return;
+    }
+
+    #ifdef TESTING
+        SerialUSB.print("Calibrating axis ");
+        SerialUSB.println(axis_);
+    #endif
+
+    if (odrive_.MotorCalibrationStatus(axis_)){
+        if (odrive_.EncoderReadyStatus(axis_)){
+            // nothing to calibrate, enter closed loop without a reboot
+            odrive_.SetControlModePos(axis_);
+            odrive_.run_state(axis_, ODriveClass::AXIS_STATE_CLOSED_LOOP_CONTROL, false);
+            nextAxis();
+        } else {
+            encoder_calibrate(odrive_, axis_);
+            setPhase(PHASE_ENCODER_INDEX_SEARCH);
+        }
+    } else {
+        // FULL CALIBRATION SEQUENCE
+        motor_calibrate(odrive_, axis_);
+        setPhase(PHASE_MOTOR_CALIBRATION);
+    }
+}
+
+/**
+  * @brief  Waits for a calibration step to return the axis to idle, then starts the next one
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::serviceCalibration()
+{
+    if (poll_timer_ < poll_interval_)
+        return;
+    poll_timer_ = 0;
+
+    if (poll_interval_ < STATE_POLL_INTERVAL)
+        poll_interval_ = min(poll_interval_ * 2, (unsigned long)STATE_POLL_INTERVAL);
+
+    ODriveClass::StateWait_t status = odrive_.check_state(axis_, ODriveClass::AXIS_STATE_IDLE);
+
+    if (status == ODriveClass::STATE_PENDING && phase_timer_ <= STARTUP_TIMEOUT)
+        return;
+
+    #ifdef TESTING
+        SerialUSB.print("Calibration step took ");
+        SerialUSB.print((unsigned long)phase_timer_);
+        SerialUSB.println("ms");
+    #endif
+
+    if (status != ODriveClass::STATE_REACHED){
+        // the remaining steps would fail the same way, the axis is left out of homing and motion
+        failAxis(status == ODriveClass::STATE_FAILED ? odrive_.AxisError : odrive_.readAxisError(axis_));
+        nextAxis();
+        return;
+    }
+
+    switch(phase_){
+    case PHASE_MOTOR_CALIBRATION:
+        motor_calibrate_finish(odrive_, axis_);
+        encoder_calibrate(odrive_, axis_);
+        setPhase(PHASE_ENCODER_INDEX_SEARCH);
+        break;
+    case PHASE_ENCODER_INDEX_SEARCH:
+        encoder_offset_calibrate(odrive_, axis_);
+        setPhase(PHASE_ENCODER_OFFSET_CALIBRATION);
+        break;
+    default:
+        // the pre_calibrated flags need saving
+        encoder_calibrate_finish(odrive_, axis_);
+        reconfigured_ = true;
+        odrive_.SetControlModePos(axis_);
+        nextAxis();
+        break;
+    }
+}
+
+/**
+  * @brief  Waits out the ODrive configuration save and reboot
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::serviceSave()
+{
+    if (phase_ == PHASE_SAVE && phase_timer_ >= SAVE_CONFIGURATION_TIME){
+        odrive_.Reboot();
+        rebooted_ = true;
+        setPhase(PHASE_REBOOT);
+    } else if (phase_ == PHASE_REBOOT && phase_timer_ >= REBOOT_TIME){
+        axis_ = FIRST_AXIS;
+        setPhase(PHASE_WAIT_ODRIVE);
+    }
+}
+
+/**
+  * @brief  Steps through the hall sensor search, see startHoming()
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::serviceIndex()
+{
+    bool timeout = phase_timer_ >= STARTUP_TIMEOUT;
+
+    switch(phase_){
+    case PHASE_VERIFY_BACKOFF:
+    case PHASE_INDEX_BACKOFF:
+        if (poll_timer_ < MOVE_POLL_INTERVAL)
+            return;
+        poll_timer_ = 0;
+
+        if (move_settled(odrive_, axis_, target_) || timeout){
+            // checking the stored edge only needs to cover the tolerance, a miss costs little
+            if (phase_ == PHASE_VERIFY_BACKOFF)
+                target_ = coarse_position_ + HOMING_VERIFY_TOLERANCE;
+            else
+                target_ = coarse_position_ + HOMING_BACKOFF;
+            hall_sensor_arm(odrive_, axis_, target_, HOMING_VELOCITY);
+            setPhase(phase_ == PHASE_VERIFY_BACKOFF ? PHASE_VERIFY_APPROACH : PHASE_INDEX_APPROACH);
+        }
+        break;
+    case PHASE_INDEX_SEARCH:
+        if (hall_sensor_captured()){
+            hall_sensor_disarm();
+            coarse_position_ = hall_edge_position(odrive_, axis_);
+
+            // back off and approach again, always from the same side
+            target_ = coarse_position_ - HOMING_BACKOFF;
+            odrive_.TrapezoidalMove(axis_, target_);
+            setPhase(PHASE_INDEX_BACKOFF);
+            return;
+        }
+
+        if (poll_timer_ < MOVE_POLL_INTERVAL)
+            return;
+        poll_timer_ = 0;
+
+        // a full output revolution without an edge, waiting longer will not find it
+        if (move_settled(odrive_, axis_, target_) || timeout){
+            hall_sensor_disarm();
+
+            #ifdef TESTING
+                SerialUSB.println("Hall sensor search failed");
+            #endif
+
+            odrive_.ReadFeedback(axis_);
+            finishIndex(odrive_.Feedback.position, false);
+        }
+        break;
+    case PHASE_VERIFY_APPROACH:
+    case PHASE_INDEX_APPROACH:
+        if (hall_sensor_captured()){
+            hall_sensor_disarm();
+            float index_position = hall_edge_position(odrive_, axis_);
+
+            if (phase_ == PHASE_INDEX_APPROACH){
+                finishIndex(index_position, true);
+            } else if (abs(index_position - coarse_position_) < HOMING_VERIFY_TOLERANCE){
+                #ifdef TESTING
+                    SerialUSB.println("Stored index verified");
+                #endif
+                homing_result_ = HOMING_FAST_HIT;
+                thor_.SystemIndex.fast_hits++;
+                finishIndex(index_position, true);
+            } else {
+                startCoarseSearch();
+            }
+            return;
+        }
+
+        if (poll_timer_ < MOVE_POLL_INTERVAL)
+            return;
+        poll_timer_ = 0;
+
+        // reached the end of the approach without an edge
+        if (move_settled(odrive_, axis_, target_) || timeout){
+            hall_sensor_disarm();
+
+            if (phase_ == PHASE_INDEX_APPROACH)
+                finishIndex(coarse_position_, true);
+            else
+                startCoarseSearch();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+  * @brief  Waits for the move to the system index, then enables ArtNet control
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::serviceHoming()
+{
+    if (poll_timer_ < MOVE_POLL_INTERVAL)
+        return;
+    poll_timer_ = 0;
+
+    if (move_settled(odrive_, axis_, target_) || phase_timer_ >= STARTUP_TIMEOUT){
+        #ifdef TESTING
+            SerialUSB.print("ODrive encoder count: ");
+            SerialUSB.println(odrive_.Feedback.position);
+            SerialUSB.println();
+        #endif
+
+        thor_.enableMotion(true);
+        setPhase(PHASE_DONE);
+    }
+}
+
+/**
+  * @brief  Reports a failed calibration step
+  * @param  int32_t error - ODrive axis error code
+  * @return void
+  */
+void StartupSequencer::reportAxisError(int32_t error)
+{
+    uint8_t report[6] = {(uint8_t)axis_, (uint8_t)phase_, (uint8_t)(error >> 24), (uint8_t)(error >> 16), (uint8_t)(error >> 8), (uint8_t)error};
+
+    thor_.sendTelemetry(StormBreaker::TELEMETRY_AXIS_ERROR, report, sizeof(report));
+
+    #ifdef TESTING
+        SerialUSB.print("Axis ");
+        SerialUSB.print(axis_);
+        SerialUSB.print(" calibration failed, error 0x");
+        SerialUSB.println(error, HEX);
+    #endif
+}
+
+/**
+  * @brief  Reports how the hall sensor edge was found and the fast path hit rate
+  *     [axis][HomingResult_t][attempts, 16 bit big endian][hits, 16 bit big endian][ms since power on, 32 bit big endian]
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::reportHoming()
+{
+    uint16_t attempts = thor_.SystemIndex.fast_attempts;
+    uint16_t hits = thor_.SystemIndex.fast_hits;
+    uint32_t now = millis();
+    uint8_t report[10] = {(uint8_t)axis_, (uint8_t)homing_result_, (uint8_t)(attempts >> 8), (uint8_t)attempts,
+        (uint8_t)(hits >> 8), (uint8_t)hits, (uint8_t)(now >> 24), (uint8_t)(now >> 16), (uint8_t)(now >> 8), (uint8_t)now};
+
+    thor_.sendTelemetry(StormBreaker::TELEMETRY_HOMING, report, sizeof(report));
+
+    #ifdef TESTING
+        SerialUSB.print("Homing result ");
+        SerialUSB.print(homing_result_);
+        SerialUSB.print(", fast path hits ");
+        SerialUSB.print(hits);
+        SerialUSB.print("/");
+        SerialUSB.println(attempts);
+    #endif
+}
+
+/**
+  * @brief  Marks the current axis as failed and reports why
+  * @param  int32_t error - ODrive axis error code
+  * @return void
+  */
+void StartupSequencer::failAxis(int32_t error)
+{
+    axis_failed_[axis_] = true;
+    reportAxisError(error);
+}
+
+/**
+  * @brief  Finds an axis that failed to calibrate
+  * @param  void
+  * @return int - the first failed axis, -1 if every axis is usable
+  */
+int StartupSequencer::failedAxis()
+{
+    for (int axis = FIRST_AXIS; axis < FIRST_AXIS + NUM_MOTORS; axis++){
+        if (axis_failed_[axis])
+            return axis;
+    }
+    return -1;
+}
+
+/**
+  * @brief  Configures the next axis, or saves the configuration once all are done
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::nextAxis()
+{
+    if (++axis_ < FIRST_AXIS + NUM_MOTORS){
+        setPhase(PHASE_CONFIGURE);
+    } else if (reconfigured_){
+        #ifdef TESTING
+            SerialUSB.println("Saving calibration and rebooting");
+        #endif
+
+        odrive_.SaveConfiguration();
+        setPhase(PHASE_SAVE);
+    } else {
+        startHoming();
+    }
+}
+
+/**
+  * @brief  Starts homing, checking the stored hall sensor edge first if there is one
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::startHoming()
+{
+    // a failed axis cannot home or follow ArtNet, stop here with motion disabled
+    int failed = failedAxis();
+    if (failed >= 0){
+        axis_ = failed;
+        setPhase(PHASE_FAILED);
+        return;
+    }
+
+    axis_ = HOMING_AXIS;
+
+    load_index(odrive_, thor_, axis_);
+
+    odrive_.ConfigureTrajAccelLimit(axis_, TRAJ_ACCEL_LIMIT);
+    odrive_.ConfigureTrajDecelLimit(axis_, TRAJ_DECEL_LIMIT);
+    odrive_.ReadFeedback(axis_);
+    odrive_.SetControlModeTraj(axis_);
+    homing_result_ = HOMING_COARSE;
+
+    if (thor_.SystemIndex.hall_known && digitalRead(HALL_SENSOR) == LOW){
+        // The magnet is on the output, so the edge recurs every CPR * TENSION_SCALING_FACTOR
+        // counts, but encoder positions only carry over between boots within one motor
+        // revolution.  Of the TENSION_SCALING_FACTOR motor revolutions the edge could be
+        // on, guess the nearest: it is right when the fixture powered off within half a
+        // motor revolution of the edge.  The hit rate is kept with the index record and
+        // reported by reportHoming(), a miss costs one backoff and approach.
+        coarse_position_ = thor_.SystemIndex.hall_position + round((odrive_.Feedback.position - thor_.SystemIndex.hall_position) / CPR) * CPR;
+        homing_result_ = HOMING_FAST_MISS;
+        thor_.SystemIndex.fast_attempts++;
+        target_ = coarse_position_ - HOMING_VERIFY_BACKOFF;
+        odrive_.TrapezoidalMove(axis_, target_);
+        setPhase(PHASE_VERIFY_BACKOFF);
+        return;
+    }
+
+    startCoarseSearch();
+}
+
+/**
+  * @brief  Starts the fast hall sensor search, heading towards the last known edge
+  * @param  void
+  * @return void
+  */
+void StartupSequencer::startCoarseSearch()
+{
+    odrive_.ReadFeedback(axis_);
+
+    if (digitalRead(HALL_SENSOR) == HIGH){
+        // already sitting on the magnet
+        coarse_position_ = odrive_.Feedback.position;
+        target_ = coarse_position_ - HOMING_BACKOFF;
+        odrive_.TrapezoidalMove(axis_, target_);
+        setPhase(PHASE_INDEX_BACKOFF);
+        return;
+    }
+
+    float direction = 1.0f;
+    if (thor_.SystemIndex.hall_known && thor_.SystemIndex.hall_position < odrive_.Feedback.position)
+        direction = -1.0f;
+
+    target_ = odrive_.Feedback.position + direction * (CPR * TENSION_SCALING_FACTOR);
+    hall_sensor_arm(odrive_, axis_, target_, HOMING_SEARCH_VELOCITY);
+    setPhase(PHASE_INDEX_SEARCH);
+}
+
+/**
+  * @brief  Sets the system index from the hall sensor edge and starts homing to it
+  * @param  float position - encoder position of the hall sensor edge
+  * @param  bool found - the edge was found and should be stored
+  * @return void
+  */
+void StartupSequencer::finishIndex(float position, bool found)
+{
+    if (found){
+        thor_.SystemIndex.hall_position = position;
+        thor_.SystemIndex.hall_known = true;
+    } else {
+        homing_result_ = HOMING_FAILED;
+    }
+
+    reportHoming();
+
+    startup_index(odrive_, thor_, position, axis_);
+
+    if (found)
+        save_index(thor_, axis_);
+
+    #if defined BODY || defined BOTH_FOR_TESTING
+        target_ = (float)thor_.SystemIndex.pan_index;
+    #else
+        target_ = (float)thor_.SystemIndex.tilt_index;
+    #endif
+
+    homing_system(odrive_, target_, axis_);
+    setPhase(PHASE_HOMING);
+}
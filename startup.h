@@ -0,0 +1,103 @@
+/*
+ * Startup Header
+ *
+ * @file    startup.h
+ * @author  Carbon Video Systems 2019
+ * @description   Non-blocking ODrive startup and homing sequencer.
+ * The sequence is advanced one step at a time from loop() so the
+ * StormBreaker link and the LED ring keep being serviced while the
+ * ODrive calibrates and the system homes.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+#include "ODriveLib.h"
+#include "stormbreaker.h"
+#include "options.h"
+
+/* Functions------------------------------------------------------------*/
+class StartupSequencer {
+public:
+    StartupSequencer(ODriveClass& odrive, StormBreaker& thor) : odrive_(odrive), thor_(thor), phase_(PHASE_DONE) {}
+
+    // reported over telemetry, do not reorder
+    enum Phase_t {
+        PHASE_WAIT_ODRIVE = 0,          // waiting for the ODrive startup sequence
+        PHASE_CONFIGURE = 1,            // syncing the configuration of the next axis
+        PHASE_MOTOR_CALIBRATION = 2,
+        PHASE_ENCODER_INDEX_SEARCH = 3,
+        PHASE_ENCODER_OFFSET_CALIBRATION = 4,
+        PHASE_SAVE = 5,                 // saving the ODrive configuration
+        PHASE_REBOOT = 6,               // waiting for the ODrive to come back up
+        PHASE_VERIFY_BACKOFF = 7,       // moving to the stored hall sensor edge
+        PHASE_VERIFY_APPROACH = 8,
+        PHASE_INDEX_SEARCH = 9,         // coarse hall sensor search
+        PHASE_INDEX_BACKOFF = 10,
+        PHASE_INDEX_APPROACH = 11,
+        PHASE_HOMING = 12,              // moving to the system index
+        PHASE_DONE = 13,
+        PHASE_FAILED = 14               // an axis could not be calibrated, motion stays disabled
+    };
+
+    // reported over telemetry, do not reorder
+    enum HomingResult_t {
+        HOMING_COARSE = 0,              // no stored edge, found by the coarse search
+        HOMING_FAST_HIT = 1,            // the stored edge was where it was expected
+        HOMING_FAST_MISS = 2,           // the stored edge was checked, then the coarse search found it
+        HOMING_FAILED = 3               // no edge found, homed from the current position
+    };
+
+    void begin();
+    void service();
+
+    bool done() { return phase_ == PHASE_DONE; }
+    Phase_t phase() { return phase_; }
+
+private:
+    ODriveClass& odrive_;
+    StormBreaker& thor_;
+
+    Phase_t phase_;
+    int axis_;                      // axis being configured or homed
+    bool calibration_status_[2];
+    bool axis_failed_[2];           // calibration failed or the axis never reached closed loop
+    bool reconfigured_;             // ODrive configuration changed and needs saving
+    bool rebooted_;
+    float target_;                  // position the current move is heading to
+    float coarse_position_;         // hall sensor edge found by the coarse pass
+    HomingResult_t homing_result_;
+
+    elapsedMillis phase_timer_;
+    elapsedMillis poll_timer_;
+    unsigned long poll_interval_;   // ms, calibration polls back off up to STATE_POLL_INTERVAL
+
+    void setPhase(Phase_t phase);
+
+    void serviceWaitODrive();
+    void serviceConfigure();
+    void serviceCalibration();
+    void serviceSave();
+    void serviceIndex();
+    void serviceHoming();
+
+    void reportAxisError(int32_t error);
+    void reportHoming();
+    void nextAxis();
+    void failAxis(int32_t error);
+    int failedAxis();
+    void startHoming();
+    void startCoarseSearch();
+    void finishIndex(float position, bool found);
+};
+
+#endif //STARTUP_H
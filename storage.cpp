@@ -0,0 +1,186 @@
+/*
+ * Storage Source
+ *
+ * @file    storage.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Non-volatile storage in the Teensy EEPROM.
+ * Records are stored with a CRC and rejected on load if it does not match.
+ * Presets rotate through several slots each to spread EEPROM wear.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "storage.h"
+
+/* Constants -----------------------------------------------------------*/
+#define PRESET_ADDRESS(INDEX, SLOT) (PRESET_TABLE_ADDRESS + ((INDEX) * PRESET_SLOTS + (SLOT)) * sizeof(PresetRecord_t))
+
+/* Functions------------------------------------------------------------*/
+static uint16_t presetCrc(const PresetRecord_t& record);
+static int newestPresetSlot(uint8_t index, PresetRecord_t& record);
+
+/**
+  * @brief  CRC-16/CCITT of a block of data
+  * @param  const uint8_t* data - data to be checked
+  * @param  size_t length - number of bytes in data
+  * @return uint16_t - calculated crc
+  */
+uint16_t crc16(const uint8_t* data, size_t length)
+{
+    return crc16(data, length, 0xFFFF);
+}
+
+/**
+  * @brief  Continues a CRC-16/CCITT over another block of data
+  * @param  const uint8_t* data - data to be checked
+  * @param  size_t length - number of bytes in data
+  * @param  uint16_t crc - crc of the preceding data
+  * @return uint16_t - calculated crc
+  */
+uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc)
+{
+    for (size_t i = 0; i < length; i++){
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++){
+            if (crc & 0x8000)
+                crc = (crc << 1) ^ 0x1021;
+            else
+                crc <<= 1;
+        }
+    }
+
+    return crc;
+}
+
+/**
+  * @brief  Loads the stored index record
+  * @param  IndexRecord_t& record - filled with the stored record
+  * @return bool - true if the record is present and intact
+  */
+bool loadIndexRecord(IndexRecord_t& record)
+{
+    EEPROM.get(INDEX_RECORD_ADDRESS, record);
+
+    if (record.version != INDEX_RECORD_VERSION)
+        return false;
+
+    return record.crc == crc16((const uint8_t*)&record, offsetof(IndexRecord_t, crc));
+}
+
+/**
+  * @brief  Stores an index record, only changed bytes are written
+  * @param  IndexRecord_t& record - record to be stored, the crc is filled in
+  * @return void
+  */
+void saveIndexRecord(IndexRecord_t& record)
+{
+    record.version = INDEX_RECORD_VERSION;
+    record.crc = crc16((const uint8_t*)&record, offsetof(IndexRecord_t, crc));
+
+    EEPROM.put(INDEX_RECORD_ADDRESS, record);
+}
+
+/**
+  * @brief  Increments the stored power on counter, call once per boot
+  * @param  void
+  * @return uint32_t - number of this boot, 1 on the first boot or after the record was lost
+  */
+uint32_t countBoot(void)
+{
+    BootRecord_t record;
+
+    EEPROM.get(BOOT_RECORD_ADDRESS, record);
+
+    if (record.crc != crc16((const uint8_t*)&record, offsetof(BootRecord_t, crc)))
+        record.boots = 0;
+
+    record.boots++;
+    record.crc = crc16((const uint8_t*)&record, offsetof(BootRecord_t, crc));
+    EEPROM.put(BOOT_RECORD_ADDRESS, record);
+
+    return record.boots;
+}
+
+/**
+  * @brief  Loads the newest intact copy of a preset
+  * @param  uint8_t index - preset number, 0 to PRESET_COUNT - 1
+  * @param  PresetRecord_t& record - filled with the stored preset
+  * @return bool - true if the preset has been stored
+  */
+bool loadPreset(uint8_t index, PresetRecord_t& record)
+{
+    if (index >= PRESET_COUNT)
+        return false;
+
+    return newestPresetSlot(index, record) >= 0;
+}
+
+/**
+  * @brief  Stores a preset in the slot after its newest copy
+  * @param  uint8_t index - preset number, 0 to PRESET_COUNT - 1
+  * @param  PresetRecord_t& record - preset to be stored, sequence and crc are filled in
+  * @return bool - true if the index is valid
+  */
+bool savePreset(uint8_t index, PresetRecord_t& record)
+{
+    if (index >= PRESET_COUNT)
+        return false;
+
+    PresetRecord_t newest;
+    int slot = newestPresetSlot(index, newest);
+
+    if (slot < 0){
+        record.sequence = 0;
+        slot = 0;
+    }
+    else{
+        record.sequence = newest.sequence + 1;
+        slot = (slot + 1) % PRESET_SLOTS;
+    }
+    record.crc = presetCrc(record);
+
+    EEPROM.put(PRESET_ADDRESS(index, slot), record);
+    return true;
+}
+
+/**
+  * @brief  CRC of a preset, seeded with the layout version
+  * @param  const PresetRecord_t& record - preset to be checked
+  * @return uint16_t - calculated crc
+  */
+static uint16_t presetCrc(const PresetRecord_t& record)
+{
+    return crc16((const uint8_t*)&record, offsetof(PresetRecord_t, crc), 0xFFFF ^ PRESET_RECORD_VERSION);
+}
+
+/**
+  * @brief  Finds the most recently written intact copy of a preset
+  * @param  uint8_t index - preset number
+  * @param  PresetRecord_t& record - filled with the newest copy
+  * @return int - slot of the newest copy, -1 if none is intact
+  */
+static int newestPresetSlot(uint8_t index, PresetRecord_t& record)
+{
+    int newest = -1;
+    PresetRecord_t copy;
+
+    for (int slot = 0; slot < PRESET_SLOTS; slot++){
+        EEPROM.get(PRESET_ADDRESS(index, slot), copy);
+
+        if (copy.crc != presetCrc(copy))
+            continue;
+
+        // sequence numbers wrap, compare the signed difference
+        if (newest < 0 || (int8_t)(copy.sequence - record.sequence) > 0){
+            record = copy;
+            newest = slot;
+        }
+    }
+
+    return newest;
+}
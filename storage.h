@@ -0,0 +1,82 @@
+/*
+ * Storage Header
+ *
+ * @file    storage.h
+ * @author  Carbon Video Systems 2019
+ * @description   Non-volatile storage in the Teensy EEPROM.
+ * Records are stored with a CRC and rejected on load if it does not match.
+ * Presets rotate through several slots each to spread EEPROM wear.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "options.h"
+
+/* Constants -----------------------------------------------------------*/
+// EEPROM layout
+#define INDEX_RECORD_ADDRESS    0
+#define INDEX_RECORD_VERSION    2
+#define BOOT_RECORD_ADDRESS     20  // after the index record
+#define PRESET_TABLE_ADDRESS    32  // after the boot record
+#define PRESET_RECORD_VERSION   1   // seeds the preset crc, bump when the layout changes
+#define PRESET_COUNT            32
+#define PRESET_SLOTS            4   // copies per preset, written in turn
+
+/* Variables  ----------------------------------------------------------*/
+// Last validated homing result for one axis
+struct IndexRecord_t {
+    uint8_t version;
+    uint8_t axis;
+    uint16_t odrive_fingerprint;    // see odrive_fingerprint() in calibration.cpp
+    float hall_position;            // encoder position of the hall sensor edge
+    uint16_t fast_attempts;         // boots that checked the stored edge first
+    uint16_t fast_hits;             // boots where that check found the edge
+    uint16_t crc;
+};
+
+// Power on counter, tells boot profiles apart once they are aggregated
+struct BootRecord_t {
+    uint32_t boots;
+    uint16_t crc;
+};
+
+// One stored cue, laid out without padding
+struct PresetRecord_t {
+    uint16_t pan;
+    uint16_t tilt;
+    uint16_t effect_size;
+    uint16_t effect_rate;
+    uint16_t effect_phase;
+    uint8_t pan_tilt_speed;
+    uint8_t led_red;
+    uint8_t led_green;
+    uint8_t led_blue;
+    uint8_t effect_shape;
+    uint8_t sequence;               // incremented on every store, newest slot wins
+    uint16_t crc;
+};
+
+/* Functions------------------------------------------------------------*/
+uint16_t crc16(const uint8_t* data, size_t length);
+uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc);
+
+bool loadIndexRecord(IndexRecord_t& record);
+void saveIndexRecord(IndexRecord_t& record);
+
+uint32_t countBoot(void);
+
+bool loadPreset(uint8_t index, PresetRecord_t& record);
+bool savePreset(uint8_t index, PresetRecord_t& record);
+
+#endif //STORAGE_H
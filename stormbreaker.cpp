@@ -17,7 +17,12 @@
 /* Includes-------------------------------------------------------------*/
 #include "stormbreaker.h"
 #include "calibration.h"
+#include "curves.h"
+#include "profiler.h"
+#include "trace.h"
+#include "storage.h"
 #include "led.h"
+#include "fan.h"
 
 /* Constants -----------------------------------------------------------*/
 #define MAX_STORMBREAKER_LENGTH 14  // maximum size of a stormbreaker message
@@ -31,12 +36,14 @@
 #define ARTNET_PAN_TILT_SCALING_FACTOR_360   1 //converts ArtNet 0-65,536 to 0-(65,536*factor)count where the max value is 360 degrees
 #define ARTNET_PAN_TILT_SCALING_FACTOR_540   1.5 //converts ArtNet 0-65,536 to 0-(65,536*factor)count where the max value is 540 degrees
 
-#define ARTNET_PAN_TILT_SCALING_FACTOR(VELOCITY_LIMIT) (VELOCITY_LIMIT/256) //converts ArtNet 0-255 to 0-(255*factor)counts/s where the max value is the velocity limit
 #define ARTNET_VELOCITY_SCALING_FACTOR(VELOCITY_LIMIT) (VELOCITY_LIMIT/126) //converts ArtNet 2-127 or 130-255 to 0-(126*factor)counts/s where the max value is the velocity limit
+#define EFFECT_SIZE_SCALING_FACTOR(SIZE) ((float)(SIZE) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_360) //converts effect size to counts, scaled like the 360 degree range
 
 /* Functions------------------------------------------------------------*/
 void StormBreaker::serviceStormBreaker()
 {
+    PROFILE_SECTION(PROFILE_FRAME_PARSE);
+
     Header.type = (StormBreaker::MessageType_t)pi_serial.read();
 
     #ifdef TESTING
@@ -50,6 +57,16 @@ void StormBreaker::serviceStormBreaker()
         break;
     case ARTNETHEAD:
         break;
+    case EFFECT:
+        break;
+    case PRESET:
+        break;
+    case RESPONSE:
+        break;
+    case PREDICTION:
+        break;
+    case FAN:
+        break;
     case IDENTIFY:
         break;
     default:
@@ -67,6 +84,8 @@ void StormBreaker::serviceStormBreaker()
         SerialUSB.println(Header.size);
     #endif
 
+    traceEvent(TRACE_FRAME, Header.type, Header.size);
+
     switch(Header.size){
     case SIZE_IDENT:
         if (Header.type == IDENTIFY)
@@ -81,7 +100,10 @@ void StormBreaker::serviceStormBreaker()
         if (Header.type == ARTNETBODY){
             #if defined BODY || defined BOTH_FOR_TESTING
                 receiveArtNetBody();
-                serviceArtNetBody();
+                if (motion_enabled_){
+                    serviceArtNetBody();
+                    reportFirstFrame();
+                }
             #endif
         }
         else{
@@ -94,9 +116,62 @@ void StormBreaker::serviceStormBreaker()
         if (Header.type == ARTNETHEAD){
             #if defined HEAD || defined BOTH_FOR_TESTING
                 receiveArtNetHead();
-                serviceArtNetHead();
+                if (motion_enabled_){
+                    serviceArtNetHead();
+                    reportFirstFrame();
+                }
+            #endif
+        }
+        else{
+            #ifdef TESTING
+                SerialUSB.println("SIZE ERROR");
+            #endif
+        }
+        break;
+    case SIZE_PREDICTION:
+        if (Header.type == PREDICTION)
+            receivePrediction();
+        else{
+            #ifdef TESTING
+                SerialUSB.println("SIZE ERROR");
+            #endif
+        }
+        break;
+    case SIZE_RESPONSE:     // and SIZE_FAN
+        if (Header.type == RESPONSE){
+            receiveResponse();
+            if (motion_enabled_)
+                serviceResponse();
+        }
+        else if (Header.type == FAN){
+            // fans do not depend on homing
+            receiveFanSetpoint();
+            serviceFanSetpoint();
+        }
+        else{
+            #ifdef TESTING
+                SerialUSB.println("SIZE ERROR");
+            #endif
+        }
+        break;
+    case SIZE_PRESET:
+        if (Header.type == PRESET){
+            receivePreset();
+            if (motion_enabled_)
+                servicePreset();
+        }
+        else{
+            #ifdef TESTING
+                SerialUSB.println("SIZE ERROR");
             #endif
         }
+        break;
+    case SIZE_EFFECT:
+        if (Header.type == EFFECT){
+            receiveEffect();
+            if (motion_enabled_)
+                serviceEffect();
+        }
         else{
             #ifdef TESTING
                 SerialUSB.println("SIZE ERROR");
@@ -150,56 +225,43 @@ void StormBreaker::ArtNetPan()
     if (ArtNetBody.pan_control != prev_pan_control || ArtNetBody.pan != prev_pan){
         switch(ArtNetBody.pan_control){
         case 0: //pan with 540 range
-            if (prev_pan_control != 0 && prev_pan_control != 1 && prev_pan_control != 129){
-                odrive_.SetVelocity(AXIS_BODY, 0);
-                pan_reindex();
-
-                odrive_.SetPosition(AXIS_BODY, odrive_.Feedback.position);
-                odrive_.TrapezoidalMove(AXIS_BODY, (ArtNetBody.pan - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_540 + SystemIndex.pan_index);
-                odrive_.SetControlModeTraj(AXIS_BODY);
-            }
-            //offset by half a rotation (to allow for panning in both directions) and scale for 540 degree range
-            else
-                odrive_.TrapezoidalMove(AXIS_BODY, (ArtNetBody.pan - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_540 + SystemIndex.pan_index);
+            if (prev_pan_control != 0 && prev_pan_control != 1 && prev_pan_control != 129)
+                stopRotation(AXIS_BODY);
+            else if (!stopping_[AXIS_BODY])
+                motion_.moveTo(AXIS_BODY, predictor_.update(AXIS_BODY, panTarget()));
             break;
         case 1: //pan with 360 range
-            if (prev_pan_control != 0 && prev_pan_control != 1 && prev_pan_control != 129){
-                odrive_.SetVelocity(AXIS_BODY, 0);
-                pan_reindex();
-
-                odrive_.SetPosition(AXIS_BODY, odrive_.Feedback.position);
-                odrive_.TrapezoidalMove(AXIS_BODY, (ArtNetBody.pan - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_360 + SystemIndex.pan_index);
-                odrive_.SetControlModeTraj(AXIS_BODY);
-            }
-            //offset by half a rotation (to allow for panning in both directions) and scale for 360 degree range
-            else
-                odrive_.TrapezoidalMove(AXIS_BODY, (ArtNetBody.pan - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_360 + SystemIndex.pan_index);
+            if (prev_pan_control != 0 && prev_pan_control != 1 && prev_pan_control != 129)
+                stopRotation(AXIS_BODY);
+            else if (!stopping_[AXIS_BODY])
+                motion_.moveTo(AXIS_BODY, predictor_.update(AXIS_BODY, panTarget()));
             break;
         case 128: //stop in place
-            odrive_.SetVelocity(AXIS_BODY, 0); //TODO: investigate why motors are "looser" in this state
+            motion_.release(AXIS_BODY);
+            predictor_.reset(AXIS_BODY);
+            stopping_[AXIS_BODY] = false;
+            motion_.setVelocity(AXIS_BODY, 0); //TODO: investigate why motors are "looser" in this state
 
             if (prev_pan_control == 0 || prev_pan_control == 1 || prev_pan_control == 129)
                 odrive_.SetControlModeVel(AXIS_BODY);
             break;
         case 129: //stop and return to index position
-            if (prev_pan_control != 129){
-                odrive_.SetVelocity(AXIS_BODY, 0);
-                odrive_.ReadFeedback(AXIS_BODY);
-                odrive_.SetPosition(AXIS_BODY, odrive_.Feedback.position);
-                odrive_.SetControlModePos(AXIS_BODY);
-                // Reindex
-                pan_reindex();
-                homing_system(odrive_, SystemIndex.pan_index, AXIS_BODY, false);
-            }
+            motion_.release(AXIS_BODY);
+            predictor_.reset(AXIS_BODY);
+            if (prev_pan_control != 129)
+                stopRotation(AXIS_BODY);
             break;
         default: //continuous cw or ccw rotation
+            motion_.release(AXIS_BODY);
+            predictor_.reset(AXIS_BODY);
+            stopping_[AXIS_BODY] = false;
             if((ArtNetBody.pan_control >= 2) && (ArtNetBody.pan_control <= 127)){
                 //scale based on the velocity limit CW
-                odrive_.SetVelocity(AXIS_BODY, (VEL_VEL_LIMIT - ((ArtNetBody.pan_control - 2) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT)))); //note velocity can never be zero
+                motion_.setVelocity(AXIS_BODY, (VEL_VEL_LIMIT - ((ArtNetBody.pan_control - 2) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT)))); //note velocity can never be zero
             } else if((ArtNetBody.pan_control >= 130) && (ArtNetBody.pan_control <= 255)){
                 //scale based on the velocity limit CCW
                 // odrive_.SetVelocity(AXIS_BODY, (-VEL_VEL_LIMIT + ((ArtNetBody.pan_control - 130) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT)))); //note velocity can never be zero
-                odrive_.SetVelocity(AXIS_BODY, ((129 - ArtNetBody.pan_control) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT))); //note velocity can never be zero
+                motion_.setVelocity(AXIS_BODY, ((129 - ArtNetBody.pan_control) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT))); //note velocity can never be zero
             }
 
             if (prev_pan_control == 0 || prev_pan_control == 1 || prev_pan_control == 129)
@@ -209,13 +271,71 @@ void StormBreaker::ArtNetPan()
     prev_pan_control = ArtNetBody.pan_control;
     prev_pan = ArtNetBody.pan;
     }
+    // a predicted target keeps settling for a few frames after the console holds still
+    else if (predictor_.moving(AXIS_BODY) && motion_.tracking(AXIS_BODY)){
+        motion_.moveTo(AXIS_BODY, predictor_.update(AXIS_BODY, panTarget()));
+    }
+}
+
+//offset by half a rotation (to allow for panning in both directions) and scale for the 540 or 360 degree range
+float StormBreaker::panOffset()
+{
+    switch(ArtNetBody.pan_control){
+    case 1:
+        return (ArtNetBody.pan - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_360;
+    case 129: // index position
+        return 0;
+    default:
+        return (ArtNetBody.pan - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_540;
+    }
 }
 
-// PAN reindexing
+float StormBreaker::panTarget()
+{
+    // summed in counts, only the final target is narrowed to the float the ODrive takes
+    return (float)(SystemIndex.pan_index + lroundf(panOffset()));
+}
+
+// At rest, hands pan back to position control, rebased if it has been rotating
+void StormBreaker::finishPanStop()
+{
+    bool rotated = motion_.rotating(AXIS_BODY);
+    motion_.stopVelocity(AXIS_BODY);
+    predictor_.reset(AXIS_BODY);
+
+    if (rotated)
+        rebase(AXIS_BODY, pan_tracker_);
+
+    if (ArtNetBody.pan_control == 129){ //stop and return to index position
+        odrive_.ReadFeedback(AXIS_BODY);
+        odrive_.SetPosition(AXIS_BODY, odrive_.Feedback.position);
+        odrive_.SetControlModePos(AXIS_BODY);
+        // Reindex
+        pan_reindex();
+        homing_system(odrive_, (float)SystemIndex.pan_index, AXIS_BODY);
+        motion_.invalidate(AXIS_BODY);
+        return;
+    }
+
+    pan_reindex();
+    odrive_.SetPosition(AXIS_BODY, odrive_.Feedback.position);
+    motion_.moveTo(AXIS_BODY, panTarget());
+    odrive_.SetControlModeTraj(AXIS_BODY);
+}
+
+// PAN reindexing, picks the system revolution closest to the requested pan
 void StormBreaker::pan_reindex()
 {
     odrive_.ReadFeedback(AXIS_BODY);
-    SystemIndex.pan_index = system_reindex(odrive_.Feedback.position, SystemIndex.start_index);
+    pan_tracker_.update(odrive_.ReadShadowCount(AXIS_BODY));
+    SystemIndex.pan_index = pan_tracker_.nearestIndex(lroundf(panOffset()));
+
+    #ifdef TESTING
+        SerialUSB.print("New pan index ");
+        SerialUSB.print((double)SystemIndex.pan_index, 0);
+        SerialUSB.print(" at revolution ");
+        SerialUSB.println((long)pan_tracker_.revolutions());
+    #endif
 }
 
 //
@@ -327,45 +447,43 @@ void StormBreaker::ArtNetTilt()
     if (ArtNetHead.tilt_control != prev_tilt_control || ArtNetHead.tilt != prev_tilt){
         switch(ArtNetHead.tilt_control){
         case 0: //tilt with 270 range
-            if (prev_tilt_control != 0 && prev_tilt_control != 128){
-                odrive_.SetVelocity(AXIS_HEAD, 0);
-                tilt_reindex();
-
-                odrive_.SetPosition(AXIS_HEAD, odrive_.Feedback.position);
-                odrive_.TrapezoidalMove(AXIS_HEAD, (ArtNetHead.tilt - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_270 + SystemIndex.tilt_index);
-                odrive_.SetControlModeTraj(AXIS_HEAD);
-            }
-            //offset by half a rotation (to allow for tilting in both directions) and scale for 270 degree range
-            else
-                odrive_.TrapezoidalMove(AXIS_HEAD, (ArtNetHead.tilt - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_270 + SystemIndex.tilt_index);
+            if (prev_tilt_control != 0 && prev_tilt_control != 128)
+                stopRotation(AXIS_HEAD);
+            else if (!stopping_[AXIS_HEAD])
+                motion_.moveTo(AXIS_HEAD, predictor_.update(AXIS_HEAD, tiltTarget()));
             break;
         case 127: //stop in place
-            odrive_.SetVelocity(AXIS_HEAD, 0);
+            motion_.release(AXIS_HEAD);
+            predictor_.reset(AXIS_HEAD);
+            stopping_[AXIS_HEAD] = false;
+            motion_.setVelocity(AXIS_HEAD, 0);
             if (prev_tilt_control == 0 || prev_tilt_control == 128)
                 odrive_.SetControlModeVel(AXIS_HEAD);
             break;
         case 128: //stop and return to index position
-            if (prev_tilt_control != 128){
-                odrive_.SetVelocity(AXIS_HEAD, 0);
-                odrive_.ReadFeedback(AXIS_HEAD);
-                odrive_.SetPosition(AXIS_HEAD, odrive_.Feedback.position);
-                odrive_.SetControlModePos(AXIS_HEAD);
-                // Reindex
-                tilt_reindex();
-            }
+            motion_.release(AXIS_HEAD);
+            predictor_.reset(AXIS_HEAD);
+            if (prev_tilt_control != 128)
+                stopRotation(AXIS_HEAD);
             break;
         case 129: //stop in place
-            odrive_.SetVelocity(AXIS_HEAD, 0); //TODO: investigate why motors are "looser" in this state
+            motion_.release(AXIS_HEAD);
+            predictor_.reset(AXIS_HEAD);
+            stopping_[AXIS_HEAD] = false;
+            motion_.setVelocity(AXIS_HEAD, 0); //TODO: investigate why motors are "looser" in this state
             if (prev_tilt_control == 0 || prev_tilt_control == 128)
                 odrive_.SetControlModeVel(AXIS_HEAD);
             break;
         default: //continuous cw or ccw rotation
+            motion_.release(AXIS_HEAD);
+            predictor_.reset(AXIS_HEAD);
+            stopping_[AXIS_HEAD] = false;
             if((ArtNetHead.tilt_control >= 1) && (ArtNetHead.tilt_control <= 126)){
                 //scale based on the velocity limit CW
-                odrive_.SetVelocity(AXIS_HEAD, (VEL_VEL_LIMIT - ((ArtNetHead.tilt_control - 1) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT)))); //note velocity can never be zero
+                motion_.setVelocity(AXIS_HEAD, (VEL_VEL_LIMIT - ((ArtNetHead.tilt_control - 1) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT)))); //note velocity can never be zero
             } else if((ArtNetHead.tilt_control >= 130) && (ArtNetHead.tilt_control <= 255)){
                 //scale based on the velocity limit CCW
-                odrive_.SetVelocity(AXIS_HEAD, ((129 - ArtNetHead.tilt_control) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT))); //note velocity can never be zero
+                motion_.setVelocity(AXIS_HEAD, ((129 - ArtNetHead.tilt_control) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT))); //note velocity can never be zero
                 // odrive_.SetVelocity(AXIS_HEAD, (-VEL_VEL_LIMIT + ((ArtNetHead.tilt_control - 130) * ARTNET_VELOCITY_SCALING_FACTOR(VEL_VEL_LIMIT)))); //note velocity can never be zero
             }
             if (prev_tilt_control == 0 || prev_tilt_control == 128)
@@ -373,52 +491,317 @@ void StormBreaker::ArtNetTilt()
             break;
         }
     }
+    // a predicted target keeps settling for a few frames after the console holds still
+    else if (predictor_.moving(AXIS_HEAD) && motion_.tracking(AXIS_HEAD)){
+        motion_.moveTo(AXIS_HEAD, predictor_.update(AXIS_HEAD, tiltTarget()));
+    }
     prev_tilt_control = ArtNetHead.tilt_control;
     prev_tilt = ArtNetHead.tilt;
 }
 
-// TILT reindexing
+//offset by half a rotation (to allow for tilting in both directions) and scale for 270 degree range
+float StormBreaker::tiltOffset()
+{
+    if (ArtNetHead.tilt_control == 128) // index position
+        return 0;
+
+    return (ArtNetHead.tilt - PAN_TILT_COUNT_MIDPOINT) / PAN_TILT_SCALING_FACTOR * TENSION_SCALING_FACTOR * ARTNET_PAN_TILT_SCALING_FACTOR_270;
+}
+
+float StormBreaker::tiltTarget()
+{
+    // summed in counts, only the final target is narrowed to the float the ODrive takes
+    return (float)(SystemIndex.tilt_index + lroundf(tiltOffset()));
+}
+
+// At rest, hands tilt back to position control, rebased if it has been rotating
+void StormBreaker::finishTiltStop()
+{
+    bool rotated = motion_.rotating(AXIS_HEAD);
+    motion_.stopVelocity(AXIS_HEAD);
+    predictor_.reset(AXIS_HEAD);
+
+    if (rotated)
+        rebase(AXIS_HEAD, tilt_tracker_);
+
+    if (ArtNetHead.tilt_control == 128){ //stop and return to index position
+        odrive_.ReadFeedback(AXIS_HEAD);
+        odrive_.SetPosition(AXIS_HEAD, odrive_.Feedback.position);
+        odrive_.SetControlModePos(AXIS_HEAD);
+        // Reindex
+        tilt_reindex();
+        return;
+    }
+
+    tilt_reindex();
+    odrive_.SetPosition(AXIS_HEAD, odrive_.Feedback.position);
+    motion_.moveTo(AXIS_HEAD, tiltTarget());
+    odrive_.SetControlModeTraj(AXIS_HEAD);
+}
+
+// TILT reindexing, picks the system revolution closest to the requested tilt
 void StormBreaker::tilt_reindex()
 {
     odrive_.ReadFeedback(AXIS_HEAD);
-    SystemIndex.tilt_index = system_reindex(odrive_.Feedback.position, SystemIndex.start_index);
+    tilt_tracker_.update(odrive_.ReadShadowCount(AXIS_HEAD));
+    SystemIndex.tilt_index = tilt_tracker_.nearestIndex(lroundf(tiltOffset()));
+
+    #ifdef TESTING
+        SerialUSB.print("New tilt index ");
+        SerialUSB.print((double)SystemIndex.tilt_index, 0);
+        SerialUSB.print(" at revolution ");
+        SerialUSB.println((long)tilt_tracker_.revolutions());
+    #endif
 }
 
 //
 #endif  // HEAD || BOTH_FOR_TESTING
 
+// Each axis follows the pan_tilt_speed of its own frame, the motion planner skips unchanged limits
 void StormBreaker::ArtNetPanTiltSpeed()
 {
-    static bool startup = true;
-    static uint8_t prev_pan_tilt_speed = 0;
+    #if defined BODY || defined BOTH_FOR_TESTING
+        applyPanTiltSpeed(AXIS_BODY, ArtNetBody.pan_tilt_speed);
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        applyPanTiltSpeed(AXIS_HEAD, ArtNetHead.pan_tilt_speed);
+    #endif
+}
+
+void StormBreaker::applyPanTiltSpeed(int axis, uint8_t pan_tilt_speed)
+{
+    float velocity = TRAJ_VEL_LIMIT * responseFraction(Response.velocity, pan_tilt_speed);
+    float acceleration = TRAJ_ACCEL_LIMIT * responseFraction(Response.acceleration, pan_tilt_speed);
+    float deceleration = TRAJ_ACCEL_LIMIT * responseFraction(Response.deceleration, pan_tilt_speed);
+
+    motion_.setLimits(axis, velocity, acceleration, deceleration); //note limits can never be zero
+    motion_.setRampRate(axis, VEL_RAMP_LIMIT * responseFraction(Response.acceleration, pan_tilt_speed));
+}
+
+void StormBreaker::receiveEffect()
+{
+    while(pi_serial.available() < Header.size){} //TODO: add a timeout (do this for all occurrences)
+
+    Effect.shape = pi_serial.read();
+    Effect.size = (uint16_t)pi_serial.read() << 8;
+    Effect.size |= pi_serial.read();
+    Effect.rate = (uint16_t)pi_serial.read() << 8;
+    Effect.rate |= pi_serial.read();
+    Effect.phase = (uint16_t)pi_serial.read() << 8;
+    Effect.phase |= pi_serial.read();
+    Effect.timebase = (uint32_t)pi_serial.read() << 24;
+    Effect.timebase |= (uint32_t)pi_serial.read() << 16;
+    Effect.timebase |= (uint32_t)pi_serial.read() << 8;
+    Effect.timebase |= (uint32_t)pi_serial.read();
+
+    #ifdef TESTING
+        SerialUSB.print("Effect packet: ");
+        SerialUSB.print(Effect.shape);
+        SerialUSB.print(" ");
+        SerialUSB.print(Effect.size);
+        SerialUSB.print(" ");
+        SerialUSB.print(Effect.rate);
+        SerialUSB.print(" ");
+        SerialUSB.print(Effect.phase);
+        SerialUSB.print(" ");
+        SerialUSB.println(Effect.timebase);
+    #endif
+}
+
+// Effects are added on top of the pan/tilt position
+void StormBreaker::serviceEffect()
+{
+    effects_.start(Effect.shape, EFFECT_SIZE_SCALING_FACTOR(Effect.size), Effect.rate, Effect.phase, Effect.timebase);
+}
+
+void StormBreaker::receivePreset()
+{
+    while(pi_serial.available() < Header.size){} //TODO: add a timeout (do this for all occurrences)
+
+    Preset.command = pi_serial.read();
+    Preset.index = pi_serial.read();
+
+    #ifdef TESTING
+        SerialUSB.print("Preset packet: ");
+        SerialUSB.print(Preset.command);
+        SerialUSB.print(" ");
+        SerialUSB.println(Preset.index);
+    #endif
+}
+
+void StormBreaker::servicePreset()
+{
+    switch(Preset.command){
+    case PRESET_RECALL:
+        recallPreset();
+        break;
+    case PRESET_STORE:
+        storePreset();
+        break;
+    default:
+        #ifdef TESTING
+            SerialUSB.println("PRESET COMMAND ERROR");
+        #endif
+        break;
+    }
+}
+
+// Stores the last received ArtNet and effect settings
+void StormBreaker::storePreset()
+{
+    PresetRecord_t record;
+    memset(&record, 0, sizeof(record));
 
     #if defined BODY || defined BOTH_FOR_TESTING
-        if (startup == true){
-            odrive_.ConfigureTrajAccelLimit(AXIS_BODY, (TRAJ_ACCEL_LIMIT - (ArtNetBody.pan_tilt_speed * ARTNET_PAN_TILT_SCALING_FACTOR(TRAJ_ACCEL_LIMIT)))); //note velocity can never be zero
-            odrive_.ConfigureTrajDecelLimit(AXIS_BODY, (TRAJ_ACCEL_LIMIT - (ArtNetBody.pan_tilt_speed * ARTNET_PAN_TILT_SCALING_FACTOR(TRAJ_ACCEL_LIMIT)))); //note velocity can never be zero
-            odrive_.ConfigureTrajVelLimit(AXIS_BODY, TRAJ_VEL_LIMIT);
-            prev_pan_tilt_speed = ArtNetBody.pan_tilt_speed;
-            startup = false;
-        }
-        if (ArtNetBody.pan_tilt_speed != prev_pan_tilt_speed){
-            odrive_.ConfigureTrajAccelLimit(AXIS_BODY, (TRAJ_ACCEL_LIMIT - (ArtNetBody.pan_tilt_speed * ARTNET_PAN_TILT_SCALING_FACTOR(TRAJ_ACCEL_LIMIT)))); //note velocity can never be zero
-            odrive_.ConfigureTrajDecelLimit(AXIS_BODY, (TRAJ_ACCEL_LIMIT - (ArtNetBody.pan_tilt_speed * ARTNET_PAN_TILT_SCALING_FACTOR(TRAJ_ACCEL_LIMIT)))); //note velocity can never be zero
-            prev_pan_tilt_speed = ArtNetBody.pan_tilt_speed;
+        record.pan = ArtNetBody.pan;
+        record.pan_tilt_speed = ArtNetBody.pan_tilt_speed;
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        record.tilt = ArtNetHead.tilt;
+        record.pan_tilt_speed = ArtNetHead.pan_tilt_speed;
+        record.led_red = ArtNetHead.led_ring_red;
+        record.led_green = ArtNetHead.led_ring_green;
+        record.led_blue = ArtNetHead.led_ring_blue;
+    #endif
+    record.effect_shape = Effect.shape;
+    record.effect_size = Effect.size;
+    record.effect_rate = Effect.rate;
+    record.effect_phase = Effect.phase;
 
-        }
+    if (!savePreset(Preset.index, record)){
+        #ifdef TESTING
+            SerialUSB.println("PRESET INDEX ERROR");
+        #endif
+    }
+}
+
+// Recalled positions go straight to the motion planner, axes outside trajectory control keep their mode
+void StormBreaker::recallPreset()
+{
+    PresetRecord_t record;
+
+    if (!loadPreset(Preset.index, record)){
+        #ifdef TESTING
+            SerialUSB.println("PRESET NOT STORED");
+        #endif
+        return;
+    }
+
+    #if defined BODY || defined BOTH_FOR_TESTING
+        ArtNetBody.pan = record.pan;
+        ArtNetBody.pan_tilt_speed = record.pan_tilt_speed;
     #endif
     #if defined HEAD || defined BOTH_FOR_TESTING
-        if (startup == true){
-            odrive_.ConfigureTrajAccelLimit(AXIS_HEAD, (TRAJ_ACCEL_LIMIT - (ArtNetBody.pan_tilt_speed * ARTNET_PAN_TILT_SCALING_FACTOR(TRAJ_ACCEL_LIMIT)))); //note velocity can never be zero
-            odrive_.ConfigureTrajDecelLimit(AXIS_HEAD, (TRAJ_ACCEL_LIMIT - (ArtNetBody.pan_tilt_speed * ARTNET_PAN_TILT_SCALING_FACTOR(TRAJ_ACCEL_LIMIT)))); //note velocity can never be zero
-            odrive_.ConfigureTrajVelLimit(AXIS_HEAD, TRAJ_VEL_LIMIT); //note velocity can never be zero
-            prev_pan_tilt_speed = ArtNetHead.pan_tilt_speed;
-            startup = false;
-        }
-        if (ArtNetHead.pan_tilt_speed != prev_pan_tilt_speed){
-            odrive_.ConfigureTrajAccelLimit(AXIS_HEAD, (TRAJ_ACCEL_LIMIT - (ArtNetBody.pan_tilt_speed * ARTNET_PAN_TILT_SCALING_FACTOR(TRAJ_ACCEL_LIMIT)))); //note velocity can never be zero
-            odrive_.ConfigureTrajDecelLimit(AXIS_HEAD, (TRAJ_ACCEL_LIMIT - (ArtNetBody.pan_tilt_speed * ARTNET_PAN_TILT_SCALING_FACTOR(TRAJ_ACCEL_LIMIT)))); //note velocity can never be zero
-            prev_pan_tilt_speed = ArtNetHead.pan_tilt_speed;
+        ArtNetHead.tilt = record.tilt;
+        ArtNetHead.pan_tilt_speed = record.pan_tilt_speed;
+        ArtNetHead.led_ring_red = record.led_red;
+        ArtNetHead.led_ring_green = record.led_green;
+        ArtNetHead.led_ring_blue = record.led_blue;
+    #endif
+
+    ArtNetPanTiltSpeed();
+
+    #if defined BODY || defined BOTH_FOR_TESTING
+        if (motion_.tracking(AXIS_BODY))
+            motion_.moveTo(AXIS_BODY, panTarget());
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        if (motion_.tracking(AXIS_HEAD))
+            motion_.moveTo(AXIS_HEAD, tiltTarget());
+        #if defined LED_RING
+            ArtNetLEDRing();
+        #endif
+    #endif
+
+    Effect.shape = record.effect_shape;
+    Effect.size = record.effect_size;
+    Effect.rate = record.effect_rate;
+    Effect.phase = record.effect_phase;
+    effects_.start(Effect.shape, EFFECT_SIZE_SCALING_FACTOR(Effect.size), Effect.rate, Effect.phase);
+}
+
+void StormBreaker::receiveResponse()
+{
+    while(pi_serial.available() < Header.size){} //TODO: add a timeout (do this for all occurrences)
+
+    Response.acceleration = pi_serial.read();
+    Response.deceleration = pi_serial.read();
+    Response.velocity = pi_serial.read();
+
+    #ifdef TESTING
+        SerialUSB.print("Response packet: ");
+        SerialUSB.print(Response.acceleration);
+        SerialUSB.print(" ");
+        SerialUSB.print(Response.deceleration);
+        SerialUSB.print(" ");
+        SerialUSB.println(Response.velocity);
+    #endif
+}
+
+// New curves apply to the current pan_tilt_speed straight away
+void StormBreaker::serviceResponse()
+{
+    if (Response.acceleration >= RESPONSE_COUNT || Response.deceleration >= RESPONSE_COUNT || Response.velocity >= RESPONSE_COUNT){
+        #ifdef TESTING
+            SerialUSB.println("RESPONSE CURVE ERROR");
+        #endif
+        Response.acceleration = RESPONSE_LINEAR;
+        Response.deceleration = RESPONSE_LINEAR;
+        Response.velocity = RESPONSE_FIXED;
+    }
+
+    ArtNetPanTiltSpeed();
+}
+
+// Horizons are the measured console to motor latency of each axis, 0 turns prediction off
+void StormBreaker::receivePrediction()
+{
+    while(pi_serial.available() < Header.size){} //TODO: add a timeout (do this for all occurrences)
+
+    uint16_t body_horizon = (uint16_t)pi_serial.read() << 8;
+    body_horizon |= pi_serial.read();
+    uint16_t head_horizon = (uint16_t)pi_serial.read() << 8;
+    head_horizon |= pi_serial.read();
+
+    #if defined BODY || defined BOTH_FOR_TESTING
+        predictor_.setHorizon(AXIS_BODY, body_horizon);
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        predictor_.setHorizon(AXIS_HEAD, head_horizon);
+    #endif
+
+    #ifdef TESTING
+        SerialUSB.print("Prediction packet: ");
+        SerialUSB.print(body_horizon);
+        SerialUSB.print(" ");
+        SerialUSB.println(head_horizon);
+    #endif
+}
+
+void StormBreaker::receiveFanSetpoint()
+{
+    while(pi_serial.available() < Header.size){} //TODO: add a timeout (do this for all occurrences)
+
+    FanSetpoint.fan = pi_serial.read();
+    FanSetpoint.setpoint = (uint16_t)pi_serial.read() << 8;
+    FanSetpoint.setpoint |= pi_serial.read();
+
+    #ifdef TESTING
+        SerialUSB.print("Fan packet: ");
+        SerialUSB.print(FanSetpoint.fan);
+        SerialUSB.print(" ");
+        SerialUSB.println(FanSetpoint.setpoint / 16.0f);
+    #endif
+}
+
+// Setpoints outside FAN_MIN_SETPOINT to FAN_MAX_SETPOINT are ignored
+void StormBreaker::serviceFanSetpoint()
+{
+    #ifdef FANS
+        if (!setFanSetpoint(FanSetpoint.fan, FanSetpoint.setpoint / 16.0f)){
+            #ifdef TESTING
+                SerialUSB.println("FAN SETPOINT ERROR");
+            #endif
         }
     #endif
 }
@@ -475,3 +858,112 @@ void StormBreaker::serviceIdentify()
     pi_serial.write(IDENTIFIER);
     pi_serial.println();
 }
+
+// ArtNet packets are only acted on once the system is homed, the revolution count starts at the system index
+void StormBreaker::enableMotion(bool enable)
+{
+    #if defined BODY || defined BOTH_FOR_TESTING
+        motion_.invalidate(AXIS_BODY);
+        if (enable)
+            pan_tracker_.reset(odrive_.ReadShadowCount(AXIS_BODY), SystemIndex.pan_index, CPR * TENSION_SCALING_FACTOR);
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        motion_.invalidate(AXIS_HEAD);
+        if (enable)
+            tilt_tracker_.reset(odrive_.ReadShadowCount(AXIS_HEAD), SystemIndex.tilt_index, CPR * TENSION_SCALING_FACTOR);
+    #endif
+
+    motion_enabled_ = enable;
+}
+
+// Keeps the unwrapped count current while an axis rotates outside trajectory control
+void StormBreaker::serviceTracking()
+{
+    if (!motion_enabled_)
+        return;
+
+    #if defined BODY || defined BOTH_FOR_TESTING
+        if (!motion_.tracking(AXIS_BODY) && pan_tracker_.stale())
+            pan_tracker_.update(odrive_.ReadShadowCount(AXIS_BODY));
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        if (!motion_.tracking(AXIS_HEAD) && tilt_tracker_.stale())
+            tilt_tracker_.update(odrive_.ReadShadowCount(AXIS_HEAD));
+    #endif
+}
+
+// Leaving continuous rotation, the velocity ramps down and serviceStops() changes mode once at rest
+void StormBreaker::stopRotation(int axis)
+{
+    // from position control the axis is already at rest
+    if (motion_.rotating(axis))
+        motion_.setVelocity(axis, 0);
+    stopping_[axis] = true;
+}
+
+// Brings the ODrive count of an axis at rest back to its angle within the system revolution,
+// after a long show in one direction a float position no longer holds every count
+void StormBreaker::rebase(int axis, RevolutionTracker& tracker)
+{
+    tracker.update(odrive_.ReadShadowCount(axis));
+    int32_t angle = tracker.angle();
+
+    odrive_.SetLinearCount(axis, angle);
+    tracker.reset(angle, 0, CPR * TENSION_SCALING_FACTOR);
+    motion_.invalidate(axis);
+}
+
+// An axis has ramped to rest and is waiting to return to position control
+bool StormBreaker::stopPending()
+{
+    for (int axis = 0; axis < NUM_MOTORS; axis++){
+        if (stopping_[axis] && motion_.stopped(axis))
+            return true;
+    }
+    return false;
+}
+
+void StormBreaker::serviceStops()
+{
+    #if defined BODY || defined BOTH_FOR_TESTING
+        if (stopping_[AXIS_BODY] && motion_.stopped(AXIS_BODY)){
+            stopping_[AXIS_BODY] = false;
+            finishPanStop();
+        }
+    #endif
+    #if defined HEAD || defined BOTH_FOR_TESTING
+        if (stopping_[AXIS_HEAD] && motion_.stopped(AXIS_HEAD)){
+            stopping_[AXIS_HEAD] = false;
+            finishTiltStop();
+        }
+    #endif
+}
+
+// Telemetry uses the same header as received messages, followed by the telemetry type
+void StormBreaker::sendTelemetry(TelemetryType_t type, const uint8_t* data, uint8_t size)
+{
+    pi_serial.write(TELEMETRY);
+    pi_serial.write(size + 1);
+    pi_serial.write(type);
+    pi_serial.write(data, size);
+}
+
+// Cold start to first accepted frame timing
+void StormBreaker::reportFirstFrame()
+{
+    static bool first_frame = true;
+
+    if (first_frame){
+        uint8_t profile[BOOT_PROFILE_PACKED_SIZE];
+
+        bootProfileMark(BOOT_EVENT_FIRST_FRAME, 0);
+        sendTelemetry(TELEMETRY_BOOT_PROFILE, profile, bootProfilePack(profile, sizeof(profile)));
+
+        #ifdef TESTING
+            SerialUSB.print("First frame accepted ");
+            SerialUSB.print(millis());
+            SerialUSB.println("ms after power on");
+        #endif
+        first_frame = false;
+    }
+}
@@ -21,16 +21,28 @@
 #include <stdint.h>
 
 #include "ODriveLib.h"
+#include "curves.h"
+#include "effects.h"
+#include "motion.h"
+#include "predictor.h"
+#include "tracker.h"
 #include "options.h"
 
 /* Constants -----------------------------------------------------------*/
 #define TENSION_SCALING_FACTOR  5   // scaling factor between one motor revolution and one system revolution
-#define REINDEX_FACTOR          3   // TENSION_SCALING_FACTOR / 2 > rounded up
 
 /* Functions------------------------------------------------------------*/
 class StormBreaker {
 public:
-    StormBreaker(ODriveClass& odrive) : odrive_(odrive){}
+    StormBreaker(ODriveClass& odrive, MotionPlanner& motion, EffectsEngine& effects) : odrive_(odrive), motion_(motion), effects_(effects), motion_enabled_(false)
+    {
+        for (int axis = 0; axis < NUM_MOTORS; axis++)
+            stopping_[axis] = false;
+
+        Response.acceleration = RESPONSE_LINEAR;
+        Response.deceleration = RESPONSE_LINEAR;
+        Response.velocity = RESPONSE_FIXED;
+    }
 
     enum MessageType_t {
         ERROR = -2,
@@ -38,12 +50,33 @@ public:
         OK = 0,
         ARTNETBODY = 1,
         ARTNETHEAD = 2,
-        IDENTIFY = 99
+        EFFECT = 3,
+        PRESET = 4,
+        RESPONSE = 5,
+        PREDICTION = 6,
+        FAN = 7,
+        IDENTIFY = 99,
+        TELEMETRY = 100     // transmit only
+    };
+
+    enum TelemetryType_t {
+        TELEMETRY_STARTUP = 1,
+        TELEMETRY_BOOT_PROFILE = 2,
+        TELEMETRY_AXIS_ERROR = 3,
+        TELEMETRY_FOLLOWING_ERROR = 4,
+        TELEMETRY_PROFILE = 5,
+        TELEMETRY_FANS = 6,
+        TELEMETRY_HOMING = 7
     };
 
     enum MessageSize_t{
         SIZE_IDENT = 0,
+        SIZE_PRESET = 2,
+        SIZE_RESPONSE = 3,
+        SIZE_FAN = 3,
+        SIZE_PREDICTION = 4,
         SIZE_BODY = 5,
+        SIZE_EFFECT = 11,
         // SIZE_HEAD = 11
         SIZE_HEAD = 14
     };
@@ -74,23 +107,72 @@ public:
         uint8_t led_ring_blue;
     } ArtNetHead;
 
+    struct Effect_t {
+        uint8_t shape;
+        uint16_t size;          // amplitude, same units as pan/tilt
+        uint16_t rate;          // mHz
+        uint16_t phase;         // 1/65536 of a cycle
+        uint32_t timebase;      // shared time base in ms
+    } Effect;
+
+    struct Response_t {
+        uint8_t acceleration;   // ResponseCurve_t for each pan_tilt_speed limit
+        uint8_t deceleration;
+        uint8_t velocity;
+    } Response;
+
+    enum PresetCommand_t {
+        PRESET_RECALL = 0,
+        PRESET_STORE = 1
+    };
+
+    struct Preset_t {
+        uint8_t command;        // PresetCommand_t
+        uint8_t index;
+    } Preset;
+
+    struct FanSetpoint_t {
+        uint8_t fan;            // zone number, starting at 1
+        int16_t setpoint;       // 1/16 degrees C, the TMP102 resolution
+    } FanSetpoint;
+
     struct SystemIndex_t {
-        float pan_index;
-        float tilt_index;
+        int64_t pan_index;      // ODrive counts, rebased after continuous rotation, see RevolutionTracker
+        int64_t tilt_index;
         int start_index;
         bool encoder_direction;
+        float hall_position;    // encoder position of the last hall sensor edge
+        bool hall_known;        // hall_position holds a previously found edge
+        uint16_t fast_attempts; // fast path statistics, stored with the index
+        uint16_t fast_hits;
     } SystemIndex;
 
     void serviceStormBreaker();
+    void sendTelemetry(TelemetryType_t type, const uint8_t* data, uint8_t size);
+    void enableMotion(bool enable);
+    void serviceTracking();
+    bool stopPending();
+    void serviceStops();
 
 private:
     ODriveClass& odrive_;
+    MotionPlanner& motion_;
+    EffectsEngine& effects_;
+    bool motion_enabled_;   // ArtNet packets are received but ignored until homed
+    bool stopping_[NUM_MOTORS]; // ramping out of continuous rotation before returning to position control
+
+    RevolutionTracker pan_tracker_;
+    RevolutionTracker tilt_tracker_;
+    Predictor predictor_;
 
     // body functions
     void receiveArtNetBody();
     void serviceArtNetBody();
     void ArtNetPan();
+    float panOffset();
+    float panTarget();
     void pan_reindex();
+    void finishPanStop();
     // head functions
     void receiveArtNetHead();
     void serviceArtNetHead();
@@ -100,11 +182,29 @@ private:
     void ArtNetFocus();
     void ArtNetLEDRing();
     void ArtNetTilt();
+    float tiltOffset();
+    float tiltTarget();
     void tilt_reindex();
+    void finishTiltStop();
     // common functions
+    void receiveEffect();
+    void serviceEffect();
+    void receivePreset();
+    void servicePreset();
+    void storePreset();
+    void recallPreset();
     void ArtNetPanTiltSpeed();
+    void applyPanTiltSpeed(int axis, uint8_t pan_tilt_speed);
+    void stopRotation(int axis);
+    void rebase(int axis, RevolutionTracker& tracker);
+    void receiveResponse();
+    void serviceResponse();
+    void receivePrediction();
+    void receiveFanSetpoint();
+    void serviceFanSetpoint();
     void ArtNetPowerSpecialFunctions();
     void serviceIdentify();
+    void reportFirstFrame();
 };
 
 #endif //STORMBREAKER_H
@@ -0,0 +1,223 @@
+/*
+ * Host Arduino Stub
+ *
+ * @file    Arduino.h
+ * @author  Carbon Video Systems 2019
+ * @description   Just enough of the Teensyduino core to build the
+ * firmware sources with g++ on a host.  Time, pins and interrupts are
+ * simulated so tests can drive them, see host.h.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// standard headers first, the Teensy min/max/abs/round macros below break them
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// the core passes these on the command line, see the Makefile
+#ifndef ARDUINO
+    #define ARDUINO     10810
+#endif
+#ifndef TEENSYDUINO
+    #define TEENSYDUINO 148
+#endif
+#ifndef F_CPU
+    #define F_CPU       180000000
+#endif
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define CHANGE          4
+#define FALLING         2
+#define RISING          3
+#define LED_BUILTIN     13
+#define HOST_PINS       64
+
+#define DEC 10
+#define HEX 16
+
+#define DMAMEM
+#define FASTRUN
+#define SERIAL_8N1  0
+
+#define PI      3.1415926535897932384626433832795
+#define TWO_PI  6.283185307179586476925286766559
+
+// as defined by the Teensyduino core
+#define min(a, b) ({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); (_a < _b) ? _a : _b; })
+#define max(a, b) ({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); (_a > _b) ? _a : _b; })
+#define abs(x) ({ __typeof__(x) _x = (x); (_x > 0) ? _x : -_x; })
+#define constrain(amt, low, high) ({ __typeof__(amt) _amt = (amt); __typeof__(low) _low = (low); __typeof__(high) _high = (high); (_amt < _low) ? _low : ((_amt > _high) ? _high : _amt); })
+#define round(x) ({ __typeof__(x) _x = (x); (_x >= 0) ? (long)(_x + 0.5) : (long)(_x - 0.5); })
+#define degrees(rad) ((rad) * 57.29577951308232)
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/* Time and pins ---------------------------------------------------------*/
+uint32_t micros(void);
+uint32_t millis(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void analogWrite(uint8_t pin, int value);
+void analogWriteResolution(int bits);
+void analogWriteFrequency(uint8_t pin, float frequency);
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterrupt(int interrupt, void (*isr)(void), int mode);
+void detachInterrupt(int interrupt);
+void noInterrupts(void);
+void interrupts(void);
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+long random(long howbig);
+
+class elapsedMillis {
+public:
+    elapsedMillis(uint32_t value = 0) { start_ = millis() - value; }
+    operator uint32_t() const { return millis() - start_; }
+    elapsedMillis& operator=(uint32_t value) { start_ = millis() - value; return *this; }
+private:
+    uint32_t start_;
+};
+
+class elapsedMicros {
+public:
+    elapsedMicros(uint32_t value = 0) { start_ = micros() - value; }
+    operator uint32_t() const { return micros() - start_; }
+    elapsedMicros& operator=(uint32_t value) { start_ = micros() - value; return *this; }
+private:
+    uint32_t start_;
+};
+
+// never fires on its own, tests fire the running timers with hostRunTimers()
+class IntervalTimer;
+void hostTimer(IntervalTimer* timer, bool running);
+
+class IntervalTimer {
+public:
+    IntervalTimer() : function_(NULL) {}
+    ~IntervalTimer() { end(); }
+    bool begin(void (*function)(void), float) { function_ = function; hostTimer(this, true); return true; }
+    void end(void) { function_ = NULL; hostTimer(this, false); }
+    void priority(uint8_t) {}
+    void (*function_)(void);
+};
+
+/* Strings and streams ---------------------------------------------------*/
+class String {
+public:
+    String(const char* text = "") : text_(text) {}
+    String& operator+=(char c) { text_ += c; return *this; }
+    const char* c_str() const { return text_.c_str(); }
+    unsigned int length() const { return text_.length(); }
+    int indexOf(char c) const { size_t i = text_.find(c); return i == std::string::npos ? -1 : (int)i; }
+    String substring(unsigned int from) const { return String(from < text_.length() ? text_.c_str() + from : ""); }
+    float toFloat() const { return strtod(text_.c_str(), NULL); }
+    long toInt() const { return strtol(text_.c_str(), NULL, 10); }
+private:
+    std::string text_;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) { for (size_t i = 0; i < size; i++) write(buffer[i]); return size; }
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long long n, int base = DEC) { return printFormat(base == HEX ? "%llX" : "%lld", n); }
+    size_t print(unsigned long long n, int base = DEC) { return printFormat(base == HEX ? "%llX" : "%llu", n); }
+    size_t print(int n, int base = DEC) { return print((long long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long long)n, base); }
+    size_t print(long n, int base = DEC) { return print((long long)n, base); }
+    size_t print(unsigned long n, int base = DEC) { return print((unsigned long long)n, base); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long long)n, base); }
+    size_t print(double n, int digits = 2) { char text[64]; snprintf(text, sizeof(text), "%.*f", digits, n); return write(text); }
+
+    template<class T> size_t println(T value) { return print(value) + println(); }
+    template<class T> size_t println(T value, int format) { return print(value, format) + println(); }
+    size_t println(void) { return write("\r\n"); }
+    void flush(void) {}
+
+private:
+    template<class T> size_t printFormat(const char* format, T n) { char text[32]; snprintf(text, sizeof(text), format, n); return write(text); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+};
+
+// Serial port, writes go to an attached device which queues the replies
+class HostDevice {
+public:
+    virtual ~HostDevice() {}
+    virtual void receive(uint8_t b) = 0;
+};
+
+class HardwareSerial : public Stream {
+public:
+    HardwareSerial() : capture_(false), device_(NULL) {}
+    void begin(uint32_t, uint32_t = 0) {}
+    operator bool() { return true; }
+    int availableForWrite(void) { return 64; }
+
+    size_t write(uint8_t b) { if (device_) device_->receive(b); else if (capture_) output_.push_back(b); return 1; }
+    using Print::write;
+    int available(void) { return rx_.size(); }
+    int read(void) { if (rx_.empty()) return -1; int b = rx_.front(); rx_.pop_front(); return b; }
+    int peek(void) { return rx_.empty() ? -1 : rx_.front(); }
+
+    void attach(HostDevice* device) { device_ = device; }
+    void inject(const uint8_t* data, size_t size) { rx_.insert(rx_.end(), data, data + size); }
+    void inject(const char* text) { inject((const uint8_t*)text, strlen(text)); }
+
+    std::deque<uint8_t> rx_;        // waiting to be read by the firmware
+    std::string output_;            // written by the firmware while capture_ is set
+    bool capture_;
+
+private:
+    HostDevice* device_;
+};
+
+typedef HardwareSerial usb_serial_class;
+
+extern usb_serial_class Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#include "host.h"
+
+#endif //ARDUINO_H
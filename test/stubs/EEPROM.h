@@ -0,0 +1,52 @@
+/*
+ * Host EEPROM Stub
+ *
+ * @file    EEPROM.h
+ * @author  Carbon Video Systems 2019
+ * @description   RAM backed EEPROM that counts the writes to every byte.
+ * put() only writes bytes that change, as on the Teensy.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <Arduino.h>
+
+#define HOST_EEPROM_SIZE    4096
+
+class EEPROMClass {
+public:
+    EEPROMClass() { erase(); }
+
+    uint8_t read(int address) { return data_[address]; }
+    void write(int address, uint8_t value) { data_[address] = value; writes_[address]++; }
+    void update(int address, uint8_t value) { if (data_[address] != value) write(address, value); }
+    uint16_t length(void) { return HOST_EEPROM_SIZE; }
+
+    template<class T> T& get(int address, T& value) { memcpy(&value, &data_[address], sizeof(T)); return value; }
+    template<class T> const T& put(int address, const T& value)
+    {
+        const uint8_t* bytes = (const uint8_t*)&value;
+        for (size_t i = 0; i < sizeof(T); i++)
+            update(address + i, bytes[i]);
+        return value;
+    }
+
+    // test controls
+    void erase(void) { memset(data_, 0xFF, sizeof(data_)); memset(writes_, 0, sizeof(writes_)); }
+    uint32_t writes(int address) { return writes_[address]; }
+
+private:
+    uint8_t data_[HOST_EEPROM_SIZE];
+    uint32_t writes_[HOST_EEPROM_SIZE];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif //EEPROM_H
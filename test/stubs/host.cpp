@@ -0,0 +1,125 @@
+/*
+ * Host Simulation Source
+ *
+ * @file    host.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Controls for the simulated Teensy used by the host tests.
+ * The clock only moves when a test advances it, pin changes fire the
+ * attached interrupts on the matching edge.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <i2c_t3.h>
+
+/* Variables  ----------------------------------------------------------*/
+usb_serial_class Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+HardwareSerial Serial3;
+EEPROMClass EEPROM;
+i2c_t3 Wire;
+
+std::atomic<uint32_t> host_clock_step(0);
+
+static std::atomic<uint64_t> host_clock(0);
+static int host_digital[HOST_PINS];
+static int host_analog[HOST_PINS];
+static uint32_t host_analog_writes[HOST_PINS];
+static void (*host_isr[HOST_PINS])(void);
+static int host_isr_mode[HOST_PINS];
+static std::vector<IntervalTimer*> host_timers;
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Puts the clock, pins and interrupts back to power on
+  * @param  void
+  * @return void
+  */
+void hostReset(void)
+{
+    host_clock = 0;
+    host_clock_step = 0;
+    for (int pin = 0; pin < HOST_PINS; pin++){
+        host_digital[pin] = LOW;
+        host_analog[pin] = 0;
+        host_analog_writes[pin] = 0;
+        host_isr[pin] = NULL;
+    }
+}
+
+void hostAdvance(uint64_t us) { host_clock += us; }
+void hostSetTime(uint64_t us) { host_clock = us; }
+uint64_t hostTime(void) { return host_clock; }
+
+/**
+  * @brief  Drives an input pin, firing an attached interrupt on a matching edge
+  * @param  uint8_t pin - pin number
+  * @param  int level - HIGH or LOW
+  * @return void
+  */
+void hostSetPin(uint8_t pin, int level)
+{
+    int previous = host_digital[pin];
+    host_digital[pin] = level;
+
+    if (host_isr[pin] == NULL || previous == level)
+        return;
+
+    if (host_isr_mode[pin] == CHANGE || (host_isr_mode[pin] == RISING && level == HIGH) || (host_isr_mode[pin] == FALLING && level == LOW))
+        host_isr[pin]();
+}
+
+/**
+  * @brief  Keeps track of the running IntervalTimers
+  * @param  IntervalTimer* timer - timer started or stopped
+  * @param  bool running - true when started
+  * @return void
+  */
+void hostTimer(IntervalTimer* timer, bool running)
+{
+    host_timers.erase(std::remove(host_timers.begin(), host_timers.end(), timer), host_timers.end());
+    if (running)
+        host_timers.push_back(timer);
+}
+
+/**
+  * @brief  Fires every running IntervalTimer once, as if its period had passed
+  * @param  void
+  * @return void
+  */
+void hostRunTimers(void)
+{
+    for (size_t i = 0; i < host_timers.size(); i++)
+        host_timers[i]->function_();
+}
+
+int hostAnalog(uint8_t pin) { return host_analog[pin]; }
+uint32_t hostAnalogWrites(uint8_t pin) { return host_analog_writes[pin]; }
+
+uint32_t micros(void) { return (uint32_t)host_clock.fetch_add(host_clock_step); }
+uint32_t millis(void) { return (uint32_t)(host_clock.fetch_add(host_clock_step) / 1000); }
+void delay(uint32_t ms) { host_clock += (uint64_t)ms * 1000; }
+void delayMicroseconds(uint32_t us) { host_clock += us; }
+
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t pin) { return host_digital[pin]; }
+void digitalWrite(uint8_t pin, uint8_t value) { host_digital[pin] = value; }
+void analogWrite(uint8_t pin, int value) { host_analog[pin] = value; host_analog_writes[pin]++; }
+void analogWriteResolution(int) {}
+void analogWriteFrequency(uint8_t, float) {}
+
+void attachInterrupt(int interrupt, void (*isr)(void), int mode) { host_isr[interrupt] = isr; host_isr_mode[interrupt] = mode; }
+void detachInterrupt(int interrupt) { host_isr[interrupt] = NULL; }
+void noInterrupts(void) {}
+void interrupts(void) {}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) { return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min; }
+long random(long howbig) { return howbig > 0 ? rand() % howbig : 0; }
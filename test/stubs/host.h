@@ -0,0 +1,35 @@
+/*
+ * Host Simulation Header
+ *
+ * @file    host.h
+ * @author  Carbon Video Systems 2019
+ * @description   Controls for the simulated Teensy used by the host tests.
+ * The clock only moves when a test advances it, pin changes fire the
+ * attached interrupts on the matching edge.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+/* Variables  ----------------------------------------------------------*/
+extern std::atomic<uint32_t> host_clock_step;  // us added by every micros()/millis() call, keeps busy waits finite
+
+/* Functions------------------------------------------------------------*/
+void hostReset(void);
+void hostAdvance(uint64_t us);
+void hostSetTime(uint64_t us);
+uint64_t hostTime(void);
+
+void hostSetPin(uint8_t pin, int level);
+int hostAnalog(uint8_t pin);
+uint32_t hostAnalogWrites(uint8_t pin);
+
+void hostRunTimers(void);
+
+#endif //HOST_H
@@ -0,0 +1,162 @@
+/*
+ * Host i2c_t3 Stub
+ *
+ * @file    i2c_t3.h
+ * @author  Carbon Video Systems 2019
+ * @description   I2C bus with simulated TMP102 style register devices.
+ * Background transfers finish after a set number of done() polls, and
+ * tests can hold the bus busy, drop devices or fail the next transfer.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef I2C_T3_H
+#define I2C_T3_H
+
+#include <Arduino.h>
+
+enum i2c_stop { I2C_NOSTOP, I2C_STOP };
+
+#define I2C_ADDRESSES       128
+#define I2C_NACK_ADDRESS    2       // endTransmission() / getError() codes
+#define I2C_NACK_DATA       3
+#define I2C_OTHER           4
+
+// Register device, a pointer write selects which 16 bit register is read back
+struct HostI2CDevice {
+    bool present;
+    uint8_t pointer;
+    uint16_t registers[4];
+    uint32_t reads;
+};
+
+class i2c_t3 {
+public:
+    i2c_t3() { reset(); }
+
+    void begin(void) {}
+    void setClock(uint32_t) {}
+
+    void beginTransmission(uint8_t address) { tx_address_ = address; tx_.clear(); }
+    size_t write(uint8_t b) { tx_.push_back(b); return 1; }
+    uint8_t endTransmission(i2c_stop = I2C_STOP) { error_ = transmit(); return error_; }
+    uint8_t requestFrom(uint8_t address, size_t length, i2c_stop = I2C_STOP) { error_ = request(address, length); return rx_.size(); }
+
+    void sendTransmission(i2c_stop = I2C_STOP) { start(TRANSFER_WRITE, tx_address_, 0); }
+    void sendRequest(uint8_t address, size_t length, i2c_stop = I2C_STOP) { start(TRANSFER_READ, address, length); }
+
+    // Background transfers complete after latency polls, never while stalled
+    uint8_t done(void)
+    {
+        if (transfer_ == TRANSFER_NONE)
+            return 1;
+        if (stall || --remaining_ > 0)
+            return 0;
+
+        error_ = (transfer_ == TRANSFER_WRITE) ? transmit() : request(request_address_, request_length_);
+        transfer_ = TRANSFER_NONE;
+        return 1;
+    }
+
+    uint8_t getError(void) { return error_; }
+    int available(void) { return rx_.size() - rx_index_; }
+    int read(void) { return rx_index_ < rx_.size() ? rx_[rx_index_++] : -1; }
+
+    // test controls
+    void reset(void)
+    {
+        memset(devices, 0, sizeof(devices));
+        latency = 1;
+        stall = false;
+        fail_next = 0;
+        short_next = false;
+        transfers = 0;
+        transfer_ = TRANSFER_NONE;
+        error_ = 0;
+        tx_.clear();
+        rx_.clear();
+        rx_index_ = 0;
+    }
+
+    HostI2CDevice devices[I2C_ADDRESSES];
+    uint32_t latency;       // done() polls a background transfer takes
+    bool stall;             // holds a background transfer busy
+    uint8_t fail_next;      // error code given to the next transfer
+    bool short_next;        // next read returns one byte fewer
+    uint32_t transfers;
+
+private:
+    enum Transfer_t { TRANSFER_NONE, TRANSFER_WRITE, TRANSFER_READ };
+
+    void start(Transfer_t transfer, uint8_t address, size_t length)
+    {
+        transfer_ = transfer;
+        request_address_ = address;
+        request_length_ = length;
+        remaining_ = latency;
+    }
+
+    uint8_t injected(void) { uint8_t error = fail_next; fail_next = 0; return error; }
+
+    uint8_t transmit(void)
+    {
+        transfers++;
+        uint8_t error = injected();
+        if (error)
+            return error;
+
+        HostI2CDevice& device = devices[tx_address_ & 0x7F];
+        if (!device.present)
+            return I2C_NACK_ADDRESS;
+
+        if (tx_.size() > 0)
+            device.pointer = tx_[0] & 0x03;
+        if (tx_.size() > 2)
+            device.registers[device.pointer] = (tx_[1] << 8) | tx_[2];
+        else if (tx_.size() > 1)
+            device.registers[device.pointer] = (device.registers[device.pointer] & 0x00FF) | (tx_[1] << 8);
+        return 0;
+    }
+
+    uint8_t request(uint8_t address, size_t length)
+    {
+        transfers++;
+        rx_.clear();
+        rx_index_ = 0;
+        uint8_t error = injected();
+        if (error)
+            return error;
+
+        HostI2CDevice& device = devices[address & 0x7F];
+        if (!device.present)
+            return I2C_NACK_ADDRESS;
+
+        device.reads++;
+        uint16_t value = device.registers[device.pointer];
+        if (short_next){
+            length--;
+            short_next = false;
+        }
+        for (size_t i = 0; i < length; i++)
+            rx_.push_back(i % 2 == 0 ? value >> 8 : value & 0xFF);
+        return 0;
+    }
+
+    Transfer_t transfer_;
+    uint32_t remaining_;
+    uint8_t error_;
+    uint8_t tx_address_;
+    uint8_t request_address_;
+    size_t request_length_;
+    std::vector<uint8_t> tx_;
+    std::vector<uint8_t> rx_;
+    size_t rx_index_;
+};
+
+extern i2c_t3 Wire;
+
+#endif //I2C_T3_H
@@ -0,0 +1,57 @@
+/*
+ * Host Test Header
+ *
+ * @file    test.h
+ * @author  Carbon Video Systems 2019
+ * @description   Minimal checks for the host tests, a failed check prints
+ * where it was and the test program exits non-zero at the end.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+/* Variables  ----------------------------------------------------------*/
+static int test_checks = 0;
+static int test_failures = 0;
+
+/* Macros --------------------------------------------------------------*/
+#define CHECK(condition) do { \
+    test_checks++; \
+    if (!(condition)){ \
+        test_failures++; \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+    } \
+} while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) do { \
+    test_checks++; \
+    double _actual = (actual), _expected = (expected); \
+    if (!(fabs(_actual - _expected) <= (tolerance))){ \
+        test_failures++; \
+        fprintf(stderr, "%s:%d: %s = %g, expected %g +/- %g\n", __FILE__, __LINE__, #actual, _actual, _expected, (double)(tolerance)); \
+    } \
+} while (0)
+
+#define RUN(test) do { \
+    hostReset(); \
+    printf("  %s\n", #test); \
+    test(); \
+} while (0)
+
+/* Functions------------------------------------------------------------*/
+static inline int testSummary(const char* name)
+{
+    printf("%s: %d checks, %d failed\n", name, test_checks, test_failures);
+    return test_failures ? 1 : 0;
+}
+
+#endif //TEST_H
@@ -0,0 +1,146 @@
+/*
+ * Response Curve Tests
+ *
+ * @file    test_curves.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   The compile time pan_tilt_speed tables against the
+ * formulas they are built from, evaluated with the C library at run time,
+ * the original linear mapping, and the shape of each curve.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "curves.h"
+
+/* Constants -----------------------------------------------------------*/
+#define SPEEDS              256
+#define SLOWEST             (1.0 / SPEEDS)
+#define TRAJ_ACCEL_LIMIT    25000.0f    // calibration.h
+
+/* Functions------------------------------------------------------------*/
+static double position(int speed) { return (double)speed / (SPEEDS - 1); }
+
+// largest difference between a table and a reference over every speed
+static double worstError(uint8_t curve, double (*reference)(int))
+{
+    double worst = 0.0;
+    for (int speed = 0; speed < SPEEDS; speed++)
+        worst = max(worst, fabs(responseFraction(curve, speed) - reference(speed)));
+    return worst;
+}
+
+static double exponential(int speed) { return exp(log(SLOWEST) * position(speed)); }
+
+static double sCurve(int speed)
+{
+    double x = position(speed);
+    return 1.0 - (1.0 - SLOWEST) * x * x * (3.0 - 2.0 * x);
+}
+
+static bool decreasing(uint8_t curve)
+{
+    for (int speed = 1; speed < SPEEDS; speed++){
+        if (responseFraction(curve, speed) > responseFraction(curve, speed - 1))
+            return false;
+    }
+    return true;
+}
+
+static void testFixed(void)
+{
+    bool full = true;
+    for (int speed = 0; speed < SPEEDS; speed++)
+        full &= responseFraction(RESPONSE_FIXED, speed) == 1.0f;
+    CHECK(full);
+}
+
+static void testLinear(void)
+{
+    // the limits ArtNetPanTiltSpeed() set before the curves, to the bit
+    bool original = true;
+    for (int speed = 0; speed < SPEEDS; speed++)
+        original &= TRAJ_ACCEL_LIMIT * responseFraction(RESPONSE_LINEAR, speed) == TRAJ_ACCEL_LIMIT - speed * TRAJ_ACCEL_LIMIT / 256;
+    CHECK(original);
+    CHECK(decreasing(RESPONSE_LINEAR));
+}
+
+static void testExponential(void)
+{
+    // the constexpr series against the C library
+    double error = worstError(RESPONSE_EXPONENTIAL, exponential);
+    printf("    exponential within %.2g of exp()\n", error);
+    CHECK(error < 1e-6);
+
+    // every step slows by the same ratio, 1/256 over the full range
+    double ratio = pow(SLOWEST, 1.0 / (SPEEDS - 1));
+    bool even = true;
+    for (int speed = 1; speed < SPEEDS; speed++)
+        even &= fabs(responseFraction(RESPONSE_EXPONENTIAL, speed) / responseFraction(RESPONSE_EXPONENTIAL, speed - 1) - ratio) < 1e-5;
+    CHECK(even);
+    CHECK(decreasing(RESPONSE_EXPONENTIAL));
+
+    // finer at the slow end than linear
+    CHECK(responseFraction(RESPONSE_EXPONENTIAL, 128) < responseFraction(RESPONSE_LINEAR, 128));
+}
+
+static void testS(void)
+{
+    double error = worstError(RESPONSE_S, sCurve);
+    CHECK(error < 1e-6);
+    CHECK(decreasing(RESPONSE_S));
+
+    // flat at both ends, steepest in the middle
+    float first_step = responseFraction(RESPONSE_S, 0) - responseFraction(RESPONSE_S, 1);
+    float last_step = responseFraction(RESPONSE_S, 254) - responseFraction(RESPONSE_S, 255);
+    float middle_step = responseFraction(RESPONSE_S, 127) - responseFraction(RESPONSE_S, 128);
+    CHECK(first_step < middle_step / 50 && last_step < middle_step / 50);
+    CHECK_NEAR(first_step, last_step, 1e-6);
+
+    // and symmetric about the middle
+    bool symmetric = true;
+    for (int speed = 0; speed < SPEEDS; speed++)
+        symmetric &= fabs(responseFraction(RESPONSE_S, speed) + responseFraction(RESPONSE_S, 255 - speed) - (1.0 + SLOWEST)) < 1e-6;
+    CHECK(symmetric);
+}
+
+static void testRange(void)
+{
+    // every curve keeps the limits above zero and at most the full limit
+    bool bounded = true;
+    for (uint8_t curve = 0; curve < RESPONSE_COUNT; curve++){
+        for (int speed = 0; speed < SPEEDS; speed++){
+            float fraction = responseFraction(curve, speed);
+            bounded &= fraction >= (float)SLOWEST * 0.9999f && fraction <= 1.0f;
+        }
+    }
+    CHECK(bounded);
+
+    CHECK(responseFraction(RESPONSE_LINEAR, 255) == (float)SLOWEST);
+    CHECK(responseFraction(RESPONSE_S, 255) == (float)SLOWEST);
+    CHECK(responseFraction(RESPONSE_S, 0) == 1.0f);
+    CHECK(responseFraction(RESPONSE_EXPONENTIAL, 0) == 1.0f);
+
+    // unknown curves from the Pi fall back to linear
+    bool linear = true;
+    for (int curve = RESPONSE_COUNT; curve < 256; curve++){
+        for (int speed = 0; speed < SPEEDS; speed += 15)
+            linear &= responseFraction(curve, speed) == responseFraction(RESPONSE_LINEAR, speed);
+    }
+    CHECK(linear);
+}
+
+int main(void)
+{
+    RUN(testFixed);
+    RUN(testLinear);
+    RUN(testExponential);
+    RUN(testS);
+    RUN(testRange);
+    return testSummary("curves");
+}
@@ -0,0 +1,247 @@
+/*
+ * Fan Control Tests
+ *
+ * @file    test_fan.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Runs the fan PI loop against a lumped thermal model of
+ * each zone through the simulated TMP102s, and measures how long the zones
+ * take to settle, how far they overshoot and how often the PWM is written.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "fan.h"
+
+/* Constants -----------------------------------------------------------*/
+#define STEP_US             (FAN_SERVICE_INTERVAL * 1000UL)
+#define CONVERSION_US       250000      // TMP102 at 4 Hz
+#define AMBIENT             25.0        // degrees C
+#define HEAT_CAPACITY       200.0       // J/K of a zone
+#define CONDUCTANCE_STILL   0.2         // W/K to ambient with the fan stopped
+#define CONDUCTANCE_FAN     6.0         // W/K added at full fan speed
+#define FAN_SPIN_UP         1.0         // s time constant of the fan speed
+#define SENSOR_NOISE        0.1         // degrees C standard deviation
+#define SENSOR_SPREAD       0.5         // second sensor of a zone reads this much cooler
+#define SETTLE_BAND         0.5         // degrees C around the setpoint
+
+static const int fan_pins[FAN_ZONES] = {3, 4};
+static const uint8_t zone_sensors[FAN_ZONES][2] = {{0x48, 0x4A}, {0x49, 0x4B}};
+
+/* Variables  ----------------------------------------------------------*/
+struct Plant_t {
+    double temperature;
+    double heat;            // W
+    double fan_speed;       // fraction of full speed
+};
+
+static Plant_t plants[FAN_ZONES];
+static uint32_t noise_state = 12345;
+
+// Measured over a phase of the simulation
+struct Phase_t {
+    double settle_s;        // from the start of the phase until the zone stays in band, -1 if never
+    double overshoot;       // highest temperature above the setpoint once it was reached
+    uint32_t writes;        // PWM writes in the second half of the phase
+    uint32_t starts;        // times the fan started from stopped
+    double minutes;         // length of the second half
+};
+
+/* Functions------------------------------------------------------------*/
+static double noise(void)
+{
+    // Box-Muller from a small LCG, repeatable between runs
+    noise_state = noise_state * 1664525 + 1013904223;
+    double u1 = ((noise_state >> 8) + 1.0) / 16777217.0;
+    noise_state = noise_state * 1664525 + 1013904223;
+    double u2 = (noise_state >> 8) / 16777216.0;
+    return sqrt(-2.0 * log(u1)) * cos(2 * PI * u2);
+}
+
+static uint16_t temperatureRegister(double temperature)
+{
+    int counts = (int)lround(temperature * 16);
+    return (uint16_t)((counts & 0xFFF) << 4);
+}
+
+static void convert(void)
+{
+    for (int zone = 0; zone < FAN_ZONES; zone++){
+        for (int i = 0; i < 2; i++){
+            double reading = plants[zone].temperature - i * SENSOR_SPREAD + SENSOR_NOISE * noise();
+            Wire.devices[zone_sensors[zone][i]].registers[0] = temperatureRegister(reading);
+        }
+    }
+}
+
+static void stepPlants(double dt)
+{
+    for (int zone = 0; zone < FAN_ZONES; zone++){
+        Plant_t& plant = plants[zone];
+        double duty = hostAnalog(fan_pins[zone]) / 1024.0;
+
+        plant.fan_speed += (duty - plant.fan_speed) * dt / FAN_SPIN_UP;
+        double conductance = CONDUCTANCE_STILL + CONDUCTANCE_FAN * plant.fan_speed;
+        plant.temperature += (plant.heat - conductance * (plant.temperature - AMBIENT)) * dt / HEAT_CAPACITY;
+    }
+}
+
+/**
+  * @brief  Runs the fans and the thermal model for a while
+  * @param  double seconds - length of the phase
+  * @param  const float* setpoints - setpoint of each zone during the phase
+  * @param  Phase_t* result - measurements of each zone
+  * @return void
+  */
+static void simulate(double seconds, const float* setpoints, Phase_t* result)
+{
+    uint64_t steps = (uint64_t)(seconds * 1e6 / STEP_US);
+    uint32_t writes_before[FAN_ZONES];
+    int last_pwm[FAN_ZONES];
+    uint64_t last_out[FAN_ZONES];
+    bool reached[FAN_ZONES];
+
+    for (int zone = 0; zone < FAN_ZONES; zone++){
+        result[zone] = Phase_t();
+        result[zone].minutes = seconds / 2 / 60;
+        writes_before[zone] = hostAnalogWrites(fan_pins[zone]);
+        last_pwm[zone] = hostAnalog(fan_pins[zone]);
+        last_out[zone] = 0;
+        reached[zone] = false;
+    }
+
+    for (uint64_t step = 0; step < steps; step++){
+        if (hostTime() % CONVERSION_US < STEP_US)
+            convert();
+
+        hostAdvance(STEP_US);
+        runFans();
+        stepPlants(STEP_US / 1e6);
+
+        for (int zone = 0; zone < FAN_ZONES; zone++){
+            double error = plants[zone].temperature - setpoints[zone];
+            int pwm = hostAnalog(fan_pins[zone]);
+
+            if (step == steps / 2)
+                writes_before[zone] = hostAnalogWrites(fan_pins[zone]);
+            if (pwm != 0 && last_pwm[zone] == 0)
+                result[zone].starts++;
+            last_pwm[zone] = pwm;
+
+            reached[zone] = reached[zone] || fabs(error) <= SETTLE_BAND;
+            if (reached[zone])
+                result[zone].overshoot = max(result[zone].overshoot, error);
+            if (fabs(error) > SETTLE_BAND)
+                last_out[zone] = step + 1;
+        }
+    }
+
+    for (int zone = 0; zone < FAN_ZONES; zone++){
+        result[zone].settle_s = last_out[zone] < steps ? last_out[zone] * (STEP_US / 1e6) : -1.0;
+        result[zone].writes = hostAnalogWrites(fan_pins[zone]) - writes_before[zone];
+    }
+}
+
+static void report(const char* phase, const Phase_t* result)
+{
+    for (int zone = 0; zone < FAN_ZONES; zone++){
+        printf("    %-12s zone %d: settled %6.1f s, overshoot %4.2f C, %5.2f PWM writes/min, %u starts, at %5.2f C PWM %d\n",
+            phase, zone + 1, result[zone].settle_s, result[zone].overshoot, result[zone].writes / result[zone].minutes,
+            result[zone].starts, plants[zone].temperature, hostAnalog(fan_pins[zone]));
+    }
+}
+
+static void testRegulation(void)
+{
+    Wire.reset();
+    for (int zone = 0; zone < FAN_ZONES; zone++){
+        for (int i = 0; i < 2; i++)
+            Wire.devices[zone_sensors[zone][i]].present = true;
+        plants[zone].temperature = AMBIENT;
+        plants[zone].fan_speed = 0.0;
+    }
+    convert();
+    initFans();
+
+    // both zones have sensors, so the fans wait for the setpoint
+    CHECK(hostAnalog(fan_pins[0]) == 0 && hostAnalog(fan_pins[1]) == 0);
+
+    float setpoints[FAN_ZONES] = {FAN_DEFAULT_SETPOINT, FAN_DEFAULT_SETPOINT};
+    Phase_t result[FAN_ZONES];
+
+    // warm up from ambient, zone 2 runs cooler
+    plants[0].heat = 20.0;
+    plants[1].heat = 12.0;
+    simulate(3600, setpoints, result);
+    report("warm up", result);
+    for (int zone = 0; zone < FAN_ZONES; zone++){
+        CHECK(result[zone].settle_s > 0 && result[zone].settle_s < 600);
+        CHECK(result[zone].overshoot < 2.0);
+        CHECK(result[zone].starts == 1);
+        CHECK(result[zone].writes / result[zone].minutes < 4.0);
+    }
+
+    float hottest = 0.0f;
+    CHECK(hottestTemperature(hottest));
+    CHECK_NEAR(hottest, FAN_DEFAULT_SETPOINT, SETTLE_BAND);
+
+    // the show starts, zone 1 takes 40% more heat
+    plants[0].heat = 28.0;
+    simulate(3600, setpoints, result);
+    report("load step", result);
+    CHECK(result[0].settle_s > 0 && result[0].settle_s < 300);
+    CHECK(result[0].overshoot < 2.0);
+    CHECK(result[0].starts == 0);
+    CHECK(result[0].writes / result[0].minutes < 4.0);
+
+    // the load comes off and zone 1 is given a lower setpoint
+    plants[0].heat = 20.0;
+    CHECK(setFanSetpoint(1, 30.0f));
+    setpoints[0] = 30.0f;
+    simulate(3600, setpoints, result);
+    report("setpoint", result);
+    CHECK(result[0].settle_s > 0 && result[0].settle_s < 300);
+    CHECK(result[0].overshoot < 1.0);
+    CHECK(result[0].writes / result[0].minutes < 4.0);
+    CHECK_NEAR(plants[0].temperature, 30.0, SETTLE_BAND);
+    CHECK_NEAR(plants[1].temperature, FAN_DEFAULT_SETPOINT, SETTLE_BAND);
+
+    // rejected setpoints change nothing
+    CHECK(!setFanSetpoint(0, 30.0f));
+    CHECK(!setFanSetpoint(FAN_ZONES + 1, 30.0f));
+    CHECK(!setFanSetpoint(1, FAN_MIN_SETPOINT - 1.0f));
+    CHECK(!setFanSetpoint(1, FAN_MAX_SETPOINT + 1.0f));
+    simulate(600, setpoints, result);
+    CHECK_NEAR(plants[0].temperature, 30.0, SETTLE_BAND);
+}
+
+static void testLightLoad(void)
+{
+    // too little heat to hold the setpoint at the minimum duty, so the fan
+    // cycles through the hysteresis band, no more than once every 5 minutes
+    float setpoints[FAN_ZONES] = {30.0f, FAN_DEFAULT_SETPOINT};
+    Phase_t result[FAN_ZONES];
+
+    plants[0].heat = 2.0;
+    simulate(2 * 3600, setpoints, result);
+    report("light load", result);
+
+    double cycles_per_hour = result[0].starts / 2.0;
+    CHECK(cycles_per_hour > 0 && cycles_per_hour < 12.0);
+    CHECK(result[0].overshoot < 2.0);
+}
+
+int main(void)
+{
+    hostReset();
+    printf("  testRegulation\n");
+    testRegulation();
+    printf("  testLightLoad\n");
+    testLightLoad();
+    return testSummary("fan");
+}
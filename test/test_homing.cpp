@@ -0,0 +1,430 @@
+/*
+ * Homing Tests
+ *
+ * @file    test_homing.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Powers the fixture on at random output positions and homes
+ * it with StartupSequencer against a simulated ODrive and hall sensor, then
+ * does the same with the single speed search it replaced, and compares the
+ * time to home and where the edge was found.
+ *
+ * The simulated ODrive answers the ASCII protocol on Serial1 and follows
+ * trapezoidal moves at the configured limits.  The magnet is on the output,
+ * so it passes the sensor once every CPR * TENSION_SCALING_FACTOR counts, and
+ * the encoder position only carries over between boots within one motor
+ * revolution.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "startup.h"
+#include "calibration.h"
+
+#include <stdarg.h>
+#include <map>
+#include <string>
+
+/* Constants -----------------------------------------------------------*/
+#define STEP_US             100         // simulation step, the hall edge is seen within one step
+#define OUTPUT_REVOLUTION   (CPR * TENSION_SCALING_FACTOR)
+#define MAGNET_POSITION     13000.0     // output counts where the sensor starts to see the magnet
+#define MAGNET_WIDTH        400.0       // output counts the sensor stays high for
+#define BOOTS               100         // power ons per scenario
+#define EDGE_TOLERANCE      2.0         // counts, found edge vs the edge approached from below
+#define BOOT_LIMIT          60.0        // s, a boot taking longer has hung
+
+/* Classes -------------------------------------------------------------*/
+// ODrive in closed loop on the end of Serial1, one axis is simulated
+class ODriveSim : public HostDevice {
+public:
+    ODriveSim() : length_(0) {}
+
+    /**
+      * @brief  Powers the ODrive on with the output at a position, its
+      *     saved configuration is kept
+      * @param  double output - output position in counts
+      * @return void
+      */
+    void powerOn(double output)
+    {
+        output = fmod(output, OUTPUT_REVOLUTION);
+        if (output < 0)
+            output += OUTPUT_REVOLUTION;
+
+        // after the encoder index search only the angle within the motor revolution is known
+        position_ = fmod(output, CPR);
+        offset_ = output - position_;
+        velocity_ = 0.0;
+        target_ = position_;
+        time_ = hostTime();
+        length_ = 0;
+        Serial1.rx_.clear();
+        hostSetPin(HALL_SENSOR, hall() ? HIGH : LOW);
+    }
+
+    /**
+      * @brief  Runs the trajectory up to the current time
+      * @param  void
+      * @return void
+      */
+    void advance(void)
+    {
+        while (time_ + STEP_US <= hostTime()){
+            time_ += STEP_US;
+            step(STEP_US * 1e-6);
+            hostSetPin(HALL_SENSOR, hall() ? HIGH : LOW);
+        }
+    }
+
+    // encoder position of the magnet edge met moving forwards, nearest to position
+    double edge(double position)
+    {
+        double edge = MAGNET_POSITION - offset_;
+        return edge + round((position - edge) / OUTPUT_REVOLUTION) * OUTPUT_REVOLUTION;
+    }
+
+    double position() { return position_; }
+    double output() { return position_ + offset_; }
+
+    void receive(uint8_t b)
+    {
+        if (b != '\n'){
+            if (length_ < sizeof(line_) - 1)
+                line_[length_++] = b;
+            return;
+        }
+        line_[length_] = '\0';
+        length_ = 0;
+        advance();
+        command(line_);
+    }
+
+private:
+    std::map<std::string, float> properties_;      // survives power cycles, as if saved
+    char line_[128];
+    size_t length_;
+
+    uint64_t time_;
+    double position_;       // encoder counts
+    double offset_;         // output position of encoder zero
+    double velocity_;
+    double target_;
+
+    bool hall()
+    {
+        double angle = fmod(output() - MAGNET_POSITION, OUTPUT_REVOLUTION);
+        if (angle < 0)
+            angle += OUTPUT_REVOLUTION;
+        return angle < MAGNET_WIDTH;
+    }
+
+    float property(const char* name)
+    {
+        std::map<std::string, float>::iterator found = properties_.find(name);
+        return found == properties_.end() ? 0.0f : found->second;
+    }
+
+    // online trapezoid, brakes at decel_limit to stop on the target
+    void step(double dt)
+    {
+        double velocity_limit = property("axis0.trap_traj.config.vel_limit");
+        double accel = property("axis0.trap_traj.config.accel_limit");
+        double decel = property("axis0.trap_traj.config.decel_limit");
+        double distance = target_ - position_;
+
+        if (fabs(distance) < 0.01 && fabs(velocity_) < decel * dt){
+            position_ = target_;
+            velocity_ = 0.0;
+            return;
+        }
+
+        double direction = distance > 0 ? 1.0 : -1.0;
+        double speed = velocity_ * direction;   // towards the target
+        double braking = speed > 0 ? speed * speed / (2 * decel) : 0.0;
+
+        if (speed < 0)
+            speed += decel * dt;
+        else if (braking >= fabs(distance))
+            speed = max(speed - decel * dt, 0.0);
+        else if (speed > velocity_limit)
+            speed = max(speed - decel * dt, velocity_limit);
+        else
+            speed = min(speed + accel * dt, velocity_limit);
+
+        // never step past the target
+        speed = min(speed, fabs(distance) / dt);
+        velocity_ = speed * direction;
+        position_ += velocity_ * dt;
+    }
+
+    void reply(const char* format, ...)
+    {
+        char text[64];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        Serial1.inject(text);
+    }
+
+    void command(const char* line)
+    {
+        int axis;
+        float value;
+        char name[96];
+
+        if (sscanf(line, "f %d", &axis) == 1){
+            reply("%.4f %.4f\n", position_, velocity_);
+        } else if (sscanf(line, "t %d %f", &axis, &value) == 2){
+            target_ = value;
+        } else if (sscanf(line, "w %95s %f", name, &value) == 2){
+            properties_[name] = value;
+        } else if (sscanf(line, "r %95s", name) == 1){
+            const char* field = strchr(name, '.');
+            field = field ? field + 1 : name;
+
+            if (strcmp(field, "current_state") == 0)
+                reply("%d\n", ODriveClass::AXIS_STATE_CLOSED_LOOP_CONTROL);
+            else if (strcmp(field, "motor.is_calibrated") == 0 || strcmp(field, "encoder.is_ready") == 0 || strcmp(field, "encoder.index_found") == 0)
+                reply("1\n");
+            else if (strcmp(field, "encoder.shadow_count") == 0)
+                reply("%ld\n", lround(position_));
+            else if (strcmp(name, "serial_number") == 0)
+                reply("205F3A8B5748\n");
+            else
+                reply("%g\n", property(name));
+        }
+    }
+};
+
+/* Variables  ----------------------------------------------------------*/
+static ODriveSim sim;
+static uint32_t random_state = 20190501;
+
+struct Boot_t {
+    double search_s;        // from the start of homing until the edge is found
+    double home_s;          // until the axis is at the system index
+    double edge_error;      // counts between the stored edge and the edge met moving forwards
+    double home;            // output position the axis homed to
+    bool fast_hit;
+};
+
+/* Functions------------------------------------------------------------*/
+static double uniform(double low, double high)
+{
+    random_state = random_state * 1664525 + 1013904223;
+    return low + (high - low) * (random_state >> 8) / 16777216.0;
+}
+
+static void step(void)
+{
+    hostAdvance(STEP_US);
+    sim.advance();
+}
+
+/**
+  * @brief  Boots the firmware startup sequence and homes the axis
+  * @param  double output - output position at power on
+  * @return Boot_t - measurements of the boot
+  */
+static Boot_t bootSequencer(double output)
+{
+    hostReset();
+    sim.powerOn(output);
+
+    ODriveClass odrive(Serial1);
+    MotionPlanner motion(odrive);
+    EffectsEngine effects(motion);
+    StormBreaker thor(odrive, motion, effects);
+    StartupSequencer startup(odrive, thor);
+
+    Boot_t boot = {-1.0, -1.0, 0.0, 0.0, false};
+    double start = -1.0;
+    uint16_t hits = 0;
+
+    startup.begin();
+    while (!startup.done() && startup.phase() != StartupSequencer::PHASE_FAILED && hostTime() < BOOT_LIMIT * 1e6){
+        startup.service();
+        step();
+
+        double now = hostTime() * 1e-6;
+        if (start < 0 && startup.phase() >= StartupSequencer::PHASE_VERIFY_BACKOFF){
+            start = now;
+            hits = thor.SystemIndex.fast_hits;
+        }
+        if (boot.search_s < 0 && startup.phase() == StartupSequencer::PHASE_HOMING){
+            boot.search_s = now - start;
+            boot.edge_error = thor.SystemIndex.hall_position - sim.edge(thor.SystemIndex.hall_position);
+            boot.fast_hit = thor.SystemIndex.fast_hits != hits;
+        }
+    }
+
+    if (startup.done()){
+        boot.home_s = hostTime() * 1e-6 - start;
+        boot.home = sim.output();
+    }
+    return boot;
+}
+
+/**
+  * @brief  Homes the axis the way it was done before the two phase search,
+  *     one pass forwards at HOMING_VELOCITY over up to a full output revolution
+  * @param  double output - output position at power on
+  * @return Boot_t - measurements of the boot
+  */
+static Boot_t bootSingleSpeed(double output)
+{
+    hostReset();
+    sim.powerOn(output);
+
+    ODriveClass odrive(Serial1);
+    MotionPlanner motion(odrive);
+    EffectsEngine effects(motion);
+    StormBreaker thor(odrive, motion, effects);
+
+    Boot_t boot = {-1.0, -1.0, 0.0, 0.0, false};
+    float edge;
+
+    odrive.ConfigureTrajAccelLimit(AXIS_BODY, TRAJ_ACCEL_LIMIT);
+    odrive.ConfigureTrajDecelLimit(AXIS_BODY, TRAJ_DECEL_LIMIT);
+    odrive.ReadFeedback(AXIS_BODY);
+    odrive.SetControlModeTraj(AXIS_BODY);
+
+    if (digitalRead(HALL_SENSOR) == HIGH){
+        edge = odrive.Feedback.position;
+    } else {
+        hall_sensor_arm(odrive, AXIS_BODY, odrive.Feedback.position + OUTPUT_REVOLUTION, HOMING_VELOCITY);
+        while (!hall_sensor_captured() && hostTime() < STARTUP_TIMEOUT * 1000ULL)
+            step();
+        if (!hall_sensor_disarm())
+            return boot;
+        edge = hall_edge_position(odrive, AXIS_BODY);
+    }
+    boot.search_s = hostTime() * 1e-6;
+    boot.edge_error = edge - sim.edge(edge);
+
+    startup_index(odrive, thor, edge, AXIS_BODY);
+    homing_system(odrive, (float)thor.SystemIndex.pan_index, AXIS_BODY);
+    elapsedMillis poll;
+    while (hostTime() < BOOT_LIMIT * 1e6){
+        step();
+        if (poll < 10)
+            continue;
+        poll = 0;
+        if (move_settled(odrive, AXIS_BODY, (float)thor.SystemIndex.pan_index)){
+            boot.home_s = hostTime() * 1e-6;
+            boot.home = sim.output();
+            break;
+        }
+    }
+    return boot;
+}
+
+static double percentile(std::vector<double> values, double fraction)
+{
+    std::sort(values.begin(), values.end());
+    return values[(size_t)(fraction * (values.size() - 1) + 0.5)];
+}
+
+/**
+  * @brief  Boots a series of power on positions and summarises them
+  * @param  const char* name - row name
+  * @param  Boot_t (*boot)(double) - the homing to run
+  * @param  const std::vector<double>& positions - output position at each power on
+  * @param  std::vector<double>& times - time to home of each boot
+  * @param  double& home - where the axis homed to, from the magnet
+  * @return int - fast path hits
+  */
+static int series(const char* name, Boot_t (*boot)(double), const std::vector<double>& positions, std::vector<double>& times, double& home)
+{
+    std::vector<double> search;
+    double worst_edge = 0.0;
+    double lowest = OUTPUT_REVOLUTION, highest = 0.0;
+    int hits = 0, failed = 0;
+
+    times.clear();
+    for (size_t i = 0; i < positions.size(); i++){
+        Boot_t result = boot(positions[i]);
+        if (result.home_s < 0){
+            failed++;
+            continue;
+        }
+        search.push_back(result.search_s);
+        times.push_back(result.home_s);
+        worst_edge = max(worst_edge, fabs(result.edge_error));
+        hits += result.fast_hit;
+
+        double from_magnet = fmod(result.home - MAGNET_POSITION + 2 * OUTPUT_REVOLUTION, OUTPUT_REVOLUTION);
+        lowest = min(lowest, from_magnet);
+        highest = max(highest, from_magnet);
+    }
+
+    // the same edge every boot, and the same home
+    CHECK(failed == 0);
+    CHECK(worst_edge < EDGE_TOLERANCE);
+    CHECK(highest - lowest <= HOMING_POSITION_TOLERANCE);
+    home = lowest;
+    if (times.empty())
+        return hits;
+
+    printf("    %-22s search %5.2f/%5.2f/%5.2f s, home %5.2f/%5.2f/%5.2f s, edge within %4.2f, home +%.0f..%.0f, %3d fast hits\n", name,
+        percentile(search, 0.5), percentile(search, 0.9), percentile(search, 1.0),
+        percentile(times, 0.5), percentile(times, 0.9), percentile(times, 1.0), worst_edge, lowest, highest, hits);
+    return hits;
+}
+
+static void testRandomPowerOn(void)
+{
+    // the show left the output anywhere
+    std::vector<double> positions;
+    for (int i = 0; i < BOOTS; i++)
+        positions.push_back(uniform(0, OUTPUT_REVOLUTION));
+
+    std::vector<double> single, sequencer;
+    double single_home, sequencer_home;
+    printf("    %-22s        p50 / p90 / max\n", "");
+    series("single speed", bootSingleSpeed, positions, single, single_home);
+    series("two phase", bootSequencer, positions, sequencer, sequencer_home);
+    CHECK_NEAR(sequencer_home, single_home, HOMING_POSITION_TOLERANCE);
+
+    // the coarse pass runs at four times the speed, and a missed guess costs little
+    CHECK(percentile(sequencer, 0.5) < percentile(single, 0.5));
+    CHECK(percentile(sequencer, 0.9) < percentile(single, 0.9));
+    CHECK(percentile(sequencer, 1.0) < percentile(single, 1.0));
+}
+
+static void testParkedPowerOn(void)
+{
+    // parked within half a motor revolution of the edge either side, the stored edge is checked first
+    std::vector<double> positions;
+    for (int i = 0; i < BOOTS; i++){
+        double offset = uniform(-0.45 * CPR, 0.45 * CPR);
+        if (offset >= 0 && offset < MAGNET_WIDTH)
+            offset += MAGNET_WIDTH;
+        positions.push_back(MAGNET_POSITION + offset);
+    }
+
+    std::vector<double> single, sequencer;
+    double single_home, sequencer_home;
+    series("single speed, parked", bootSingleSpeed, positions, single, single_home);
+    int hits = series("two phase, parked", bootSequencer, positions, sequencer, sequencer_home);
+    CHECK_NEAR(sequencer_home, single_home, HOMING_POSITION_TOLERANCE);
+
+    CHECK(hits == BOOTS);
+    CHECK(percentile(sequencer, 0.9) < percentile(single, 0.9));
+    CHECK(percentile(sequencer, 1.0) < percentile(single, 0.5));
+}
+
+int main(void)
+{
+    Serial1.attach(&sim);
+    RUN(testRandomPowerOn);
+    RUN(testParkedPowerOn);
+    return testSummary("homing");
+}
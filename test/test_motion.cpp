@@ -0,0 +1,321 @@
+/*
+ * Motion Planner Tests
+ *
+ * @file    test_motion.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   trapezoidDuration() against a numerically integrated
+ * profile, and the arrival skew of coordinated pan and tilt moves, built
+ * for BOTH_FOR_TESTING so both axes are on the one ODrive.  Arrival times
+ * come from plannedState(), the planner's mirror of the ODrive trajectory.
+ * Velocity ramps come down to rest without a step larger than the ramp.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "motion.h"
+
+#include <new>
+
+/* Constants -----------------------------------------------------------*/
+#define TICK_US             (1000000 / CONTROL_RATE)
+#define INTEGRATION_STEP    1e-5        // s
+#define MOVES               2000        // random coordinated moves per case
+#define MAX_MOVE            200000.0    // counts
+
+#if !defined BOTH_FOR_TESTING
+    #error "test_motion is built with -DBOTH_FOR_TESTING"
+#endif
+
+struct Limits_t {
+    float velocity;
+    float acceleration;
+    float deceleration;
+};
+
+static const Limits_t trajectory_limits = {40960.0f, 25000.0f, 20000.0f};   // calibration.h TRAJ_*
+
+/* Variables  ----------------------------------------------------------*/
+static ODriveClass odrive(Serial1);
+static uint32_t random_state = 20190704;
+
+/* Functions------------------------------------------------------------*/
+static double uniform(double low, double high)
+{
+    random_state = random_state * 1664525 + 1013904223;
+    return low + (high - low) * (random_state >> 8) / 16777216.0;
+}
+
+// rest to rest, braking as late as the deceleration allows
+static double integrate(double distance, double velocity, double acceleration, double deceleration)
+{
+    double position = 0.0, speed = 0.0, time = 0.0;
+    distance = fabs(distance);
+
+    while (true){
+        if (speed * speed / (2 * deceleration) >= distance - position){
+            if (speed <= deceleration * INTEGRATION_STEP)
+                return time + speed / deceleration;
+            speed -= deceleration * INTEGRATION_STEP;
+        } else {
+            speed = min(speed + acceleration * INTEGRATION_STEP, velocity);
+        }
+        position += speed * INTEGRATION_STEP;
+        time += INTEGRATION_STEP;
+    }
+}
+
+static void tick(MotionPlanner& motion)
+{
+    hostAdvance(TICK_US);
+    hostRunTimers();
+    motion.service();
+}
+
+// s from the move starting until plannedState() reports it complete
+static double arrival(MotionPlanner& motion, int axis, uint32_t start)
+{
+    uint32_t low = 0, high = 60000000;
+    float position, velocity;
+    bool complete = false;
+
+    while (high - low > 1){
+        uint32_t middle = low + (high - low) / 2;
+        if (motion.plannedState(axis, start + middle, position, velocity, complete) && complete)
+            high = middle;
+        else
+            low = middle;
+    }
+    return high * 1e-6;
+}
+
+// the firmware's planner is a global, so each test gets a fresh zeroed one,
+// clearing it before the constructor would be optimised away
+static MotionPlanner& startPlanner(void)
+{
+    static MotionPlanner* planner = NULL;
+    if (planner){
+        planner->~MotionPlanner();
+        free(planner);
+    }
+    planner = new (calloc(1, sizeof(MotionPlanner))) MotionPlanner(odrive);
+    MotionPlanner& motion = *planner;
+
+    hostReset();
+    Serial1.capture_ = true;
+    Serial1.output_.clear();
+
+    // trajectories start from background feedback until one has been planned
+    for (int axis = 0; axis < NUM_MOTORS; axis++){
+        odrive.AsyncFeedback[axis].position = 0.0f;
+        odrive.AsyncFeedback[axis].velocity = 0.0f;
+        odrive.AsyncFeedback[axis].timestamp = micros();
+    }
+
+    motion.begin();
+    motion.setLimits(AXIS_BODY, trajectory_limits.velocity, trajectory_limits.acceleration, trajectory_limits.deceleration);
+    motion.setLimits(AXIS_HEAD, trajectory_limits.velocity, trajectory_limits.acceleration, trajectory_limits.deceleration);
+    motion.moveTo(AXIS_BODY, 0.0f);
+    motion.moveTo(AXIS_HEAD, 0.0f);
+    tick(motion);
+    return motion;
+}
+
+static void testTrapezoidDuration(void)
+{
+    // reaches the velocity limit: 1.6384 s up, 2.048 s down, 24502.5 counts at 40960
+    CHECK_NEAR(MotionPlanner::trapezoidDuration(100000.0f, 40960.0f, 25000.0f, 20000.0f), 1.6384 + 2.048 + 24502.5 / 40960.0, 1e-4);
+
+    // triangular: 8192 counts peaks at 13493 counts/s
+    double peak = sqrt(2.0 * 8192 * 25000 * 20000 / 45000);
+    CHECK_NEAR(MotionPlanner::trapezoidDuration(8192.0f, 40960.0f, 25000.0f, 20000.0f), peak / 25000 + peak / 20000, 1e-4);
+
+    CHECK(MotionPlanner::trapezoidDuration(0.0f, 40960.0f, 25000.0f, 20000.0f) == 0.0f);
+    CHECK(MotionPlanner::trapezoidDuration(-5000.0f, 40960.0f, 25000.0f, 20000.0f) == MotionPlanner::trapezoidDuration(5000.0f, 40960.0f, 25000.0f, 20000.0f));
+    CHECK(MotionPlanner::trapezoidDuration(5000.0f, 0.0f, 25000.0f, 20000.0f) == 0.0f);
+    CHECK(MotionPlanner::trapezoidDuration(5000.0f, 40960.0f, 0.0f, 20000.0f) == 0.0f);
+    CHECK(MotionPlanner::trapezoidDuration(5000.0f, 40960.0f, 25000.0f, -1.0f) == 0.0f);
+
+    // continuous where the triangle becomes a trapezoid
+    float ramp = 40960.0f * 40960.0f / 50000.0f + 40960.0f * 40960.0f / 40000.0f;
+    CHECK_NEAR(MotionPlanner::trapezoidDuration(ramp * 0.9999f, 40960.0f, 25000.0f, 20000.0f),
+        MotionPlanner::trapezoidDuration(ramp * 1.0001f, 40960.0f, 25000.0f, 20000.0f), 1e-3);
+
+    // against the integrated profile over both shapes
+    double worst = 0.0;
+    for (int i = 0; i < 200; i++){
+        double distance = uniform(1.0, MAX_MOVE);
+        double velocity = uniform(1000.0, 80000.0);
+        double acceleration = uniform(2000.0, 100000.0);
+        double deceleration = uniform(2000.0, 100000.0);
+        double error = MotionPlanner::trapezoidDuration(distance, velocity, acceleration, deceleration) - integrate(distance, velocity, acceleration, deceleration);
+        worst = max(worst, fabs(error));
+    }
+    printf("    integrated profile within %.3f ms\n", worst * 1e3);
+    CHECK(worst < 1e-3);
+}
+
+static void testPlannerAgrees(void)
+{
+    // the planner mirror and trapezoidDuration() describe the same move
+    MotionPlanner& motion = startPlanner();
+
+    double worst = 0.0;
+    float position = 0.0f;
+    for (int i = 0; i < 100; i++){
+        float distance = uniform(-MAX_MOVE, MAX_MOVE);
+        position += distance;
+        motion.moveTo(AXIS_BODY, position);
+        motion.moveTo(AXIS_HEAD, 0.0f);
+        tick(motion);
+        uint32_t start = micros();
+
+        double expected = MotionPlanner::trapezoidDuration(distance, trajectory_limits.velocity, trajectory_limits.acceleration, trajectory_limits.deceleration);
+        worst = max(worst, fabs(arrival(motion, AXIS_BODY, start) - expected));
+        hostAdvance((uint64_t)(expected * 1e6) + TICK_US);
+    }
+    CHECK(worst < 1e-4);
+}
+
+/**
+  * @brief  Random coordinated moves, each from rest, reporting the arrival skew
+  * @param  const char* name - row name
+  * @param  const Limits_t& pan - pan limits
+  * @param  const Limits_t& tilt - tilt limits
+  * @return double - worst skew in seconds
+  */
+static double skew(const char* name, const Limits_t& pan, const Limits_t& tilt)
+{
+    MotionPlanner& motion = startPlanner();
+    motion.setLimits(AXIS_BODY, pan.velocity, pan.acceleration, pan.deceleration);
+    motion.setLimits(AXIS_HEAD, tilt.velocity, tilt.acceleration, tilt.deceleration);
+
+    std::vector<double> skews;
+    float target[2] = {0.0f, 0.0f};
+    bool arrived = true;
+
+    for (int i = 0; i < MOVES; i++){
+        // often one axis barely moves
+        double scale = uniform(0, 1) < 0.2 ? 0.01 : 1.0;
+        target[AXIS_BODY] += uniform(-MAX_MOVE, MAX_MOVE);
+        target[AXIS_HEAD] += uniform(-MAX_MOVE, MAX_MOVE) * scale;
+
+        motion.moveTo(AXIS_BODY, target[AXIS_BODY]);
+        motion.moveTo(AXIS_HEAD, target[AXIS_HEAD]);
+        tick(motion);
+        uint32_t start = micros();
+
+        double pan_time = arrival(motion, AXIS_BODY, start);
+        double tilt_time = arrival(motion, AXIS_HEAD, start);
+        skews.push_back(fabs(pan_time - tilt_time));
+
+        // and both end where they were sent
+        float position, velocity;
+        bool complete;
+        for (int axis = 0; axis < NUM_MOTORS; axis++){
+            motion.plannedState(axis, start + 60000000, position, velocity, complete);
+            arrived &= fabsf(position - target[axis]) < 0.5f && velocity == 0.0f;
+        }
+        hostAdvance((uint64_t)(max(pan_time, tilt_time) * 1e6) + TICK_US);
+    }
+
+    CHECK(arrived);
+
+    std::sort(skews.begin(), skews.end());
+    printf("    %-24s skew p50 %6.3f ms, p99 %6.3f ms, max %6.3f ms\n", name,
+        skews[skews.size() / 2] * 1e3, skews[skews.size() * 99 / 100] * 1e3, skews.back() * 1e3);
+    return skews.back();
+}
+
+static void testCoordinatedSkew(void)
+{
+    // scaled limits give the follower the lead's profile shape, so they arrive together
+    CHECK(skew("same limits", trajectory_limits, trajectory_limits) < 1e-3);
+
+    // tilt slower, the scaled limits stay inside its own
+    Limits_t tilt = {20480.0f, 12500.0f, 10000.0f};
+    CHECK(skew("tilt at half the limits", trajectory_limits, tilt) < 1e-3);
+
+    // tilt quick to accelerate but slow to cruise, pan gives up speed to keep the shape
+    Limits_t mixed = {20480.0f, 50000.0f, 40000.0f};
+    CHECK(skew("tilt mixed limits", trajectory_limits, mixed) < 1e-3);
+}
+
+static void testCoordinationWindow(void)
+{
+    MotionPlanner& motion = startPlanner();
+
+    // pan alone waits for tilt, then both go on the same tick
+    Serial1.output_.clear();
+    motion.moveTo(AXIS_BODY, 10000.0f);
+    hostAdvance(COORDINATION_WINDOW * 1000 / 2);
+    hostRunTimers();
+    motion.service();
+    CHECK(Serial1.output_.find("t ") == std::string::npos);
+
+    motion.moveTo(AXIS_HEAD, 5000.0f);
+    tick(motion);
+    CHECK(Serial1.output_.find("t 1 10000") != std::string::npos);
+    CHECK(Serial1.output_.find("t 0 5000") != std::string::npos);
+
+    // no tilt target comes, pan goes alone once the window has passed
+    hostAdvance(10000000);
+    Serial1.output_.clear();
+    motion.moveTo(AXIS_BODY, 20000.0f);
+    tick(motion);
+    CHECK(Serial1.output_.find("t 1 20000") != std::string::npos);
+    CHECK(Serial1.output_.find("t 0") == std::string::npos);
+}
+
+static void testVelocityStop(void)
+{
+    MotionPlanner& motion = startPlanner();
+    const float velocity = 40960.0f, ramp = 25000.0f;     // calibration.h VEL_VEL_LIMIT, VEL_RAMP_LIMIT
+
+    // up to full speed, then asked to stop
+    motion.setRampRate(AXIS_BODY, ramp);
+    motion.setVelocity(AXIS_BODY, velocity);
+    CHECK(!motion.stopped(AXIS_BODY));
+    for (int i = 0; i < 2 * CONTROL_RATE; i++)
+        tick(motion);
+    motion.setVelocity(AXIS_BODY, 0.0f);
+    CHECK(!motion.stopped(AXIS_BODY));
+
+    // not at rest until the ramp has sent zero, no step larger than the ramp allows
+    int ticks = 0;
+    bool sent_each_tick = true;
+    float last = velocity, largest = 0.0f;
+    while (!motion.stopped(AXIS_BODY) && ticks < 10 * CONTROL_RATE){
+        Serial1.output_.clear();
+        tick(motion);
+        ticks++;
+
+        float sent = 0.0f;
+        sent_each_tick &= sscanf(Serial1.output_.c_str(), "v 1 %f", &sent) == 1;
+        largest = max(largest, last - sent);
+        last = sent;
+    }
+    printf("    stopped from %.0f counts/s in %d ticks\n", velocity, ticks);
+    CHECK(sent_each_tick);
+    CHECK(last == 0.0f);
+    CHECK_NEAR(ticks, velocity / ramp * CONTROL_RATE, 1);
+    CHECK(largest <= ramp / CONTROL_RATE * 1.001f);
+
+    // an axis that was never under velocity control is at rest
+    CHECK(motion.stopped(AXIS_HEAD));
+}
+
+int main(void)
+{
+    RUN(testTrapezoidDuration);
+    RUN(testPlannerAgrees);
+    RUN(testCoordinatedSkew);
+    RUN(testCoordinationWindow);
+    RUN(testVelocityStop);
+    return testSummary("motion");
+}
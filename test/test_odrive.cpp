@@ -0,0 +1,191 @@
+/*
+ * ODrive Feedback Tests
+ *
+ * @file    test_odrive.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Background feedback requests that expire: a reply that
+ * still arrives afterwards, whole or split across the expiry, must not be
+ * taken as the answer to the next blocking read or feedback request, and a
+ * reply that never arrives must not hold either of them up.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "ODriveLib.h"
+
+#include <deque>
+#include <string>
+
+/* Constants -----------------------------------------------------------*/
+#define EXPIRY_US           1100000     // past kFeedbackTimeout
+#define BUSY_STEP_US        10          // clock advance per micros() call in busy waits
+
+/* Variables  ----------------------------------------------------------*/
+// Answers each command line the firmware sends with the next queued reply, in order
+class Responder : public HostDevice {
+public:
+    void receive(uint8_t b)
+    {
+        if (b != '\n')
+            return;
+        if (replies.empty())
+            return;
+        Serial1.inject(replies.front().c_str());
+        replies.pop_front();
+    }
+
+    std::deque<std::string> replies;   // "" sends nothing for a command that has no reply
+};
+
+static Responder odrive_device;
+
+/* Functions------------------------------------------------------------*/
+// queues the answer to the next command
+static void reply(const char* line) { odrive_device.replies.push_back(line); }
+
+// a fresh ODrive link with a background request for axis 0 that has just expired
+static ODriveClass& expiredRequest(void)
+{
+    static ODriveClass* odrive = NULL;
+    delete odrive;
+    odrive = new ODriveClass(Serial1);
+
+    Serial1.rx_.clear();
+    odrive_device.replies.clear();
+
+    // the request goes out, its reply does not come back in time
+    reply("");
+    CHECK(odrive->RequestFeedback(0));
+    hostAdvance(EXPIRY_US);
+    CHECK(!odrive->ServiceFeedback());
+    return *odrive;
+}
+
+static void testReplyInTime(void)
+{
+    ODriveClass odrive(Serial1);
+    Serial1.rx_.clear();
+
+    reply("1234.5 -6.25\n");
+    CHECK(odrive.RequestFeedback(1));
+    CHECK(!odrive.RequestFeedback(0));
+    CHECK(odrive.ServiceFeedback());
+    CHECK(odrive.AsyncFeedback[1].position == 1234.5f);
+    CHECK(odrive.AsyncFeedback[1].velocity == -6.25f);
+    CHECK(odrive.RequestFeedback(0));
+}
+
+static void testLateReplyBeforeRead(void)
+{
+    ODriveClass& odrive = expiredRequest();
+
+    // the late reply arrives ahead of the answers to the blocking reads
+    Serial1.inject("100.5 2.5\n");
+    reply("12345\n");
+    reply("7.5\n");
+    CHECK(odrive.ReadShadowCount(0) == 12345);
+
+    float value = 0.0f;
+    CHECK(odrive.ReadProperty(0, "encoder.pos_estimate", value));
+    CHECK(value == 7.5f);
+    CHECK(odrive.AsyncFeedback[0].position == 0.0f);
+}
+
+static void testLostReplyBeforeRead(void)
+{
+    ODriveClass& odrive = expiredRequest();
+
+    // the reply never comes, the answer to the read is not thrown away in its place
+    reply("42\n");
+    CHECK(odrive.ReadShadowCount(0) == 42);
+
+    reply("8\n");
+    CHECK(odrive.ReadShadowCount(0) == 8);
+}
+
+static void testSplitReply(void)
+{
+    ODriveClass odrive(Serial1);
+    Serial1.rx_.clear();
+
+    // half the reply had arrived when the request expired
+    reply("100.5");
+    CHECK(odrive.RequestFeedback(0));
+    CHECK(!odrive.ServiceFeedback());
+    hostAdvance(EXPIRY_US);
+    CHECK(!odrive.ServiceFeedback());
+
+    Serial1.inject(" 2.5\n");
+    reply("3\n");
+    CHECK(odrive.ReadShadowCount(0) == 3);
+}
+
+static void testLateReplyBeforeRequest(void)
+{
+    ODriveClass& odrive = expiredRequest();
+
+    // no new request goes out until the late reply is dealt with
+    CHECK(!odrive.RequestFeedback(1));
+    Serial1.inject("100.5 2.5\n");
+    CHECK(!odrive.ServiceFeedback());
+    CHECK(odrive.AsyncFeedback[0].position == 0.0f);
+
+    reply("-50 1\n");
+    CHECK(odrive.RequestFeedback(1));
+    CHECK(odrive.ServiceFeedback());
+    CHECK(odrive.AsyncFeedback[1].position == -50.0f);
+}
+
+static void testLostReplyBeforeRequest(void)
+{
+    ODriveClass& odrive = expiredRequest();
+
+    // given up on a second time, requests start again
+    CHECK(!odrive.RequestFeedback(0));
+    hostAdvance(EXPIRY_US);
+    CHECK(!odrive.ServiceFeedback());
+    CHECK(odrive.RequestFeedback(0));
+}
+
+static void testBlockingFeedback(void)
+{
+    ODriveClass& odrive = expiredRequest();
+
+    // a blocking feedback read looks just like the late reply, so it waits for it first
+    Serial1.inject("100.5 2.5\n");
+    reply("-3 4\n");
+    CHECK(odrive.ReadFeedback(1));
+    CHECK(odrive.Feedback.position == -3.0f);
+    CHECK(odrive.Feedback.velocity == 4.0f);
+
+    // and when it never comes the read still goes ahead
+    ODriveClass& lost = expiredRequest();
+    host_clock_step = BUSY_STEP_US;
+    reply("9 10\n");
+    uint64_t start = hostTime();
+    bool read = lost.ReadFeedback(1);
+    host_clock_step = 0;
+    CHECK(read);
+    CHECK(lost.Feedback.position == 9.0f);
+    printf("    lost reply held the read up for %.2f s\n", (hostTime() - start) / 1e6);
+}
+
+int main(void)
+{
+    Serial1.attach(&odrive_device);
+
+    RUN(testReplyInTime);
+    RUN(testLateReplyBeforeRead);
+    RUN(testLostReplyBeforeRead);
+    RUN(testSplitReply);
+    RUN(testLateReplyBeforeRequest);
+    RUN(testLostReplyBeforeRequest);
+    RUN(testBlockingFeedback);
+    return testSummary("odrive");
+}
@@ -0,0 +1,373 @@
+/*
+ * Predictor Replay Harness
+ *
+ * @file    test_predictor.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Replays timestamped console frames through the pipeline
+ * and scores how closely the motor follows the console, with and without
+ * prediction.  Frames reach the Teensy after the Pi delay and are handled
+ * as ArtNetPan() does, commands reach the ODrive after its delay and are
+ * followed by a trapezoidal trajectory at the configured limits, which the
+ * motor tracks with a first order lag.
+ *
+ *     build/test_predictor [show.csv]
+ *
+ * A show file holds one frame per line, "time in ms,pan" with pan the
+ * 16 bit ArtNet value.  Without one a built in show of linear moves,
+ * fades, a slow drift, an effect sweep and a snap cue is replayed.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "predictor.h"
+
+/* Constants -----------------------------------------------------------*/
+#define COUNTS_PER_STEP     0.9375      // counts per ArtNet pan step, 540 degree range
+#define FRAME_RATE          44.0        // ArtNet frames per second
+#define PI_DELAY            0.008       // s from console to the Teensy
+#define PI_JITTER           0.002       // s, uniform either way
+#define CONTROL_TICK        0.010       // s, commands go out on the next control tick
+#define ODRIVE_DELAY        0.012       // s from command to the trajectory starting
+#define VELOCITY_LIMIT      40960.0     // counts/s, TRAJ_VEL_LIMIT
+#define ACCEL_LIMIT         25000.0     // counts/s^2, TRAJ_ACCEL_LIMIT
+#define DECEL_LIMIT         20000.0     // counts/s^2, TRAJ_DECEL_LIMIT
+#define MOTOR_LAG           0.030       // s time constant of the motor following its trajectory
+#define PIPELINE_LATENCY    50          // ms, the measured horizon sent to the Teensy
+#define SIM_STEP            0.0005      // s
+#define SETTLE_BAND         2.0         // counts, the motor has settled on a stopped target
+
+/* Variables  ----------------------------------------------------------*/
+struct Frame_t {
+    double time;            // s, as sent by the console
+    float target;           // counts
+    uint8_t cue;            // index into the cue list, 0 for a show file
+};
+
+struct Cue_t {
+    const char* name;
+    double duration;        // s
+    double from;            // counts
+    double to;
+    int shape;              // 0 linear, 1 cosine fade, 2 effect sweep
+};
+
+// Tracking error of one cue, a cue starts with the frame that changes its target
+struct Score_t {
+    double moving_rms;      // counts, while the console target moves
+    double moving_max;
+    double overshoot;       // counts past a stopped target in the direction it was moving
+    double settle;          // s from the stop until the motor stays within SETTLE_BAND
+};
+
+static const Cue_t show_cues[] = {
+    {"hold",              1.0,      0.0,      0.0, 0},
+    {"5000 c/s move",     4.0,      0.0,  20000.0, 0},
+    {"hold",              2.0,  20000.0,  20000.0, 0},
+    {"3 s fade",          3.0,  20000.0, -10000.0, 1},
+    {"hold",              2.0, -10000.0, -10000.0, 0},
+    {"10 c/s drift",     10.0, -10000.0,  -9900.0, 0},  // under an ArtNet step per frame
+    {"hold",              1.0,  -9900.0,  -9900.0, 0},
+    {"0.25 Hz sweep",     8.0,  -9900.0,  -9900.0, 2},  // 8000 count effect
+    {"hold",              2.0,  -9900.0,  -9900.0, 0},
+    {"snap",              0.07, -9900.0,  15000.0, 0},
+    {"hold",              2.0,  15000.0,  15000.0, 0},
+};
+#define SHOW_CUES   (sizeof(show_cues) / sizeof(show_cues[0]))
+
+static uint32_t jitter_state = 1;
+
+/* Functions------------------------------------------------------------*/
+static double jitter(void)
+{
+    jitter_state = jitter_state * 1664525 + 1013904223;
+    return ((jitter_state >> 8) / 16777216.0 * 2.0 - 1.0) * PI_JITTER;
+}
+
+static bool holds(uint8_t cue)
+{
+    return cue < SHOW_CUES && show_cues[cue].from == show_cues[cue].to && show_cues[cue].shape != 2;
+}
+
+static float quantize(double counts)
+{
+    return (float)(lround(counts / COUNTS_PER_STEP) * COUNTS_PER_STEP);
+}
+
+/**
+  * @brief  Builds the built in show, sampled at the ArtNet frame rate
+  * @param  void
+  * @return std::vector<Frame_t> - console frames
+  */
+static std::vector<Frame_t> builtInShow(void)
+{
+    std::vector<Frame_t> show;
+    double start = 0.0;
+
+    for (size_t c = 0; c < SHOW_CUES; c++){
+        const Cue_t& cue = show_cues[c];
+        double end = start + cue.duration;
+
+        for (double t = ceil(start * FRAME_RATE) / FRAME_RATE; t < end; t += 1.0 / FRAME_RATE){
+            double x = (t - start) / cue.duration;
+            double position;
+
+            if (cue.shape == 1)
+                position = cue.from + (cue.to - cue.from) * (1.0 - cos(PI * x)) / 2.0;
+            else if (cue.shape == 2)
+                position = cue.from + 8000.0 * sin(2 * PI * 0.25 * (t - start));
+            else
+                position = cue.from + (cue.to - cue.from) * x;
+
+            Frame_t frame = {t, quantize(position), (uint8_t)c};
+            show.push_back(frame);
+        }
+        start = end;
+    }
+
+    return show;
+}
+
+static bool loadShow(const char* path, std::vector<Frame_t>& show)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    double time_ms;
+    unsigned pan;
+    char line[128];
+    while (fgets(line, sizeof(line), file)){
+        if (sscanf(line, "%lf,%u", &time_ms, &pan) == 2){
+            Frame_t frame = {time_ms / 1000.0, (float)(((double)pan - 32768) * COUNTS_PER_STEP), 0};
+            show.push_back(frame);
+        }
+    }
+    fclose(file);
+    return !show.empty();
+}
+
+/**
+  * @brief  Replays a show through the pipeline and scores the tracking
+  * @param  const std::vector<Frame_t>& show - console frames
+  * @param  uint16_t horizon - prediction horizon in ms, 0 for none
+  * @param  std::vector<Score_t>& scores - tracking error of each cue
+  * @return void
+  */
+static void replay(const std::vector<Frame_t>& show, uint16_t horizon, std::vector<Score_t>& scores)
+{
+    Predictor predictor;
+    predictor.setHorizon(0, horizon);
+    jitter_state = 1;
+
+    // commands in the order they reach the ODrive
+    std::deque<Frame_t> commands;
+    float previous = NAN;
+    for (size_t i = 0; i < show.size(); i++){
+        double arrival = show[i].time + PI_DELAY + jitter();
+        hostSetTime((uint64_t)(arrival * 1e6));
+
+        // as ArtNetPan(), a repeated target only goes to the predictor while it leads
+        if (show[i].target != previous || predictor.moving(0)){
+            double sent = ceil(arrival / CONTROL_TICK) * CONTROL_TICK;
+            Frame_t command = {sent + ODRIVE_DELAY, predictor.update(0, show[i].target), 0};
+            commands.push_back(command);
+        }
+        previous = show[i].target;
+    }
+
+    std::vector<double> squares;
+    std::vector<uint64_t> samples;
+    scores.clear();
+
+    size_t index = 0;
+    double command = show[0].target, setpoint = show[0].target, velocity = 0.0, motor = show[0].target;
+    double direction = 0.0, stopped_at = 0.0;
+    bool stopped = true;
+
+    for (double t = show[0].time; t < show.back().time + 2.0; t += SIM_STEP){
+        while (!commands.empty() && commands.front().time <= t){
+            command = commands.front().target;
+            commands.pop_front();
+        }
+
+        // trajectory towards the latest command, braking to stop on it
+        double distance = command - setpoint;
+        double wanted = min(sqrt(2.0 * DECEL_LIMIT * fabs(distance)), VELOCITY_LIMIT);
+        wanted = distance < 0.0 ? -wanted : wanted;
+        double limit = (fabs(wanted) < fabs(velocity) ? DECEL_LIMIT : ACCEL_LIMIT) * SIM_STEP;
+        velocity += constrain(wanted - velocity, -limit, limit);
+        setpoint += velocity * SIM_STEP;
+        motor += (setpoint - motor) * SIM_STEP / MOTOR_LAG;
+
+        // console target, interpolated between frames and held after the last
+        while (index + 1 < show.size() && show[index + 1].time <= t)
+            index++;
+        const Frame_t& frame = show[index];
+        double target = frame.target;
+        bool moving = index + 1 < show.size() && show[index + 1].target != frame.target;
+        if (moving)
+            target += (show[index + 1].target - frame.target) * (t - frame.time) / (show[index + 1].time - frame.time);
+
+        // a move is scored against the cue it belongs to, not the hold either side
+        uint8_t cue = frame.cue;
+        if (moving && holds(cue))
+            cue = show[index + 1].cue;
+        if (cue >= scores.size()){
+            scores.resize(cue + 1, Score_t());
+            squares.resize(cue + 1, 0.0);
+            samples.resize(cue + 1, 0);
+        }
+        Score_t& score = scores[cue];
+        double error = motor - target;
+
+        if (moving){
+            direction = show[index + 1].target > frame.target ? 1.0 : -1.0;
+            stopped = false;
+            squares[cue] += error * error;
+            samples[cue]++;
+            score.moving_max = max(score.moving_max, fabs(error));
+            continue;
+        }
+
+        if (!stopped){
+            stopped = true;
+            stopped_at = t;
+        }
+        score.overshoot = max(score.overshoot, error * direction);
+        if (fabs(error) > SETTLE_BAND)
+            score.settle = t - stopped_at;
+    }
+
+    for (size_t cue = 0; cue < scores.size(); cue++)
+        scores[cue].moving_rms = samples[cue] ? sqrt(squares[cue] / samples[cue]) : 0.0;
+}
+
+static void testReplay(const std::vector<Frame_t>& show, bool built_in)
+{
+    const uint16_t horizons[] = {0, PIPELINE_LATENCY / 2, PIPELINE_LATENCY, 2 * PIPELINE_LATENCY, 4 * PIPELINE_LATENCY};
+    const size_t count = sizeof(horizons) / sizeof(horizons[0]);
+    std::vector<Score_t> scores[count];
+
+    for (size_t h = 0; h < count; h++)
+        replay(show, horizons[h], scores[h]);
+
+    printf("    %-16s", "horizon ms");
+    for (size_t h = 0; h < count; h++)
+        printf(" %21u", horizons[h]);
+    printf("\n    %-16s", "");
+    for (size_t h = 0; h < count; h++)
+        printf(" %21s", "rms/max/over/settle");
+    printf("\n");
+
+    for (size_t cue = 0; cue < scores[0].size(); cue++){
+        printf("    %-16s", built_in ? show_cues[cue].name : "show");
+        for (size_t h = 0; h < count; h++){
+            const Score_t& score = scores[h][cue];
+            printf(" %5.0f/%5.0f/%4.0f/%4.2f", score.moving_rms, score.moving_max, score.overshoot, score.settle);
+        }
+        printf("\n");
+    }
+
+    if (!built_in)
+        return;
+
+    const std::vector<Score_t>& direct = scores[0];
+    const std::vector<Score_t>& predicted = scores[2];
+    const size_t move = 1, fade = 3, drift = 5, sweep = 7, snap = 9;
+
+    // without prediction the trajectory never passes a stopped target
+    for (size_t cue = 0; cue < direct.size(); cue++)
+        CHECK(direct[cue].overshoot < SETTLE_BAND);
+
+    // leading by the pipeline latency cuts the lag of every move it can follow,
+    // the rest is the trajectory braking to stop on each new target
+    CHECK(predicted[move].moving_rms < 0.8 * direct[move].moving_rms);
+    CHECK(predicted[fade].moving_rms < 0.9 * direct[fade].moving_rms);
+    CHECK(predicted[sweep].moving_rms < 0.9 * direct[sweep].moving_rms);
+
+    // a drift under one ArtNet step per frame is left alone
+    CHECK(predicted[drift].moving_max < 2.0);
+
+    // a snap is faster than the axis, prediction neither helps nor hurts
+    CHECK_NEAR(predicted[snap].moving_max, direct[snap].moving_max, 1.0);
+    CHECK(predicted[snap + 1].overshoot < SETTLE_BAND);
+
+    // the cost is running past a stop, by less than the lag it removed, and settling a little later
+    for (size_t cue = move + 1; cue < predicted.size(); cue += 2){
+        CHECK(predicted[cue].overshoot < direct[cue - 1].moving_max);
+        CHECK(predicted[cue].settle < direct[cue].settle + 0.35);
+    }
+}
+
+static void testDisabled(void)
+{
+    Predictor predictor;
+    predictor.setHorizon(0, 0);
+
+    for (int i = 0; i < 10; i++){
+        hostAdvance(22727);
+        CHECK(predictor.update(0, i * 100.0f) == i * 100.0f);
+    }
+    CHECK(!predictor.enabled(0));
+}
+
+static void testLead(void)
+{
+    Predictor predictor;
+    predictor.setHorizon(0, 100);
+
+    // a steady 1000 counts/s leads by 100 counts once the velocity has converged
+    float predicted = 0.0f;
+    for (int i = 0; i <= 40; i++){
+        hostAdvance(25000);
+        predicted = predictor.update(0, i * 25.0f);
+    }
+    CHECK_NEAR(predicted, 40 * 25.0f + 100.0f, 0.5);
+    CHECK(predictor.moving(0));
+
+    // held, the lead decays until the target is returned unchanged
+    for (int i = 0; i < 20 && predictor.moving(0); i++){
+        hostAdvance(25000);
+        predicted = predictor.update(0, 1000.0f);
+    }
+    CHECK(!predictor.moving(0));
+    CHECK(predicted == 1000.0f);
+
+    // a gap longer than PREDICTION_FRAME_GAP does not count as motion
+    hostAdvance((PREDICTION_FRAME_GAP + 1) * 1000UL);
+    CHECK(predictor.update(0, 5000.0f) == 5000.0f);
+
+    // horizons are capped
+    predictor.setHorizon(1, 2000);
+    for (int i = 0; i <= 40; i++){
+        hostAdvance(25000);
+        predicted = predictor.update(1, i * 25.0f);
+    }
+    CHECK_NEAR(predicted, 40 * 25.0f + PREDICTION_MAX_HORIZON, 2.5);
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<Frame_t> show;
+
+    if (argc > 1 && !loadShow(argv[1], show)){
+        fprintf(stderr, "%s: no frames\n", argv[1]);
+        return 2;
+    }
+    if (show.empty())
+        show = builtInShow();
+    printf("  %u frames, %.1f s\n", (unsigned)show.size(), show.back().time - show.front().time);
+
+    RUN(testDisabled);
+    RUN(testLead);
+    hostReset();
+    printf("  testReplay\n");
+    testReplay(show, argc <= 1);
+    return testSummary("predictor");
+}
@@ -0,0 +1,359 @@
+/*
+ * Continuous Rotation Tests
+ *
+ * @file    test_rotation.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Sends ArtNet pan frames through StormBreaker to a
+ * simulated ODrive: a long show of continuous rotation, millions of system
+ * revolutions in one direction, then back to a pan position or the index.
+ * Checks the axis ramps to rest, the ODrive count is rebased so every
+ * position sent afterwards is a small exact float, and the output lands on
+ * the requested angle by the shortest move.
+ *
+ * The simulated ODrive keeps the true output position in counts alongside
+ * its own frame, which encoder.set_linear_count moves, and reports the
+ * position as the float it holds and the shadow count wrapped at 32 bits.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "stormbreaker.h"
+#include "calibration.h"
+
+#include <stdarg.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Constants -----------------------------------------------------------*/
+#define STEP_US             100         // simulation step
+#define TICK_US             (1000000 / CONTROL_RATE)
+#define REVOLUTION          (CPR * TENSION_SCALING_FACTOR)
+#define SHOW_JUMP           ((1LL << 30) + 12345)  // counts turned between tracker updates while fast forwarding
+#define SHOW_JUMPS          200         // about 5 million system revolutions
+#define EXACT_FLOAT         (1 << 24)   // every count up to here is a float
+#define SETTLE_MS           5000
+#define FULL_CW             2           // pan_control at VEL_VEL_LIMIT
+#define FULL_CCW            255
+
+#if !defined BODY || defined BOTH_FOR_TESTING
+    #error "test_rotation is built for the body, the default in options.h"
+#endif
+
+/* Classes -------------------------------------------------------------*/
+// ODrive in closed loop on the end of Serial1, following velocity and position commands
+class ODriveSim : public HostDevice {
+public:
+    ODriveSim() : length_(0) {}
+
+    void powerOn(void)
+    {
+        output_ = 0.0;
+        frame_ = 0.0;
+        velocity_ = 0.0;
+        target_ = 0.0;
+        velocity_control_ = false;
+        time_ = hostTime();
+        length_ = 0;
+        rebases = 0;
+        largest_velocity_step = 0.0;
+        commands.clear();
+        Serial1.rx_.clear();
+    }
+
+    void advance(void)
+    {
+        while (time_ + STEP_US <= hostTime()){
+            time_ += STEP_US;
+            step(STEP_US * 1e-6);
+        }
+    }
+
+    // the show, turned at full speed without simulating every step
+    void turn(int64_t counts) { output_ += counts; }
+
+    double output() { return output_; }
+    double velocity() { return velocity_; }
+
+    void receive(uint8_t b)
+    {
+        if (b != '\n'){
+            if (length_ < sizeof(line_) - 1)
+                line_[length_++] = b;
+            return;
+        }
+        line_[length_] = '\0';
+        length_ = 0;
+        advance();
+        command(line_);
+    }
+
+    int rebases;                    // encoder.set_linear_count writes
+    double largest_velocity_step;   // between velocity commands, counts/s
+    std::vector<double> commands;   // positions sent with p and t
+
+private:
+    std::map<std::string, double> properties_;
+    char line_[128];
+    size_t length_;
+
+    uint64_t time_;
+    double output_;         // true output position in counts
+    double frame_;          // output position of ODrive count zero
+    double velocity_;
+    double target_;         // output position
+    bool velocity_control_;
+
+    double property(const char* name, double fallback)
+    {
+        std::map<std::string, double>::iterator found = properties_.find(name);
+        return found == properties_.end() ? fallback : found->second;
+    }
+
+    void step(double dt)
+    {
+        if (velocity_control_){
+            output_ += velocity_ * dt;
+            return;
+        }
+
+        // trapezoid onto the target, braking at decel_limit
+        double velocity_limit = property("axis0.trap_traj.config.vel_limit", TRAJ_VEL_LIMIT);
+        double accel = property("axis0.trap_traj.config.accel_limit", TRAJ_ACCEL_LIMIT);
+        double decel = property("axis0.trap_traj.config.decel_limit", TRAJ_DECEL_LIMIT);
+        double distance = target_ - output_;
+
+        if (fabs(distance) < 0.01 && fabs(velocity_) < decel * dt){
+            output_ = target_;
+            velocity_ = 0.0;
+            return;
+        }
+
+        double direction = distance > 0 ? 1.0 : -1.0;
+        double speed = velocity_ * direction;
+        double braking = speed > 0 ? speed * speed / (2 * decel) : 0.0;
+
+        if (speed < 0)
+            speed += decel * dt;
+        else if (braking >= fabs(distance))
+            speed = max(speed - decel * dt, 0.0);
+        else
+            speed = min(speed + accel * dt, velocity_limit);
+
+        speed = min(speed, fabs(distance) / dt);
+        velocity_ = speed * direction;
+        output_ += velocity_ * dt;
+    }
+
+    void reply(const char* format, ...)
+    {
+        char text[64];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        Serial1.inject(text);
+    }
+
+    void moveTo(double position)
+    {
+        commands.push_back(position);
+        target_ = position + frame_;
+        velocity_control_ = false;
+    }
+
+    void command(const char* line)
+    {
+        int axis;
+        double value;
+        char name[96];
+        double count = output_ - frame_;
+
+        if (sscanf(line, "f %d", &axis) == 1){
+            reply("%.4f %.4f\n", (double)(float)count, velocity_);
+        } else if (sscanf(line, "v %d %lf", &axis, &value) == 2){
+            largest_velocity_step = max(largest_velocity_step, fabs(value - velocity_));
+            velocity_ = value;
+            velocity_control_ = true;
+        } else if (sscanf(line, "p %d %lf", &axis, &value) == 2 || sscanf(line, "t %d %lf", &axis, &value) == 2){
+            moveTo(value);
+        } else if (sscanf(line, "w %95s %lf", name, &value) == 2){
+            if (strcmp(name, "axis0.encoder.set_linear_count") == 0){
+                frame_ = output_ - value;
+                rebases++;
+            }
+            properties_[name] = value;
+        } else if (sscanf(line, "r %95s", name) == 1){
+            if (strcmp(name, "axis0.encoder.shadow_count") == 0)
+                reply("%d\n", (int32_t)(uint32_t)(int64_t)llround(count));
+            else
+                reply("%g\n", property(name, 0.0));
+        }
+    }
+};
+
+/* Variables  ----------------------------------------------------------*/
+static ODriveSim sim;
+
+// the firmware's objects are globals, so the planner starts zeroed
+static ODriveClass odrive(Serial1);
+static MotionPlanner motion(odrive);
+static EffectsEngine effects(motion);
+static StormBreaker thor(odrive, motion, effects);
+
+/* Functions------------------------------------------------------------*/
+// runs the simulation and the control tasks the way the scheduler releases them
+static void run(uint32_t ms)
+{
+    uint64_t end = hostTime() + ms * 1000ULL;
+
+    while (hostTime() < end){
+        hostAdvance(STEP_US);
+        sim.advance();
+
+        if (hostTime() % TICK_US != 0)
+            continue;
+
+        hostRunTimers();
+        if (motion.tickPending()){
+            effects.service();
+            motion.service();
+        }
+        if (thor.stopPending())
+            thor.serviceStops();
+        thor.serviceTracking();
+    }
+}
+
+static void frame(uint16_t pan, uint8_t pan_control)
+{
+    uint8_t packet[] = {StormBreaker::ARTNETBODY, StormBreaker::SIZE_BODY, (uint8_t)(pan >> 8), (uint8_t)pan, pan_control, 0, 0};
+    Serial2.inject(packet, sizeof(packet));
+    thor.serviceStormBreaker();
+}
+
+// pan value for an offset from the index in the 540 degree range, a multiple of 7.5 counts
+static uint16_t pan(int offset)
+{
+    return 32768 + offset / 15 * 16;
+}
+
+// counts from the requested angle, the encoder count is whole but the output is not
+static double angleError(double position, double requested)
+{
+    return fabs(remainder(position - requested, REVOLUTION));
+}
+
+/**
+  * @brief  Turns the axis a long way at full speed, then stops it with a frame
+  * @param  uint8_t direction - pan_control of the rotation
+  * @param  int64_t jump - counts per tracker update, signed
+  * @return double - true output position before the stop
+  */
+static double longShow(uint8_t direction, int64_t jump)
+{
+    double start = sim.output();
+    frame(pan(0), direction);
+    run(1000);
+
+    for (int i = 0; i < SHOW_JUMPS; i++){
+        sim.turn(jump);
+        run(TRACKING_INTERVAL);
+    }
+
+    printf("    %.0f system revolutions\n", (sim.output() - start) / REVOLUTION);
+    sim.largest_velocity_step = 0.0;
+    sim.commands.clear();
+    return sim.output();
+}
+
+// positions sent since the show are whole counts a float holds exactly
+static bool exactCommands(void)
+{
+    bool exact = !sim.commands.empty();
+    for (size_t i = 0; i < sim.commands.size(); i++)
+        exact &= fabs(sim.commands[i]) < EXACT_FLOAT && sim.commands[i] == round(sim.commands[i]);
+    return exact;
+}
+
+static void testPanAfterShow(void)
+{
+    const int start = 1500, finish = -3000;
+
+    frame(pan(start), 0);
+    run(SETTLE_MS);
+    CHECK(angleError(sim.output(), start) < 1.0);
+
+    double before = longShow(FULL_CW, SHOW_JUMP);
+
+    // ramps down at the ramp rate, rebased once at rest, then lands on the new pan
+    frame(pan(finish), 0);
+    run(SETTLE_MS);
+    CHECK(sim.rebases == 1);
+    CHECK(sim.largest_velocity_step <= VEL_RAMP_LIMIT / CONTROL_RATE * 1.001);
+    CHECK(exactCommands());
+    CHECK(angleError(sim.output(), finish) < 1.0);
+    CHECK(sim.velocity() == 0.0);
+
+    // the shortest way back after the stopping distance
+    double stopping = VEL_VEL_LIMIT * VEL_VEL_LIMIT / (2 * VEL_RAMP_LIMIT);
+    CHECK(sim.output() - before <= stopping + REVOLUTION / 2);
+
+    // in the frame before the rebase the target is the true output position
+    float target = (float)sim.output();
+    printf("    a float target there steps %.0f counts\n", nextafterf(target, INFINITY) - target);
+
+    // and position frames afterwards stay exact
+    sim.commands.clear();
+    frame(pan(start), 0);
+    run(SETTLE_MS);
+    CHECK(exactCommands());
+    CHECK(angleError(sim.output(), start) < 1.0);
+}
+
+static void testIndexAfterShow(void)
+{
+    longShow(FULL_CCW, -SHOW_JUMP);
+
+    // stop and return to index homes onto a whole system revolution
+    int rebases = sim.rebases;
+    frame(pan(0), 129);
+    run(SETTLE_MS);
+    CHECK(sim.rebases == rebases + 1);
+    CHECK(sim.largest_velocity_step <= VEL_RAMP_LIMIT / CONTROL_RATE * 1.001);
+    CHECK(exactCommands());
+    CHECK(angleError(sim.output(), 0) < 1.0);
+
+    // from position control to the index there is nothing to rebase
+    frame(pan(3000), 0);
+    run(SETTLE_MS);
+    frame(pan(0), 129);
+    run(SETTLE_MS);
+    CHECK(sim.rebases == rebases + 1);
+    CHECK(angleError(sim.output(), 0) < 1.0);
+}
+
+int main(void)
+{
+    hostReset();
+    Serial1.attach(&sim);
+    sim.powerOn();
+    motion.begin();
+
+    // homed with the system index at ODrive count zero
+    thor.SystemIndex.pan_index = 0;
+    thor.enableMotion(true);
+
+    // the axis state carries over, so the tests run in order without RUN()
+    printf("  testPanAfterShow\n");
+    testPanAfterShow();
+    printf("  testIndexAfterShow\n");
+    testIndexAfterShow();
+    return testSummary("rotation");
+}
@@ -0,0 +1,264 @@
+/*
+ * Storage Tests
+ *
+ * @file    test_storage.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   EEPROM layout of the index, boot and preset records,
+ * preset wear levelling across the slots, the int8 sequence comparison
+ * as it wraps, and recovery from corrupted copies.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "storage.h"
+
+/* Constants -----------------------------------------------------------*/
+#define TEENSY35_EEPROM     4096        // bytes
+#define WEAR_STORES         1000        // stores of one preset in the wear test
+#define WRAP_STORES         600         // more than two turns of the sequence
+
+#define PRESET_BYTES        (PRESET_SLOTS * sizeof(PresetRecord_t))
+#define PRESET_START(INDEX) (PRESET_TABLE_ADDRESS + (INDEX) * PRESET_BYTES)
+
+/* Functions------------------------------------------------------------*/
+static PresetRecord_t makePreset(uint16_t value)
+{
+    PresetRecord_t record;
+    memset(&record, 0, sizeof(record));
+    record.pan = value;
+    record.tilt = ~value;
+    record.effect_size = value * 3;
+    record.effect_rate = value * 5;
+    record.effect_phase = value * 7;
+    record.pan_tilt_speed = value;
+    record.led_red = value >> 1;
+    record.led_green = value >> 2;
+    record.led_blue = value >> 3;
+    record.effect_shape = value % 5;
+    return record;
+}
+
+static bool samePreset(const PresetRecord_t& a, const PresetRecord_t& b)
+{
+    return a.pan == b.pan && a.tilt == b.tilt && a.effect_size == b.effect_size && a.effect_rate == b.effect_rate &&
+        a.effect_phase == b.effect_phase && a.pan_tilt_speed == b.pan_tilt_speed && a.led_red == b.led_red &&
+        a.led_green == b.led_green && a.led_blue == b.led_blue && a.effect_shape == b.effect_shape;
+}
+
+static uint32_t writesBetween(int start, int end)
+{
+    uint32_t writes = 0;
+    for (int address = start; address < end; address++)
+        writes += EEPROM.writes(address);
+    return writes;
+}
+
+static uint32_t mostWrites(int start, int end)
+{
+    uint32_t most = 0;
+    for (int address = start; address < end; address++)
+        most = max(most, EEPROM.writes(address));
+    return most;
+}
+
+static void testLayout(void)
+{
+    // a size change moves the stored layout and needs a version bump
+    CHECK(sizeof(IndexRecord_t) == 16);
+    CHECK(sizeof(BootRecord_t) == 8);
+    CHECK(sizeof(PresetRecord_t) == 18);
+
+    // in address order without overlap, and inside the smallest EEPROM
+    CHECK(INDEX_RECORD_ADDRESS + sizeof(IndexRecord_t) <= BOOT_RECORD_ADDRESS);
+    CHECK(BOOT_RECORD_ADDRESS + sizeof(BootRecord_t) <= PRESET_TABLE_ADDRESS);
+    CHECK(PRESET_START(PRESET_COUNT) <= TEENSY35_EEPROM);
+    printf("    preset table ends at %u of %u bytes\n", (unsigned)PRESET_START(PRESET_COUNT), TEENSY35_EEPROM);
+
+    // every preset store stays inside its own slots
+    EEPROM.erase();
+    for (int index = 0; index < PRESET_COUNT; index++){
+        uint32_t before = writesBetween(0, TEENSY35_EEPROM);
+        PresetRecord_t record = makePreset(index + 1);
+        savePreset(index, record);
+        uint32_t written = writesBetween(0, TEENSY35_EEPROM) - before;
+        CHECK(written > 0 && written == writesBetween(PRESET_START(index), PRESET_START(index + 1)));
+    }
+    CHECK(writesBetween(0, PRESET_TABLE_ADDRESS) == 0);
+
+    // and the records beside the table leave it alone
+    uint32_t table_writes = writesBetween(PRESET_TABLE_ADDRESS, TEENSY35_EEPROM);
+    IndexRecord_t index_record;
+    memset(&index_record, 0, sizeof(index_record));
+    index_record.hall_position = 1234.5f;
+    saveIndexRecord(index_record);
+    CHECK(countBoot() == 1);
+    CHECK(writesBetween(PRESET_TABLE_ADDRESS, TEENSY35_EEPROM) == table_writes);
+    CHECK(writesBetween(BOOT_RECORD_ADDRESS + sizeof(BootRecord_t), PRESET_TABLE_ADDRESS) == 0);
+
+    bool intact = true;
+    for (int index = 0; index < PRESET_COUNT; index++){
+        PresetRecord_t record;
+        intact &= loadPreset(index, record) && samePreset(record, makePreset(index + 1));
+    }
+    CHECK(intact);
+
+    IndexRecord_t loaded;
+    CHECK(loadIndexRecord(loaded));
+    CHECK(loaded.hall_position == 1234.5f);
+}
+
+static void testRoundTrip(void)
+{
+    EEPROM.erase();
+    PresetRecord_t record;
+
+    // erased EEPROM holds no presets
+    CHECK(!loadPreset(0, record));
+    CHECK(!loadPreset(PRESET_COUNT - 1, record));
+
+    PresetRecord_t stored = makePreset(0xA5C3);
+    CHECK(savePreset(7, stored));
+    CHECK(stored.sequence == 0);
+    CHECK(loadPreset(7, record));
+    CHECK(samePreset(record, stored));
+    CHECK(!loadPreset(6, record));
+    CHECK(!loadPreset(8, record));
+
+    // out of range indexes are refused without writing
+    uint32_t before = writesBetween(0, TEENSY35_EEPROM);
+    CHECK(!savePreset(PRESET_COUNT, stored));
+    CHECK(!savePreset(255, stored));
+    CHECK(!loadPreset(PRESET_COUNT, record));
+    CHECK(writesBetween(0, TEENSY35_EEPROM) == before);
+
+    // storing the same preset again rewrites only the sequence and crc of the next slot
+    before = writesBetween(0, TEENSY35_EEPROM);
+    CHECK(savePreset(7, stored));
+    CHECK(stored.sequence == 1);
+    CHECK(writesBetween(PRESET_START(7) + sizeof(PresetRecord_t), PRESET_START(7) + 2 * sizeof(PresetRecord_t)) ==
+        writesBetween(0, TEENSY35_EEPROM) - before);
+}
+
+static void testWearLevelling(void)
+{
+    EEPROM.erase();
+
+    // each store goes to the slot after the newest
+    bool rotates = true;
+    for (int i = 0; i < WEAR_STORES; i++){
+        PresetRecord_t record = makePreset(i);
+        savePreset(3, record);
+
+        PresetRecord_t loaded;
+        int crc_address = PRESET_START(3) + (i % PRESET_SLOTS) * sizeof(PresetRecord_t) + offsetof(PresetRecord_t, crc);
+        rotates &= loadPreset(3, loaded) && samePreset(loaded, makePreset(i)) && EEPROM.writes(crc_address) > 0;
+    }
+    CHECK(rotates);
+
+    // the worst byte takes a quarter of the stores, and the slots share them evenly
+    uint32_t most = mostWrites(PRESET_START(3), PRESET_START(4));
+    printf("    %d stores, worst byte written %u times\n", WEAR_STORES, most);
+    CHECK(most <= (WEAR_STORES + PRESET_SLOTS - 1) / PRESET_SLOTS);
+
+    uint32_t slot_writes[PRESET_SLOTS];
+    for (int slot = 0; slot < PRESET_SLOTS; slot++){
+        int start = PRESET_START(3) + slot * sizeof(PresetRecord_t);
+        slot_writes[slot] = writesBetween(start, start + sizeof(PresetRecord_t));
+    }
+    for (int slot = 1; slot < PRESET_SLOTS; slot++)
+        CHECK_NEAR(slot_writes[slot], slot_writes[0], slot_writes[0] * 0.05);
+
+    // neighbours are untouched
+    CHECK(writesBetween(0, PRESET_START(3)) == 0);
+    CHECK(writesBetween(PRESET_START(4), TEENSY35_EEPROM) == 0);
+}
+
+static void testSequenceWrap(void)
+{
+    EEPROM.erase();
+    bool newest = true;
+    uint8_t last_sequence = 0;
+
+    // the uint8 sequence wraps twice, the int8 difference keeps the newest copy
+    for (int i = 0; i < WRAP_STORES; i++){
+        PresetRecord_t record = makePreset(i);
+        savePreset(0, record);
+        last_sequence = record.sequence;
+
+        PresetRecord_t loaded;
+        newest &= loadPreset(0, loaded) && samePreset(loaded, makePreset(i)) && loaded.sequence == (uint8_t)i;
+    }
+    CHECK(newest);
+    CHECK(last_sequence == (uint8_t)(WRAP_STORES - 1));
+
+    // slots hold 254, 255, 0 and 1 across the wrap
+    EEPROM.erase();
+    for (int i = 0; i < 256 + 2; i++){
+        PresetRecord_t record = makePreset(i);
+        savePreset(1, record);
+    }
+    PresetRecord_t loaded;
+    CHECK(loadPreset(1, loaded));
+    CHECK(loaded.sequence == 1);
+    CHECK(samePreset(loaded, makePreset(257)));
+}
+
+static void testCorruption(void)
+{
+    EEPROM.erase();
+    for (int i = 0; i < 6; i++){
+        PresetRecord_t record = makePreset(100 + i);
+        savePreset(2, record);
+    }
+
+    // a torn write of the newest copy falls back to the one before
+    int newest = PRESET_START(2) + (5 % PRESET_SLOTS) * sizeof(PresetRecord_t);
+    EEPROM.write(newest + offsetof(PresetRecord_t, pan), EEPROM.read(newest + offsetof(PresetRecord_t, pan)) ^ 0x01);
+
+    PresetRecord_t loaded;
+    CHECK(loadPreset(2, loaded));
+    CHECK(samePreset(loaded, makePreset(104)));
+
+    // and the next store goes after the intact copy, replacing the torn one
+    PresetRecord_t record = makePreset(200);
+    savePreset(2, record);
+    CHECK(record.sequence == 5);
+    CHECK(loadPreset(2, loaded));
+    CHECK(samePreset(loaded, makePreset(200)));
+
+    // nothing intact, nothing loaded
+    for (int slot = 0; slot < PRESET_SLOTS; slot++){
+        int address = PRESET_START(2) + slot * sizeof(PresetRecord_t) + offsetof(PresetRecord_t, crc);
+        EEPROM.write(address, EEPROM.read(address) ^ 0xFF);
+    }
+    CHECK(!loadPreset(2, loaded));
+
+    // the index record and boot counter reject corruption too
+    IndexRecord_t index_record;
+    memset(&index_record, 0, sizeof(index_record));
+    saveIndexRecord(index_record);
+    CHECK(loadIndexRecord(index_record));
+    EEPROM.write(INDEX_RECORD_ADDRESS + offsetof(IndexRecord_t, hall_position), 0x42);
+    CHECK(!loadIndexRecord(index_record));
+
+    CHECK(countBoot() == 1);
+    CHECK(countBoot() == 2);
+    EEPROM.write(BOOT_RECORD_ADDRESS, EEPROM.read(BOOT_RECORD_ADDRESS) ^ 0x10);
+    CHECK(countBoot() == 1);
+}
+
+int main(void)
+{
+    RUN(testLayout);
+    RUN(testRoundTrip);
+    RUN(testWearLevelling);
+    RUN(testSequenceWrap);
+    RUN(testCorruption);
+    return testSummary("storage");
+}
@@ -0,0 +1,268 @@
+/*
+ * Fan Tachometer Tests
+ *
+ * @file    test_tach.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Built with FAN_TACH.  Drives the tach pins with pulse
+ * trains at known speeds, with and without PWM glitches, and checks the
+ * RPM and stall flag the fans report in their telemetry as a fan runs,
+ * stops, stalls and recovers.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "fan.h"
+
+/* Constants -----------------------------------------------------------*/
+#define SERVICE_US          (FAN_SERVICE_INTERVAL * 1000UL)
+#define PULSES_PER_REV      2           // fan.cpp TACH_PULSES_PER_REV
+#define FULL_RPM            6000        // fan.cpp FAN_MAX_RPM
+#define GLITCH_US           150         // PWM crosstalk after each real edge
+#define TIMEOUT_MS          500         // fan.cpp TACH_TIMEOUT
+#define LAST_SENSOR         0x4B        // read last in every pass
+
+static const int fan_pins[FAN_ZONES] = {3, 4};
+static const int tach_pins[FAN_ZONES] = {6, 7};
+static const uint8_t zone_sensors[FAN_ZONES][2] = {{0x48, 0x4A}, {0x49, 0x4B}};
+
+#if !defined FAN_TACH
+    #error "test_tach is built with -DFAN_TACH"
+#endif
+
+/* Variables  ----------------------------------------------------------*/
+// Simulated fan tach output
+struct Tach_t {
+    double rpm;             // 0 for no pulses
+    bool glitches;          // a second falling edge shortly after every pulse
+    uint64_t next_pulse;    // host time of the next falling edge
+};
+
+static Tach_t tachs[FAN_ZONES];
+
+// Telemetry of one zone, as fanPack() reports it
+struct Report_t {
+    int pwm;
+    int rpm;
+    bool stalled;
+};
+
+/* Functions------------------------------------------------------------*/
+static void setTemperature(int zone, double temperature)
+{
+    uint16_t value = (uint16_t)((((int)lround(temperature * 16)) & 0xFFF) << 4);
+    for (int i = 0; i < 2; i++)
+        Wire.devices[zone_sensors[zone][i]].registers[0] = value;
+}
+
+static void setTach(int zone, double rpm, bool glitches = false)
+{
+    tachs[zone].rpm = rpm;
+    tachs[zone].glitches = glitches;
+    tachs[zone].next_pulse = hostTime() + (rpm > 0 ? (uint64_t)(60e6 / (rpm * PULSES_PER_REV)) : 0);
+}
+
+static void pulse(int zone)
+{
+    hostSetPin(tach_pins[zone], LOW);
+    hostSetPin(tach_pins[zone], HIGH);
+}
+
+/**
+  * @brief  Runs the fans for a while, pulsing the tach pins on time
+  * @param  uint32_t ms - time to run
+  * @return void
+  */
+static void run(uint32_t ms)
+{
+    uint64_t end = hostTime() + ms * 1000ULL;
+    uint64_t next_service = hostTime() + SERVICE_US;
+
+    while (true){
+        uint64_t next = next_service;
+        int zone_due = -1;
+
+        for (int zone = 0; zone < FAN_ZONES; zone++){
+            if (tachs[zone].rpm > 0 && tachs[zone].next_pulse < next){
+                next = tachs[zone].next_pulse;
+                zone_due = zone;
+            }
+        }
+        if (next > end)
+            break;
+
+        hostSetTime(next);
+
+        if (zone_due < 0){
+            runFans();
+            next_service += SERVICE_US;
+            continue;
+        }
+
+        Tach_t& tach = tachs[zone_due];
+        pulse(zone_due);
+        if (tach.glitches){
+            hostAdvance(GLITCH_US);
+            pulse(zone_due);
+        }
+        tach.next_pulse += (uint64_t)(60e6 / (tach.rpm * PULSES_PER_REV));
+    }
+
+    hostSetTime(end);
+}
+
+// runs until the fans have finished this many passes over the sensors
+static void passes(int count)
+{
+    for (int pass = 0; pass < count; pass++){
+        uint32_t reads = Wire.devices[LAST_SENSOR].reads;
+        while (Wire.devices[LAST_SENSOR].reads == reads)
+            run(FAN_SERVICE_INTERVAL);
+        run(FAN_SERVICE_INTERVAL);
+    }
+}
+
+static Report_t report(int zone)
+{
+    uint8_t buffer[FAN_ZONES * FAN_PACKED_SIZE];
+    fanPack(buffer, sizeof(buffer));
+
+    const uint8_t* entry = &buffer[zone * FAN_PACKED_SIZE];
+    Report_t result = {(entry[1] << 8) | entry[2], (entry[3] << 8) | entry[4], entry[5] != 0};
+    return result;
+}
+
+static void testRpm(void)
+{
+    // hot enough that both fans run flat out
+    setTemperature(0, FAN_DEFAULT_SETPOINT + 20.0);
+    setTemperature(1, FAN_DEFAULT_SETPOINT + 20.0);
+    setTach(0, FULL_RPM);
+    setTach(1, FULL_RPM);
+    passes(3);
+    CHECK(report(0).pwm == 1024 && report(1).pwm == 1024);
+
+    // each zone reads its own tach across the range
+    const double speeds[][2] = {{6000, 4500}, {3000, 2400}, {2000, 5000}, {1900, 1850}};
+    double worst = 0.0;
+    bool healthy = true;
+    for (auto& speed : speeds){
+        setTach(0, speed[0]);
+        setTach(1, speed[1]);
+        run(100);
+        passes(1);
+        for (int zone = 0; zone < FAN_ZONES; zone++){
+            worst = max(worst, fabs(report(zone).rpm - speed[zone]) / speed[zone]);
+            healthy &= !report(zone).stalled;
+        }
+    }
+    printf("    RPM within %.2f%% of the tach\n", worst * 100);
+    CHECK(worst < 0.01);
+    CHECK(healthy);
+}
+
+static void testGlitches(void)
+{
+    // PWM crosstalk doubling the falling edges is ignored
+    setTach(0, 3000, true);
+    setTach(1, 2000, true);
+    run(100);
+    passes(1);
+    CHECK_NEAR(report(0).rpm, 3000, 30);
+    CHECK_NEAR(report(1).rpm, 2000, 20);
+
+    setTach(0, FULL_RPM);
+    setTach(1, FULL_RPM);
+    passes(1);
+}
+
+static void testStopped(void)
+{
+    // cooled below the hysteresis band the fan is switched off, no pulses is no stall
+    setTemperature(0, FAN_DEFAULT_SETPOINT - 5.0);
+    passes(3);
+    setTach(0, 0);
+    run(TIMEOUT_MS);
+    passes(3);
+    CHECK(report(0).pwm == 0);
+    CHECK(report(0).rpm == 0);
+    CHECK(!report(0).stalled);
+}
+
+static void testStall(void)
+{
+    // started by a warm spell, then just under the setpoint it holds the minimum duty, 1195 RPM expected
+    setTemperature(0, FAN_DEFAULT_SETPOINT + 0.5);
+    setTach(0, FULL_RPM);
+    for (int pass = 0; pass < 10 && report(0).pwm == 0; pass++)
+        passes(1);
+    CHECK(report(0).pwm == 1024);
+
+    setTemperature(0, FAN_DEFAULT_SETPOINT - 1.0);
+    setTach(0, 1200);
+    passes(12);
+    CHECK(report(0).pwm == 204);
+    CHECK(!report(0).stalled);
+
+    // dragging at half the expected speed is still healthy
+    setTach(0, 600);
+    passes(2);
+    CHECK(!report(0).stalled);
+
+    // seized: once the pulses have timed out one slow pass is forgiven, the second restarts the fan at full power
+    setTach(0, 0);
+    run(TIMEOUT_MS);
+    passes(1);
+    CHECK(report(0).rpm == 0);
+    CHECK(!report(0).stalled);
+    uint32_t writes = hostAnalogWrites(fan_pins[0]);
+    passes(1);
+    CHECK(report(0).stalled);
+    CHECK(report(0).pwm == 1024);
+    CHECK(hostAnalogWrites(fan_pins[0]) > writes);
+
+    // the PI loop takes it back down and the flag holds while the fan stays slow
+    passes(1);
+    CHECK(report(0).pwm == 204);
+    CHECK(report(0).stalled);
+
+    // the other zone carries on
+    CHECK(!report(1).stalled);
+    CHECK_NEAR(report(1).rpm, FULL_RPM, 60);
+
+    // spinning again clears it
+    setTach(0, 1200);
+    run(100);
+    passes(1);
+    CHECK(!report(0).stalled);
+    CHECK_NEAR(report(0).rpm, 1200, 12);
+}
+
+int main(void)
+{
+    hostReset();
+    hostSetTime(1000000);
+    Wire.reset();
+    for (int zone = 0; zone < FAN_ZONES; zone++){
+        for (int i = 0; i < 2; i++)
+            Wire.devices[zone_sensors[zone][i]].present = true;
+        setTemperature(zone, 25.0);
+    }
+    initFans();
+
+    // the fan state carries over, so the tests run in order without RUN()
+    printf("  testRpm\n");
+    testRpm();
+    printf("  testGlitches\n");
+    testGlitches();
+    printf("  testStopped\n");
+    testStopped();
+    printf("  testStall\n");
+    testStall();
+    return testSummary("tach");
+}
@@ -0,0 +1,244 @@
+/*
+ * TMP102 Tests
+ *
+ * @file    test_tmp102.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Register decoding in 12 and 13 bit mode, and the
+ * non-blocking read against the simulated I2C bus: completion, a busy
+ * bus, missing devices, bus errors, short reads and a wedged transfer.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "TMP102.h"
+
+/* Constants -----------------------------------------------------------*/
+#define SENSOR_ADDRESS  0x48
+#define OTHER_ADDRESS   0x49
+#define MAX_POLLS       100
+
+/* Functions------------------------------------------------------------*/
+// temperature register contents for a reading in 1/16 degree counts
+static uint16_t register12(int counts) { return (uint16_t)((counts & 0xFFF) << 4); }
+static uint16_t register13(int counts) { return (uint16_t)(((counts & 0x1FFF) << 3) | 0x01); }
+
+static float decode(uint16_t value) { return TMP102::decodeTempC(value >> 8, value & 0xFF); }
+
+static void addSensor(uint8_t address, float temperature)
+{
+    Wire.devices[address].present = true;
+    Wire.devices[address].registers[0] = register12(lroundf(temperature * 16));
+}
+
+// services the read until it finishes, 1 ms per poll, returns the polls taken
+static int serviceUntilDone(TMP102& sensor)
+{
+    for (int polls = 1; polls <= MAX_POLLS; polls++){
+        hostAdvance(1000);
+        if (sensor.serviceRead())
+            return polls;
+    }
+    return -1;
+}
+
+static void testDecode12(void)
+{
+    // datasheet table 5
+    CHECK(decode(register12(0x7FF)) == 127.9375f);
+    CHECK(decode(register12(0x640)) == 100.0f);
+    CHECK(decode(register12(0x190)) == 25.0f);
+    CHECK(decode(register12(0x004)) == 0.25f);
+    CHECK(decode(register12(0x001)) == 0.0625f);
+    CHECK(decode(register12(0x000)) == 0.0f);
+    CHECK(decode(register12(0xFFC)) == -0.25f);
+    CHECK(decode(register12(0xE70)) == -25.0f);
+    CHECK(decode(register12(0xC90)) == -55.0f);
+
+    CHECK(TMP102::decodeTempC(0x19, 0x00) == 25.0f);
+    CHECK(TMP102::decodeTempC(0xFF, 0xF0) == -0.0625f);
+
+    // the bits below the reading are ignored
+    CHECK(TMP102::decodeTempC(0x19, 0x0E) == 25.0f);
+
+    bool exact = true;
+    for (int counts = -55 * 16; counts < 128 * 16; counts++)
+        exact &= decode(register12(counts)) == counts * 0.0625f;
+    CHECK(exact);
+}
+
+static void testDecode13(void)
+{
+    // datasheet table 6, extended mode sets bit 0
+    CHECK(decode(register13(0x0960)) == 150.0f);
+    CHECK(decode(register13(0x0800)) == 128.0f);
+    CHECK(decode(register13(0x07FF)) == 127.9375f);
+    CHECK(decode(register13(0x0190)) == 25.0f);
+    CHECK(decode(register13(0x0001)) == 0.0625f);
+    CHECK(decode(register13(0x0000)) == 0.0f);
+    CHECK(decode(register13(0x1FFF)) == -0.0625f);
+    CHECK(decode(register13(0x1E70)) == -25.0f);
+    CHECK(decode(register13(0x1C90)) == -55.0f);
+
+    CHECK(TMP102::decodeTempC(0x4B, 0x01) == 150.0f);
+
+    bool exact = true;
+    for (int counts = -55 * 16; counts <= 150 * 16; counts++)
+        exact &= decode(register13(counts)) == counts * 0.0625f;
+    CHECK(exact);
+}
+
+static void testBlockingRead(void)
+{
+    Wire.reset();
+    addSensor(SENSOR_ADDRESS, 31.5f);
+    TMP102 sensor(SENSOR_ADDRESS);
+    sensor.begin();
+
+    CHECK(sensor.readTempC() == 31.5f);
+    CHECK(Wire.devices[SENSOR_ADDRESS].pointer == 0);
+}
+
+static void testRead(void)
+{
+    Wire.reset();
+    Wire.latency = 3;
+    addSensor(SENSOR_ADDRESS, 42.25f);
+    TMP102 sensor(SENSOR_ADDRESS);
+
+    CHECK(!sensor.readPending());
+    CHECK(!sensor.serviceRead());
+
+    hostSetTime(5000000);
+    CHECK(sensor.startReadTempC());
+    CHECK(sensor.readPending());
+
+    // pointer write, then the data read, each take the bus latency
+    int polls = serviceUntilDone(sensor);
+    CHECK(polls == (int)(2 * Wire.latency));
+    CHECK(!sensor.readPending());
+    CHECK(!sensor.readFailed());
+    CHECK(sensor.lastTempC() == 42.25f);
+    CHECK(sensor.lastReadTime() == millis());
+    CHECK(Wire.devices[SENSOR_ADDRESS].reads == 1);
+}
+
+static void testBusBusy(void)
+{
+    Wire.reset();
+    Wire.latency = 2;
+    addSensor(SENSOR_ADDRESS, 20.0f);
+    addSensor(OTHER_ADDRESS, 30.0f);
+    TMP102 first(SENSOR_ADDRESS);
+    TMP102 second(OTHER_ADDRESS);
+
+    CHECK(first.startReadTempC());
+    CHECK(!first.startReadTempC());     // already reading
+    CHECK(!second.startReadTempC());    // shares the bus
+    CHECK(!second.readPending());
+
+    CHECK(serviceUntilDone(first) > 0);
+    CHECK(second.startReadTempC());
+    CHECK(serviceUntilDone(second) > 0);
+
+    CHECK(first.lastTempC() == 20.0f);
+    CHECK(second.lastTempC() == 30.0f);
+}
+
+static void testMissingSensor(void)
+{
+    Wire.reset();
+    TMP102 sensor(SENSOR_ADDRESS);
+
+    CHECK(sensor.startReadTempC());
+    CHECK(serviceUntilDone(sensor) == 1);
+    CHECK(sensor.readFailed());
+    CHECK(sensor.lastTempC() == 0.0f);
+    CHECK(Wire.transfers == 1);         // gives up after the pointer write
+}
+
+static void testBusError(void)
+{
+    Wire.reset();
+    addSensor(SENSOR_ADDRESS, 25.0f);
+    TMP102 sensor(SENSOR_ADDRESS);
+
+    CHECK(sensor.startReadTempC());
+    CHECK(serviceUntilDone(sensor) > 0);
+    CHECK(sensor.lastTempC() == 25.0f);
+
+    // the data read fails, the last good reading is kept
+    Wire.devices[SENSOR_ADDRESS].registers[0] = register12(60 * 16);
+    uint32_t good_time = sensor.lastReadTime();
+    CHECK(sensor.startReadTempC());
+    hostAdvance(1000);
+    CHECK(!sensor.serviceRead());       // pointer written, data read started
+    Wire.fail_next = I2C_NACK_DATA;
+    CHECK(serviceUntilDone(sensor) > 0);
+    CHECK(sensor.readFailed());
+    CHECK(sensor.lastTempC() == 25.0f);
+    CHECK(sensor.lastReadTime() == good_time);
+
+    // and the next read recovers
+    CHECK(sensor.startReadTempC());
+    CHECK(serviceUntilDone(sensor) > 0);
+    CHECK(!sensor.readFailed());
+    CHECK(sensor.lastTempC() == 60.0f);
+}
+
+static void testShortRead(void)
+{
+    Wire.reset();
+    addSensor(SENSOR_ADDRESS, 25.0f);
+    TMP102 sensor(SENSOR_ADDRESS);
+
+    Wire.short_next = true;
+    CHECK(sensor.startReadTempC());
+    CHECK(serviceUntilDone(sensor) > 0);
+    CHECK(sensor.readFailed());
+    CHECK(sensor.lastTempC() == 0.0f);
+}
+
+static void testWedgedTransfer(void)
+{
+    Wire.reset();
+    addSensor(SENSOR_ADDRESS, 25.0f);
+    TMP102 sensor(SENSOR_ADDRESS);
+
+    hostSetTime(1000000);
+    CHECK(sensor.startReadTempC());
+    Wire.stall = true;
+
+    // abandoned once READ_TIMEOUT (20 ms) has passed
+    int polls = serviceUntilDone(sensor);
+    CHECK(polls == 21);
+    CHECK(sensor.readFailed());
+    CHECK(!sensor.readPending());
+
+    // no new read until the bus frees up
+    CHECK(!sensor.startReadTempC());
+    Wire.stall = false;
+    CHECK(sensor.startReadTempC());
+    CHECK(serviceUntilDone(sensor) > 0);
+    CHECK(!sensor.readFailed());
+    CHECK(sensor.lastTempC() == 25.0f);
+}
+
+int main(void)
+{
+    RUN(testDecode12);
+    RUN(testDecode13);
+    RUN(testBlockingRead);
+    RUN(testRead);
+    RUN(testBusBusy);
+    RUN(testMissingSensor);
+    RUN(testBusError);
+    RUN(testShortRead);
+    RUN(testWedgedTransfer);
+    return testSummary("tmp102");
+}
@@ -0,0 +1,276 @@
+/*
+ * Trace Tests
+ *
+ * @file    test_trace.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Records drained by trace.cpp are decoded with the host
+ * decoder (tools/trace_decode.h), on their own, mixed with console text,
+ * joined part way through a record and while several threads write the
+ * ring as the main loop drains it.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "trace.h"
+#include "trace_decode.h"
+
+/* Constants -----------------------------------------------------------*/
+#define STRESS_PRODUCERS    3
+#define STRESS_EVENTS       200000      // per producer
+
+static_assert(TRACE_PACKED_SIZE == TRACE_DECODE_RECORD_SIZE, "decoder record size");
+static_assert(TRACE_SYNC == TRACE_DECODE_SYNC, "decoder sync byte");
+static_assert(TRACE_TEMP_ALERT + 1 == TRACE_DECODE_IDS, "decoder event names");
+
+/* Classes -------------------------------------------------------------*/
+// Collects everything written, as the USB port would
+class Capture : public Print {
+public:
+    size_t write(uint8_t b) { bytes.push_back(b); return 1; }
+    using Print::write;
+    std::vector<uint8_t> bytes;
+};
+
+/* Functions------------------------------------------------------------*/
+static std::vector<TraceItem_t> decode(const std::vector<uint8_t>& bytes, TraceDecoder& decoder)
+{
+    std::vector<TraceItem_t> items;
+    decoder.push(bytes.data(), bytes.size(), items);
+    decoder.finish(items);
+    return items;
+}
+
+static void drainAll(Capture& out)
+{
+    while (traceDrain(out, 64) > 0)
+        ;
+}
+
+static void testRoundTrip(void)
+{
+    traceReset();
+    Capture out;
+
+    hostSetTime(1000);
+    CHECK(traceEvent(TRACE_HALL_EDGE, 1, 0));
+    hostSetTime(1250);
+    CHECK(traceEvent(TRACE_FRAME, 7, 0xDEADBEEF));
+    hostSetTime(5000);
+    CHECK(traceEvent(TRACE_PI_BACKLOG, 0xA5A5, 0xA5A5A5A5));
+    drainAll(out);
+
+    CHECK(out.bytes.size() == 3 * TRACE_PACKED_SIZE);
+
+    TraceDecoder decoder;
+    std::vector<TraceItem_t> items = decode(out.bytes, decoder);
+    CHECK(items.size() == 3);
+    CHECK(decoder.rejected() == 0);
+    if (items.size() != 3)
+        return;
+
+    CHECK(items[0].record && items[0].event.id == TRACE_HALL_EDGE && items[0].event.arg0 == 1);
+    CHECK(items[0].event.time == 1000 && items[0].event.timeline == 0);
+    CHECK(items[1].event.id == TRACE_FRAME && items[1].event.arg0 == 7 && items[1].event.arg1 == 0xDEADBEEF);
+    CHECK(items[1].event.timeline == 250);
+    CHECK(items[2].event.arg0 == 0xA5A5 && items[2].event.arg1 == 0xA5A5A5A5);
+    CHECK(items[2].event.timeline == 4000);
+}
+
+static void testTimelineWrap(void)
+{
+    traceReset();
+    Capture out;
+
+    hostSetTime(0xFFFFFF00UL);
+    traceEvent(TRACE_FRAME, 1, 0);
+    hostSetTime(0x100000100ULL);       // micros() has wrapped
+    traceEvent(TRACE_FRAME, 2, 0);
+    drainAll(out);
+
+    TraceDecoder decoder;
+    std::vector<TraceItem_t> items = decode(out.bytes, decoder);
+    CHECK(items.size() == 2);
+    if (items.size() == 2)
+        CHECK(items[1].event.timeline == 0x200);
+}
+
+static void testMixedWithText(void)
+{
+    traceReset();
+    Capture out;
+
+    out.println("Binary trace on");
+    traceEvent(TRACE_FRAME, 3, 4);
+    drainAll(out);
+    out.print("Pan: ");
+    out.println(12.5f);
+    traceEvent(TRACE_HALL_EDGE, 0, 0);
+    drainAll(out);
+    out.println("done");
+
+    TraceDecoder decoder;
+    std::vector<TraceItem_t> items = decode(out.bytes, decoder);
+    CHECK(items.size() == 5);
+    CHECK(decoder.records() == 2);
+    CHECK(decoder.rejected() == 0);
+    if (items.size() != 5)
+        return;
+
+    CHECK(!items[0].record && items[0].text == "Binary trace on");
+    CHECK(items[1].record && items[1].event.id == TRACE_FRAME);
+    CHECK(!items[2].record && items[2].text == "Pan: 12.50");
+    CHECK(items[3].record && items[3].event.id == TRACE_HALL_EDGE);
+    CHECK(!items[4].record && items[4].text == "done");
+}
+
+static void testJoinPartWay(void)
+{
+    traceReset();
+    Capture out;
+
+    // payloads full of sync bytes, joined after the first record's sync
+    for (int i = 0; i < 20; i++)
+        traceEvent(TRACE_PI_BACKLOG, 0xA5A5, 0xA5A5A5A5);
+    drainAll(out);
+    out.bytes.erase(out.bytes.begin(), out.bytes.begin() + 1);
+
+    TraceDecoder decoder;
+    std::vector<TraceItem_t> items = decode(out.bytes, decoder);
+
+    size_t records = 0;
+    for (size_t i = 0; i < items.size(); i++){
+        if (items[i].record){
+            records++;
+            CHECK(items[i].event.arg0 == 0xA5A5 && items[i].event.arg1 == 0xA5A5A5A5);
+        }
+    }
+    CHECK(records == 19);
+}
+
+static void testSplitReads(void)
+{
+    traceReset();
+    Capture out;
+
+    for (int i = 0; i < 10; i++){
+        traceEvent(TRACE_FRAME, i, i);
+        out.println("x");
+    }
+    drainAll(out);
+
+    // one byte at a time, as a slow port delivers it
+    TraceDecoder decoder;
+    std::vector<TraceItem_t> items;
+    for (size_t i = 0; i < out.bytes.size(); i++)
+        decoder.push(&out.bytes[i], 1, items);
+    decoder.finish(items);
+
+    CHECK(decoder.records() == 10);
+    CHECK(decoder.rejected() == 0);
+}
+
+static void testDropped(void)
+{
+    traceReset();
+    Capture out;
+
+    for (int i = 0; i < TRACE_SIZE; i++)
+        CHECK(traceEvent(TRACE_FRAME, i, 0));
+    CHECK(!traceEvent(TRACE_FRAME, 0, 0));
+    CHECK(!traceEvent(TRACE_FRAME, 0, 0));
+    drainAll(out);
+
+    TraceDecoder decoder;
+    std::vector<TraceItem_t> items = decode(out.bytes, decoder);
+    CHECK(items.size() == TRACE_SIZE + 1);
+    if (items.size() == TRACE_SIZE + 1){
+        CHECK(items[0].event.id == TRACE_DROPPED && items[0].event.arg1 == 2);
+        CHECK(items[TRACE_SIZE].event.arg0 == TRACE_SIZE - 1);
+    }
+}
+
+/**
+  * @brief  Producer threads stand in for interrupt handlers writing while
+  *     the main loop drains, with small drain budgets so the ring fills
+  * @param  void
+  * @return void
+  */
+static void testStress(void)
+{
+    traceReset();
+    host_clock_step = 1;
+
+    Capture out;
+    std::atomic<int> running(STRESS_PRODUCERS);
+    std::vector<std::thread> producers;
+
+    for (int p = 0; p < STRESS_PRODUCERS; p++){
+        producers.push_back(std::thread([p, &running]() {
+            for (uint32_t n = 0; n < STRESS_EVENTS; n++){
+                traceEvent(TRACE_FRAME, p, n);
+                if (n % 8 == 0)
+                    std::this_thread::yield();
+            }
+            running--;
+        }));
+    }
+
+    uint32_t budget = 0;
+    while (running > 0){
+        budget = (budget * 1103515245 + 12345) & 0x3FF;
+        traceDrain(out, budget);
+    }
+    for (size_t p = 0; p < producers.size(); p++)
+        producers[p].join();
+    drainAll(out);
+    host_clock_step = 0;
+
+    TraceDecoder decoder;
+    std::vector<TraceItem_t> items = decode(out.bytes, decoder);
+    CHECK(decoder.rejected() == 0);
+
+    uint64_t received = 0, dropped = 0;
+    int64_t next[STRESS_PRODUCERS] = {0};
+    bool ordered = true, known = true;
+
+    for (size_t i = 0; i < items.size(); i++){
+        const TraceRecord_t& event = items[i].event;
+        if (!items[i].record || event.id == TRACE_DROPPED){
+            known &= items[i].record;
+            dropped += event.arg1;
+            continue;
+        }
+        if (event.id != TRACE_FRAME || event.arg0 >= STRESS_PRODUCERS){
+            known = false;
+            continue;
+        }
+        // each producer's events come out in the order it wrote them
+        ordered &= (int64_t)event.arg1 >= next[event.arg0];
+        next[event.arg0] = event.arg1 + 1;
+        received++;
+    }
+
+    printf("    %llu received, %llu dropped\n", (unsigned long long)received, (unsigned long long)dropped);
+    CHECK(known);
+    CHECK(ordered);
+    CHECK(received + dropped == (uint64_t)STRESS_PRODUCERS * STRESS_EVENTS);
+    CHECK(received > 0);
+}
+
+int main(void)
+{
+    RUN(testRoundTrip);
+    RUN(testTimelineWrap);
+    RUN(testMixedWithText);
+    RUN(testJoinPartWay);
+    RUN(testSplitReads);
+    RUN(testDropped);
+    RUN(testStress);
+    return testSummary("trace");
+}
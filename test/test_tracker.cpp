@@ -0,0 +1,227 @@
+/*
+ * Revolution Tracker Tests
+ *
+ * @file    test_tracker.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Follows the 32 bit ODrive shadow count through millions
+ * of system revolutions and many wraps, in both directions, and checks
+ * the unwrapped position, the floor division behind revolutions() and
+ * angle(), and that nearestIndex() always gives the shortest move back.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "test.h"
+#include "tracker.h"
+
+/* Constants -----------------------------------------------------------*/
+#define REVOLUTION          (8192 * 5)  // CPR * TENSION_SCALING_FACTOR
+#define LONG_SHOW           5000000LL   // system revolutions in one direction
+#define MAX_STEP            (1LL << 30) // counts between updates, under the 2^31 limit
+#define SHOW_STEP           40960       // counts in a TRACKING_INTERVAL at the pan velocity limit
+
+/* Variables  ----------------------------------------------------------*/
+static uint64_t random_state = 0x2545F4914F6CDD1DULL;
+
+/* Functions------------------------------------------------------------*/
+static int64_t uniform(int64_t low, int64_t high)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return low + (int64_t)(random_state % (uint64_t)(high - low + 1));
+}
+
+// what the ODrive reports for an unwrapped count, wrapping at 32 bits
+static int32_t shadowCount(int64_t count)
+{
+    return (int32_t)(uint32_t)count;
+}
+
+/**
+  * @brief  Whether the tracker agrees with the true unwrapped count
+  * @param  RevolutionTracker& tracker - tracker under test
+  * @param  int64_t truth - unwrapped count
+  * @param  int64_t origin - unwrapped count of the system index
+  * @return bool - true when position, revolutions, angle and nearestIndex are exact
+  */
+static bool agrees(RevolutionTracker& tracker, int64_t truth, int64_t origin)
+{
+    if (tracker.position() != truth)
+        return false;
+
+    // floor division: the angle is never negative and the two add back up exactly
+    int64_t revolutions = tracker.revolutions();
+    int32_t angle = tracker.angle();
+    if (angle < 0 || angle >= REVOLUTION || revolutions * REVOLUTION + angle != truth - origin)
+        return false;
+
+    // the index lands on a whole revolution and the move to index + offset is the shortest
+    int32_t offset = (int32_t)uniform(-3 * REVOLUTION, 3 * REVOLUTION);
+    int64_t index = tracker.nearestIndex(offset);
+    int64_t move = index + offset - truth;
+    return (index - origin) % REVOLUTION == 0 && move >= -REVOLUTION / 2 && move <= REVOLUTION / 2;
+}
+
+/**
+  * @brief  Turns the axis a long way in random steps and checks along the way
+  * @param  int64_t start - unwrapped count at the reset
+  * @param  int64_t distance - counts to travel, signed
+  * @param  int64_t origin - unwrapped count of the system index
+  * @param  int64_t max_step - most counts between updates
+  * @return bool - true when every check agreed
+  */
+static bool run(int64_t start, int64_t distance, int64_t origin, int64_t max_step)
+{
+    // the tracker counts in the frame of the shadow count, the test in the true one
+    int64_t frame = start - shadowCount(start);
+    RevolutionTracker tracker;
+    tracker.reset(shadowCount(start), origin - frame, REVOLUTION);
+
+    int64_t truth = start;
+    int64_t end = start + distance;
+    int64_t direction = distance >= 0 ? 1 : -1;
+    int64_t updates = 0;
+    bool ok = true;
+
+    while (truth != end){
+        // mostly onwards, sometimes backing up a little
+        int64_t step = uniform(-max_step / 8, max_step) * direction;
+        if (llabs(end - truth) < max_step)
+            step = end - truth;
+
+        truth += step;
+        tracker.update(shadowCount(truth));
+        updates++;
+
+        ok &= agrees(tracker, truth - frame, origin - frame);
+    }
+
+    printf("    %+15lld counts, %lld revolutions, %lld shadow count wraps, %lld updates\n", (long long)distance,
+        (long long)(llabs(distance) / REVOLUTION), (long long)(llabs(distance) >> 32), (long long)updates);
+    return ok;
+}
+
+static void testUpdateWraps(void)
+{
+    RevolutionTracker tracker;
+    CHECK(!tracker.known());
+
+    // across the positive and negative 32 bit limits in both directions
+    tracker.reset(INT32_MAX - 10, 0, REVOLUTION);
+    CHECK(tracker.known());
+    tracker.update(INT32_MIN + 9);
+    CHECK(tracker.position() == (int64_t)INT32_MAX + 10);
+    tracker.update(INT32_MAX - 10);
+    CHECK(tracker.position() == INT32_MAX - 10);
+
+    tracker.reset(INT32_MIN + 5, 0, REVOLUTION);
+    tracker.update(INT32_MAX - 4);
+    CHECK(tracker.position() == (int64_t)INT32_MIN - 5);
+
+    // the largest step an update may cover
+    tracker.reset(0, 0, REVOLUTION);
+    tracker.update(INT32_MAX);
+    tracker.update(INT32_MIN);
+    CHECK(tracker.position() == (int64_t)INT32_MAX + 1);
+}
+
+static void testFloorDivision(void)
+{
+    RevolutionTracker tracker;
+
+    // exact multiples and one count either side, about the origin
+    struct { int64_t offset; int64_t revolutions; int32_t angle; } cases[] = {
+        {0, 0, 0},
+        {1, 0, 1},
+        {-1, -1, REVOLUTION - 1},
+        {REVOLUTION - 1, 0, REVOLUTION - 1},
+        {REVOLUTION, 1, 0},
+        {-REVOLUTION, -1, 0},
+        {-REVOLUTION - 1, -2, REVOLUTION - 1},
+        {-REVOLUTION + 1, -1, 1},
+    };
+
+    bool exact = true;
+    for (auto& c : cases){
+        for (int64_t origin : {0LL, 12345LL, -987654321LL}){
+            tracker.reset(0, origin, REVOLUTION);
+            tracker.update((int32_t)(origin + c.offset));
+            exact &= tracker.revolutions() == c.revolutions && tracker.angle() == c.angle;
+        }
+    }
+    CHECK(exact);
+}
+
+static void testNearestIndex(void)
+{
+    RevolutionTracker tracker;
+    tracker.reset(0, 1000, REVOLUTION);
+
+    // at the index the index is nearest, whatever the offset's sign
+    tracker.update(1000);
+    CHECK(tracker.nearestIndex(0) == 1000);
+    CHECK(tracker.nearestIndex(REVOLUTION / 4) == 1000);
+    CHECK(tracker.nearestIndex(-REVOLUTION / 4) == 1000);
+
+    // past half a revolution the next index is closer
+    CHECK(tracker.nearestIndex(REVOLUTION / 2 + 1) == 1000 - REVOLUTION);
+    CHECK(tracker.nearestIndex(-REVOLUTION / 2 - 1) == 1000 + REVOLUTION);
+
+    // offsets of several revolutions fold back
+    CHECK(tracker.nearestIndex(3 * REVOLUTION + 100) == 1000 - 3 * REVOLUTION);
+
+    // three and a bit revolutions back from the index
+    tracker.update(1000 - 3 * REVOLUTION - 200);
+    CHECK(tracker.nearestIndex(0) == 1000 - 3 * REVOLUTION);
+    CHECK(tracker.nearestIndex(-300) == 1000 - 3 * REVOLUTION);
+}
+
+static void testLongShow(void)
+{
+    // millions of revolutions each way, the shadow count wrapping many times
+    int64_t distance = LONG_SHOW * REVOLUTION;
+    CHECK(run(0, distance, 0, MAX_STEP));
+    CHECK(run(0, -distance, 0, MAX_STEP));
+    CHECK(run(123456789, distance + 17, -5000, MAX_STEP));
+    CHECK(run((int64_t)INT32_MAX - 1000, -distance - REVOLUTION / 2, INT32_MAX, MAX_STEP));
+
+    // and at the rate the firmware reads it during continuous rotation
+    CHECK(run(-77777, distance, 31415, SHOW_STEP));
+
+    // where a float position would have been after the same show
+    float position = (float)distance;
+    printf("    a float position there steps %.0f counts, %.0f degrees of pan\n",
+        nextafterf(position, INFINITY) - position, (nextafterf(position, INFINITY) - position) * 360.0 / REVOLUTION);
+}
+
+static void testStale(void)
+{
+    RevolutionTracker tracker;
+    hostSetTime(1000000);
+    tracker.reset(0, 0, REVOLUTION);
+    CHECK(!tracker.stale());
+
+    hostAdvance((TRACKING_INTERVAL - 1) * 1000UL);
+    CHECK(!tracker.stale());
+    hostAdvance(1000);
+    CHECK(tracker.stale());
+
+    tracker.update(100);
+    CHECK(!tracker.stale());
+}
+
+int main(void)
+{
+    RUN(testUpdateWraps);
+    RUN(testFloorDivision);
+    RUN(testNearestIndex);
+    RUN(testLongShow);
+    RUN(testStale);
+    return testSummary("tracker");
+}
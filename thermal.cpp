@@ -0,0 +1,84 @@
+/*
+ * Thermal Source
+ *
+ * @file    thermal.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Thermal derating of the motors.
+ * Lowers the ODrive current limit and the trajectory accelerations as the
+ * enclosure heats up, so a hot fixture keeps running at reduced performance
+ * instead of faulting.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include <math.h>
+
+#include "thermal.h"
+#include "calibration.h"
+#include "fan.h"
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Derates the motors from the hottest temperature sensor, writes are
+  *     deduplicated and at most every DERATE_WRITE_INTERVAL
+  * @param  void
+  * @return void
+  */
+void ThermalManager::service()
+{
+    float temperature;
+
+    // startup rewrites the full current limit
+    if (!startup_.done()){
+        applied_known_ = false;
+        return;
+    }
+
+    if (!hottestTemperature(temperature))
+        return;
+
+    float factor = derating(temperature);
+
+    // limits are only raised again once the enclosure has cooled a little
+    if (factor > factor_)
+        factor = max(factor_, derating(temperature + DERATE_HYSTERESIS));
+
+    if (applied_known_ && (factor == factor_ || write_timer_ < DERATE_WRITE_INTERVAL))
+        return;
+
+    for (int axis = 0; axis < NUM_MOTORS; axis++)
+        odrive_.ConfigureCurrentLimit(axis, CURRENT_LIM * factor);
+    motion_.setAccelerationScale(factor);
+
+    #ifdef TESTING
+        if (factor != factor_){
+            SerialUSB.print("Thermal derating ");
+            SerialUSB.print(factor);
+            SerialUSB.print(" at ");
+            SerialUSB.println(temperature);
+        }
+    #endif
+
+    factor_ = factor;
+    applied_known_ = true;
+    write_timer_ = 0;
+}
+
+/**
+  * @brief  Fraction of the current and acceleration limits allowed at a temperature
+  * @param  float temperature - degrees C
+  * @return float - between DERATE_MIN_FACTOR and 1, in steps of DERATE_STEP
+  */
+float ThermalManager::derating(float temperature)
+{
+    float fraction = constrain((temperature - DERATE_START_TEMP) / (DERATE_END_TEMP - DERATE_START_TEMP), 0.0f, 1.0f);
+    float factor = 1.0f - fraction * (1.0f - DERATE_MIN_FACTOR);
+
+    // round down so the limits never sit above the curve
+    return max(DERATE_MIN_FACTOR, floorf(factor / DERATE_STEP + 1e-3f) * DERATE_STEP);
+}
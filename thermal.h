@@ -0,0 +1,59 @@
+/*
+ * Thermal Header
+ *
+ * @file    thermal.h
+ * @author  Carbon Video Systems 2019
+ * @description   Thermal derating of the motors.
+ * Lowers the ODrive current limit and the trajectory accelerations as the
+ * enclosure heats up, so a hot fixture keeps running at reduced performance
+ * instead of faulting.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef THERMAL_H
+#define THERMAL_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+#include "ODriveLib.h"
+#include "motion.h"
+#include "startup.h"
+#include "options.h"
+
+/* Constants -----------------------------------------------------------*/
+#define DERATE_START_TEMP       55.0f   // degrees C, full performance below
+#define DERATE_END_TEMP         75.0f   // degrees C, minimum performance above
+#define DERATE_MIN_FACTOR       0.4f    // fraction of the current and acceleration limits
+#define DERATE_STEP             0.05f   // factors are rounded to this to limit writes
+#define DERATE_HYSTERESIS       2.0f    // degrees C of cooling before the limits are raised
+#define DERATE_WRITE_INTERVAL   2000    // ms between ODrive limit writes
+
+/* Functions------------------------------------------------------------*/
+class ThermalManager {
+public:
+    ThermalManager(ODriveClass& odrive, MotionPlanner& motion, StartupSequencer& startup) :
+        odrive_(odrive), motion_(motion), startup_(startup), factor_(1.0f), applied_known_(false) {}
+
+    void service();
+
+    float factor() { return factor_; }
+
+private:
+    ODriveClass& odrive_;
+    MotionPlanner& motion_;
+    StartupSequencer& startup_;
+
+    float factor_;          // derating currently applied
+    bool applied_known_;    // factor_ has been written since the ODrive was configured
+    elapsedMillis write_timer_;
+
+    static float derating(float temperature);
+};
+
+#endif //THERMAL_H
@@ -0,0 +1,132 @@
+/*
+ * Trace Decoder
+ *
+ * @file    trace_decode.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Renders the binary trace drained over USB as a timeline.
+ * Reads a capture file, or standard input so it can follow the port live:
+ *
+ *     stty -F /dev/ttyACM0 raw && cat /dev/ttyACM0 | ./trace_decode
+ *
+ * Each record gets a line with its time from the first record, the gap
+ * from the previous record, a lane per event type and its arguments.
+ * Console text is passed through in place, -q drops it.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+
+#include "trace_decode.h"
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Describes the arguments of a record
+  * @param  const TraceRecord_t& event - decoded record
+  * @param  char* text - description is written here
+  * @param  size_t size - size of text
+  * @return void
+  */
+static void describe(const TraceRecord_t& event, char* text, size_t size)
+{
+    switch (event.id){
+    case 0:
+        snprintf(text, size, "lost %u", (unsigned)event.arg1);
+        break;
+    case 1:
+        snprintf(text, size, "%s", event.arg0 ? "latched" : "");
+        break;
+    case 3:
+        snprintf(text, size, "%u bytes waiting", (unsigned)event.arg0);
+        break;
+    case 4:
+        snprintf(text, size, "type %u size %u", (unsigned)event.arg0, (unsigned)event.arg1);
+        break;
+    default:
+        text[0] = '\0';
+        break;
+    }
+}
+
+/**
+  * @brief  Prints one decoded item of the timeline
+  * @param  const TraceItem_t& item - record or text line
+  * @param  int64_t& previous - timeline of the previous record, updated
+  * @param  bool quiet - drop console text
+  * @return void
+  */
+static void render(const TraceItem_t& item, int64_t& previous, bool quiet)
+{
+    if (!item.record){
+        if (!quiet)
+            printf("%25s | %s\n", "", item.text.c_str());
+        return;
+    }
+
+    const TraceRecord_t& event = item.event;
+    char lanes[TRACE_DECODE_IDS + 1];
+    memset(lanes, '.', TRACE_DECODE_IDS);
+    lanes[TRACE_DECODE_IDS] = '\0';
+    lanes[event.id] = '*';
+
+    char args[48];
+    describe(event, args, sizeof(args));
+
+    printf("%12.3f ms %+9.3f | %s %-13s %s\n", event.timeline / 1000.0, (event.timeline - previous) / 1000.0, lanes, trace_names[event.id], args);
+    previous = event.timeline;
+}
+
+int main(int argc, char** argv)
+{
+    bool quiet = false;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-q") == 0)
+            quiet = true;
+        else if (argv[i][0] == '-' && argv[i][1] != '\0'){
+            fprintf(stderr, "usage: %s [-q] [capture file]\n", argv[0]);
+            return 2;
+        }
+        else
+            path = argv[i];
+    }
+
+    FILE* in = (path && strcmp(path, "-") != 0) ? fopen(path, "rb") : stdin;
+    if (in == NULL){
+        perror(path);
+        return 1;
+    }
+
+    printf("%12s %12s | ", "time", "gap");
+    for (size_t id = 0; id < TRACE_DECODE_IDS; id++)
+        printf("%c", trace_names[id][0]);
+    printf("\n");
+
+    TraceDecoder decoder;
+    std::vector<TraceItem_t> items;
+    int64_t previous = 0;
+    uint8_t buffer[4096];
+    size_t size;
+
+    while ((size = fread(buffer, 1, sizeof(buffer), in)) > 0){
+        decoder.push(buffer, size, items);
+        for (size_t i = 0; i < items.size(); i++)
+            render(items[i], previous, quiet);
+        items.clear();
+        fflush(stdout);
+    }
+
+    decoder.finish(items);
+    for (size_t i = 0; i < items.size(); i++)
+        render(items[i], previous, quiet);
+
+    fprintf(stderr, "%u records, %u sync bytes rejected\n", decoder.records(), decoder.rejected());
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Trace Decoder Header
+ *
+ * @file    trace_decode.h
+ * @author  Carbon Video Systems 2019
+ * @description   Host side decoder for the binary trace records the
+ * firmware drains over USB (trace.cpp).  Records share the port with the
+ * ASCII console text, a TRACE_SYNC byte only starts a record when the id
+ * is known and the CRC-8 at the end matches, every other byte is text.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef TRACE_DECODE_H
+#define TRACE_DECODE_H
+
+/* Includes-------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Constants -----------------------------------------------------------*/
+// must match trace.h
+#define TRACE_DECODE_SYNC           0xA5
+#define TRACE_DECODE_RECORD_SIZE    13      // sync, id, arg0 BE16, arg1 BE32, time BE32, crc8
+
+static const char* const trace_names[] = {
+    "DROPPED", "HALL_EDGE", "LED_DMA_DONE", "PI_BACKLOG", "FRAME", "TEMP_ALERT"
+};
+#define TRACE_DECODE_IDS    (sizeof(trace_names) / sizeof(trace_names[0]))
+
+/* Types ---------------------------------------------------------------*/
+struct TraceRecord_t {
+    uint8_t id;
+    uint16_t arg0;
+    uint32_t arg1;
+    uint32_t time;          // micros() as recorded, wraps every 71 minutes
+    int64_t timeline;       // time unwrapped, relative to the first record
+};
+
+// One decoded piece of the stream, a record or a line of console text
+struct TraceItem_t {
+    bool record;
+    TraceRecord_t event;
+    std::string text;
+};
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  CRC-8 (polynomial 0x07) of a block of data, as trace.cpp
+  * @param  const uint8_t* data - data to check
+  * @param  size_t length - number of bytes
+  * @return uint8_t - calculated crc
+  */
+inline uint8_t traceDecodeCrc(const uint8_t* data, size_t length)
+{
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < length; i++){
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+/* Classes -------------------------------------------------------------*/
+class TraceDecoder {
+public:
+    TraceDecoder() : started_(false), last_time_(0), timeline_(0), records_(0), rejected_(0) {}
+
+    /**
+      * @brief  Decodes the next part of the stream, a record cut off at the
+      *     end is held until more data arrives
+      * @param  const uint8_t* data - bytes read from the port
+      * @param  size_t size - number of bytes
+      * @param  std::vector<TraceItem_t>& items - decoded records and complete text lines are appended
+      * @return void
+      */
+    void push(const uint8_t* data, size_t size, std::vector<TraceItem_t>& items)
+    {
+        pending_.insert(pending_.end(), data, data + size);
+
+        size_t i = 0;
+        while (i < pending_.size()){
+            uint8_t b = pending_[i];
+
+            if (b == TRACE_DECODE_SYNC){
+                if (pending_.size() - i < TRACE_DECODE_RECORD_SIZE)
+                    break;
+                if (accept(&pending_[i], items)){
+                    i += TRACE_DECODE_RECORD_SIZE;
+                    continue;
+                }
+                rejected_++;
+            }
+
+            text(b, items);
+            i++;
+        }
+        pending_.erase(pending_.begin(), pending_.begin() + i);
+    }
+
+    /**
+      * @brief  Ends the stream, whatever is left over is text
+      * @param  std::vector<TraceItem_t>& items - remaining text is appended
+      * @return void
+      */
+    void finish(std::vector<TraceItem_t>& items)
+    {
+        for (size_t i = 0; i < pending_.size(); i++)
+            text(pending_[i], items);
+        pending_.clear();
+
+        if (!line_.empty())
+            flushLine(items);
+    }
+
+    uint32_t records() const { return records_; }
+    uint32_t rejected() const { return rejected_; }     // sync bytes that did not start a valid record
+
+private:
+    bool accept(const uint8_t* raw, std::vector<TraceItem_t>& items)
+    {
+        if (raw[1] >= TRACE_DECODE_IDS || traceDecodeCrc(raw, TRACE_DECODE_RECORD_SIZE - 1) != raw[TRACE_DECODE_RECORD_SIZE - 1])
+            return false;
+
+        TraceItem_t item;
+        item.record = true;
+        item.event.id = raw[1];
+        item.event.arg0 = (raw[2] << 8) | raw[3];
+        item.event.arg1 = ((uint32_t)raw[4] << 24) | ((uint32_t)raw[5] << 16) | ((uint32_t)raw[6] << 8) | raw[7];
+        item.event.time = ((uint32_t)raw[8] << 24) | ((uint32_t)raw[9] << 16) | ((uint32_t)raw[10] << 8) | raw[11];
+
+        // events are drained in reservation order, so a timestamp may step back slightly
+        if (started_)
+            timeline_ += (int32_t)(item.event.time - last_time_);
+        started_ = true;
+        last_time_ = item.event.time;
+        item.event.timeline = timeline_;
+
+        if (!line_.empty())
+            flushLine(items);
+        items.push_back(item);
+        records_++;
+        return true;
+    }
+
+    void text(uint8_t b, std::vector<TraceItem_t>& items)
+    {
+        if (b == '\r')
+            return;
+        if (b == '\n'){
+            flushLine(items);
+            return;
+        }
+        line_ += (char)b;
+    }
+
+    void flushLine(std::vector<TraceItem_t>& items)
+    {
+        TraceItem_t item;
+        item.record = false;
+        item.text = line_;
+        items.push_back(item);
+        line_.clear();
+    }
+
+    std::vector<uint8_t> pending_;
+    std::string line_;
+    bool started_;
+    uint32_t last_time_;
+    int64_t timeline_;
+    uint32_t records_;
+    uint32_t rejected_;
+};
+
+#endif //TRACE_DECODE_H
@@ -0,0 +1,155 @@
+/*
+ * Trace Source
+ *
+ * @file    trace.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Event trace ring buffer.
+ * Interrupt handlers and the main loop record compact timestamped events
+ * into one ring without disabling interrupts, the main loop drains it
+ * over USB in binary so everything shares one timeline.
+ *
+ * Writers reserve a slot by advancing the head with a compare and swap,
+ * which an interrupt preempting another writer simply retries.  A slot is
+ * published by storing its sequence number last, so the reader never sees
+ * a half written event.  The hall, LED DMA and alert interrupts all write
+ * alongside the main loop, so the ring takes several producers rather
+ * than giving each context a single producer ring of its own.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "trace.h"
+
+/* Variables  ----------------------------------------------------------*/
+struct TraceEvent_t {
+    uint32_t sequence;      // reservation number + 1 once the event is complete
+    uint32_t time;          // micros()
+    uint32_t arg1;
+    uint16_t arg0;
+    uint8_t id;
+};
+
+TraceEvent_t trace_ring[TRACE_SIZE];
+uint32_t trace_head = 0;        // next slot to reserve, written by any context
+uint32_t trace_tail = 0;        // next slot to drain, main loop only
+uint32_t trace_dropped = 0;
+
+/* Functions------------------------------------------------------------*/
+/**
+  * @brief  Records an event, safe from interrupt handlers and the main loop
+  * @param  TraceId_t id - event type
+  * @param  uint16_t arg0 - first event argument
+  * @param  uint32_t arg1 - second event argument
+  * @return bool - false when the ring was full and the event was dropped
+  */
+bool traceEvent(TraceId_t id, uint16_t arg0, uint32_t arg1)
+{
+    uint32_t head = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+
+    do {
+        if (head - __atomic_load_n(&trace_tail, __ATOMIC_ACQUIRE) >= TRACE_SIZE){
+            __atomic_fetch_add(&trace_dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&trace_head, &head, head + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    TraceEvent_t& event = trace_ring[head & (TRACE_SIZE - 1)];
+    event.time = micros();
+    event.id = id;
+    event.arg0 = arg0;
+    event.arg1 = arg1;
+    __atomic_store_n(&event.sequence, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+  * @brief  CRC-8 (polynomial 0x07) of a block of data
+  * @param  const uint8_t* data - data to check
+  * @param  size_t length - number of bytes
+  * @return uint8_t - calculated crc
+  */
+static uint8_t traceCrc(const uint8_t* data, size_t length)
+{
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < length; i++){
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++){
+            if (crc & 0x80)
+                crc = (crc << 1) ^ 0x07;
+            else
+                crc <<= 1;
+        }
+    }
+    return crc;
+}
+
+/**
+  * @brief  Packs one record
+  *     [sync][id][arg0, 16 bit big endian][arg1, 32 bit big endian][time, 32 bit big endian][crc8 of the preceding bytes]
+  * @param  Print& out - stream to write to
+  * @param  uint8_t id - event type
+  * @param  uint16_t arg0 - first event argument
+  * @param  uint32_t arg1 - second event argument
+  * @param  uint32_t time - micros() of the event
+  * @return void
+  */
+static void traceWrite(Print& out, uint8_t id, uint16_t arg0, uint32_t arg1, uint32_t time)
+{
+    uint8_t record[TRACE_PACKED_SIZE] = {TRACE_SYNC, id, (uint8_t)(arg0 >> 8), (uint8_t)arg0,
+        (uint8_t)(arg1 >> 24), (uint8_t)(arg1 >> 16), (uint8_t)(arg1 >> 8), (uint8_t)arg1,
+        (uint8_t)(time >> 24), (uint8_t)(time >> 16), (uint8_t)(time >> 8), (uint8_t)time, 0};
+
+    record[TRACE_PACKED_SIZE - 1] = traceCrc(record, TRACE_PACKED_SIZE - 1);
+    out.write(record, sizeof(record));
+}
+
+/**
+  * @brief  Writes completed events in binary, oldest first, call from the main loop only
+  * @param  Print& out - stream to write to
+  * @param  uint16_t budget - bytes that may be written without blocking
+  * @return uint16_t - number of events written
+  */
+uint16_t traceDrain(Print& out, uint16_t budget)
+{
+    uint16_t count = 0;
+
+    if (budget >= TRACE_PACKED_SIZE && __atomic_load_n(&trace_dropped, __ATOMIC_RELAXED) > 0){
+        traceWrite(out, TRACE_DROPPED, 0, __atomic_exchange_n(&trace_dropped, 0, __ATOMIC_RELAXED), micros());
+        budget -= TRACE_PACKED_SIZE;
+    }
+
+    while (budget >= TRACE_PACKED_SIZE){
+        TraceEvent_t& event = trace_ring[trace_tail & (TRACE_SIZE - 1)];
+
+        // stop at a slot that is still being written
+        if (__atomic_load_n(&event.sequence, __ATOMIC_ACQUIRE) != trace_tail + 1)
+            break;
+
+        traceWrite(out, event.id, event.arg0, event.arg1, event.time);
+        __atomic_store_n(&trace_tail, trace_tail + 1, __ATOMIC_RELEASE);
+        budget -= TRACE_PACKED_SIZE;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+  * @brief  Discards every completed event, call from the main loop only
+  * @param  void
+  * @return void
+  */
+void traceReset(void)
+{
+    while (__atomic_load_n(&trace_ring[trace_tail & (TRACE_SIZE - 1)].sequence, __ATOMIC_ACQUIRE) == trace_tail + 1)
+        __atomic_store_n(&trace_tail, trace_tail + 1, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&trace_dropped, 0, __ATOMIC_RELAXED);
+}
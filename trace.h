@@ -0,0 +1,48 @@
+/*
+ * Trace Header
+ *
+ * @file    trace.h
+ * @author  Carbon Video Systems 2019
+ * @description   Event trace ring buffer.
+ * Interrupt handlers and the main loop record compact timestamped events
+ * into one ring without disabling interrupts, the main loop drains it
+ * over USB in binary so everything shares one timeline.
+ *
+ * Records share the port with the ASCII console text.  Every record ends
+ * in a CRC-8 so the host decoder (tools/trace_decode) only accepts a
+ * TRACE_SYNC byte that starts a record whose CRC matches.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+
+/* Constants -----------------------------------------------------------*/
+#define TRACE_SIZE          128     // events, must be a power of two
+#define TRACE_SYNC          0xA5    // first byte of every drained record, never part of ASCII text
+#define TRACE_PACKED_SIZE   13      // sync, id, arg0 BE16, arg1 BE32, time BE32, crc8
+#define TRACE_BACKLOG_LEVEL 48      // Pi receive bytes worth tracing, the buffer holds 64
+
+enum TraceId_t {
+    TRACE_DROPPED = 0,          // arg1: events lost because the ring was full
+    TRACE_HALL_EDGE = 1,        // arg0: 1 when the edge was latched for homing
+    TRACE_LED_DMA_DONE = 2,
+    TRACE_PI_BACKLOG = 3,       // arg0: bytes waiting in the Pi receive buffer
+    TRACE_FRAME = 4,            // arg0: message type, arg1: message size
+    TRACE_TEMP_ALERT = 5        // a TMP102 ALERT line fired
+};
+
+/* Functions------------------------------------------------------------*/
+bool traceEvent(TraceId_t id, uint16_t arg0, uint32_t arg1);
+uint16_t traceDrain(Print& out, uint16_t budget);
+void traceReset(void);
+
+#endif //TRACE_H
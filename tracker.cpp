@@ -0,0 +1,102 @@
+/*
+ * Tracker Source
+ *
+ * @file    tracker.cpp
+ * @author  Carbon Video Systems 2019
+ * @description   Unwrapped axis position tracking.
+ * The ODrive encoder shadow count is a 32 bit integer that keeps growing
+ * during continuous rotation.  It is unwrapped into a 64 bit count so the
+ * system index can be recovered exactly after any number of revolutions.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+/* Includes-------------------------------------------------------------*/
+#include "tracker.h"
+
+/* Functions------------------------------------------------------------*/
+static int64_t floor_divide(int64_t numerator, int64_t denominator);
+
+/**
+  * @brief  Starts tracking from a known position
+  * @param  int32_t count - current ODrive shadow count
+  * @param  int64_t origin - count of the system index, in the same frame
+  * @param  int32_t revolution - counts per system revolution
+  * @return void
+  */
+void RevolutionTracker::reset(int32_t count, int64_t origin, int32_t revolution)
+{
+    last_count_ = count;
+    position_ = count;
+    origin_ = origin;
+    revolution_ = revolution;
+    known_ = true;
+    updated_ = 0;
+}
+
+/**
+  * @brief  Accumulates the movement since the last update, must be called
+  *     before the shadow count travels 2^31 counts
+  * @param  int32_t count - current ODrive shadow count
+  * @return void
+  */
+void RevolutionTracker::update(int32_t count)
+{
+    // unsigned subtraction so the step is right across a 32 bit wrap
+    position_ += (int32_t)((uint32_t)count - (uint32_t)last_count_);
+    last_count_ = count;
+    updated_ = 0;
+}
+
+/**
+  * @brief  Whole system revolutions from the origin, rounded down
+  * @param  void
+  * @return int64_t - revolutions
+  */
+int64_t RevolutionTracker::revolutions()
+{
+    return floor_divide(position_ - origin_, revolution_);
+}
+
+/**
+  * @brief  Position within the current system revolution
+  * @param  void
+  * @return int32_t - counts from the origin, 0 to revolution - 1
+  */
+int32_t RevolutionTracker::angle()
+{
+    return (int32_t)(position_ - origin_ - revolutions() * revolution_);
+}
+
+/**
+  * @brief  Index (origin plus whole revolutions) that puts index + offset
+  *     closest to the current position, giving the shortest move back
+  * @param  int32_t offset - requested position relative to the index in counts
+  * @return int64_t - index count
+  */
+int64_t RevolutionTracker::nearestIndex(int32_t offset)
+{
+    int64_t revolutions = floor_divide(position_ - origin_ - offset + revolution_ / 2, revolution_);
+
+    return origin_ + revolutions * revolution_;
+}
+
+/**
+  * @brief  Integer division rounding towards negative infinity
+  * @param  int64_t numerator
+  * @param  int64_t denominator - must be positive
+  * @return int64_t - quotient
+  */
+static int64_t floor_divide(int64_t numerator, int64_t denominator)
+{
+    int64_t quotient = numerator / denominator;
+
+    if ((numerator % denominator) < 0)
+        quotient--;
+
+    return quotient;
+}
@@ -0,0 +1,54 @@
+/*
+ * Tracker Header
+ *
+ * @file    tracker.h
+ * @author  Carbon Video Systems 2019
+ * @description   Unwrapped axis position tracking.
+ * The ODrive encoder shadow count is a 32 bit integer that keeps growing
+ * during continuous rotation.  It is unwrapped into a 64 bit count so the
+ * system index can be recovered exactly after any number of revolutions.
+ *
+ * @section LICENSE
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted in accordance with the BSD 3-Clause License.
+ *
+ * Distributed as-is; in accordance with the BSD 3-Clause License.
+ */
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+/* Includes-------------------------------------------------------------*/
+#include <Arduino.h>
+#include <stdint.h>
+
+/* Constants -----------------------------------------------------------*/
+#define TRACKING_INTERVAL   1000    // ms between shadow count reads during continuous rotation
+
+/* Functions------------------------------------------------------------*/
+class RevolutionTracker {
+public:
+    RevolutionTracker() : known_(false) {}
+
+    void reset(int32_t count, int64_t origin, int32_t revolution);
+    void update(int32_t count);
+
+    int64_t revolutions();
+    int32_t angle();
+    int64_t nearestIndex(int32_t offset);
+
+    bool known() { return known_; }
+    int64_t position() { return position_; }
+    bool stale() { return updated_ >= TRACKING_INTERVAL; }
+
+private:
+    bool known_;
+    int32_t last_count_;    // shadow count at the last update
+    int64_t position_;      // unwrapped count
+    int64_t origin_;        // unwrapped count of the system index
+    int32_t revolution_;    // counts per system revolution
+
+    elapsedMillis updated_;
+};
+
+#endif //TRACKER_H